@@ -0,0 +1,174 @@
+#ifndef FT_ARCHIVE_HPP
+#define FT_ARCHIVE_HPP
+
+#include "ft_includes.hpp"
+
+#ifdef FT_ENABLE_ZLIB
+#include <zlib.h>
+#endif // FT_ENABLE_ZLIB
+
+// ustar archives made and read on the fly, gzip wrapped when built with -DFT_ENABLE_ZLIB=ON
+//
+// names longer than the header allows use a GNU long name entry, sizes of 8 GiB and more the GNU base-256 field
+
+// writes a directory tree as a tar stream in pieces of about chunk_size bytes, files are opened and small ones
+// read ahead by worker threads while the output keeps the sorted path order
+class ft_tar_writer
+{
+
+public:
+
+	using output = std::function<bool(const char*, std::size_t)>;
+
+	// fills the next piece of a content, leaves it empty at the end, false on a read error
+	using content_source = std::function<bool(std::vector<char>&)>;
+
+	// the content a stored file stands for, given its whole stored bytes : false keeps them as they are,
+	// otherwise size is the content size and source streams it
+	using content_function = std::function<bool(const std::vector<char>&, std::uint64_t&, content_source&)>;
+
+	static constexpr std::size_t block_size = 512;
+
+private:
+
+	struct entry
+	{
+		std::string path; // on disk
+		std::string name; // in the archive
+		bool directory = false;
+
+		// filled by the worker that prepares it
+		bool ready = false;
+		bool open = false;
+		std::uint64_t size = 0;
+		std::int64_t mtime = 0;
+		std::uint32_t mode = 0;
+		std::vector<char> data; // whole content of a small file
+		std::shared_ptr<std::ifstream> file; // larger files are streamed
+		content_source source; // set when the content function took the file
+#ifdef __linux__
+		int fd = -1;
+#endif // __linux__
+	};
+
+	output m_output;
+	std::vector<char> m_buffer;
+	std::size_t m_chunk_size = 1024 * 1024;
+	std::uint64_t m_bytes_written = 0;
+
+	std::size_t m_readahead_files = 64;
+	std::size_t m_readahead_bytes = 64 * 1024 * 1024;
+	std::size_t m_small_file_size = 1024 * 1024;
+	std::size_t m_number_of_threads = 4;
+
+	std::string m_content_prefix;
+	content_function m_content_function;
+	std::vector<std::filesystem::path> m_excluded;
+
+	bool m_compress = false;
+#ifdef FT_ENABLE_ZLIB
+	z_stream m_zstream;
+	bool m_zstream_open = false;
+	std::vector<char> m_compressed;
+#endif // FT_ENABLE_ZLIB
+
+public:
+
+	ft_tar_writer() = default;
+	ft_tar_writer(const ft_tar_writer&) = delete;
+	ft_tar_writer& operator=(const ft_tar_writer&) = delete;
+	ft_tar_writer(ft_tar_writer&&) = delete;
+	ft_tar_writer& operator=(ft_tar_writer&&) = delete;
+	~ft_tar_writer();
+
+	// level 0 does not compress, compression is ignored without zlib
+	bool open(output out, int compression_level = 0);
+
+	inline bool compressed() const noexcept { return m_compress; }
+
+	void set_readahead(std::size_t files, std::size_t bytes, std::size_t number_of_threads) noexcept;
+
+	// files starting with prefix are read whole and handed to fn, called by the workers
+	void set_content_function(std::string prefix, content_function fn);
+
+	// directories left out of the archive with everything under them
+	void set_excluded(const std::vector<std::string>& paths);
+
+	// the whole tree under path, entries named after the last component of path, then the end of archive
+	bool write_directory(const std::string& path);
+
+	std::uint64_t bytes_written() const noexcept;
+
+private:
+
+	bool write(const char* ptr, std::size_t n);
+
+	bool flush(bool finish);
+
+	bool write_header(const std::string& name, char type, std::uint64_t size, std::int64_t mtime, std::uint32_t mode);
+
+	bool write_entry(entry& item);
+
+	void prepare(entry& item) const;
+
+	// hands the stored bytes of an open file to the content function when they start with the prefix
+	void expand(entry& item) const;
+
+	static void close_entry(entry& item);
+
+	static bool read_at(entry& item, std::uint64_t offset, char* ptr, std::size_t n);
+};
+
+// unpacks a tar stream fed in pieces of any size under a destination directory
+class ft_tar_reader
+{
+
+private:
+
+	std::filesystem::path m_destination;
+	bool m_failed = false;
+	bool m_finished = false;
+
+	char m_header[ft_tar_writer::block_size];
+	std::size_t m_header_size = 0;
+	std::uint64_t m_remaining = 0;
+	std::uint64_t m_padding = 0;
+	char m_type = 0;
+	std::string m_long_name;
+	std::string m_pending_long_name;
+	std::ofstream m_file;
+
+	bool m_compressed = false;
+#ifdef FT_ENABLE_ZLIB
+	z_stream m_zstream;
+	bool m_zstream_open = false;
+	std::vector<char> m_inflated;
+#endif // FT_ENABLE_ZLIB
+
+public:
+
+	ft_tar_reader() = default;
+	ft_tar_reader(const ft_tar_reader&) = delete;
+	ft_tar_reader& operator=(const ft_tar_reader&) = delete;
+	ft_tar_reader(ft_tar_reader&&) = delete;
+	ft_tar_reader& operator=(ft_tar_reader&&) = delete;
+	~ft_tar_reader();
+
+	bool open(const std::string& destination, bool compressed);
+
+	bool feed(const char* ptr, std::size_t n);
+
+	// true when the archive ended properly and everything was written
+	bool finish();
+
+private:
+
+	bool parse(const char* ptr, std::size_t n);
+
+	bool begin_entry();
+
+	// relative, without ".." : nothing lands outside the destination
+	static bool safe_name(const std::string& name);
+};
+
+#endif // FT_ARCHIVE_HPP
@@ -0,0 +1,89 @@
+#ifndef FT_CHUNK_STORE_HPP
+#define FT_CHUNK_STORE_HPP
+
+#include "ft_includes.hpp"
+#include "ft_chunker.hpp"
+#include "ft_group_commit.hpp"
+
+// content addressed chunk store, each unique chunk is kept once under <root>/<2 hex digits>/<64 hex digits>,
+// stored files are replaced by a manifest listing their chunks
+class ft_chunk_store
+{
+
+private:
+
+	std::string m_root;
+	ft_chunker m_chunker;
+	ft_group_commit* m_group_commit = nullptr;
+	bool m_sync = true;
+
+	// outcome of a chunk write : 0 until the group commit is done with it, then 1 if committed, 2 if not
+	using chunk_state = std::shared_ptr<std::atomic<int>>;
+
+	// chunks submitted to the group commit and not committed yet, manifests depending on them wait for their state
+	std::unordered_map<std::string, chunk_state> m_pending_chunks;
+	mutable std::mutex m_pending_chunks_mutex;
+
+public:
+
+	// the content a manifest stands for, read chunk by chunk
+	struct content_reader
+	{
+		std::vector<ft_chunker::chunk> chunks;
+		std::size_t next = 0;
+		std::uint64_t size = 0;
+	};
+
+	ft_chunk_store() = default;
+	ft_chunk_store(const ft_chunk_store&) = delete;
+	ft_chunk_store& operator=(const ft_chunk_store&) = delete;
+	ft_chunk_store(ft_chunk_store&&) = delete;
+	ft_chunk_store& operator=(ft_chunk_store&&) = delete;
+	~ft_chunk_store() = default;
+
+	bool open(const std::string& root, ft_group_commit& group_commit, bool sync);
+
+	inline bool is_open() const noexcept { return m_group_commit != nullptr; }
+
+	inline ft_chunker& chunker() noexcept { return m_chunker; }
+
+	bool has_chunk(const ft_sha256::digest& hash) const;
+
+	// the hash is computed here, clients are not trusted to name chunks
+	bool put_chunk(const char* ptr, std::size_t n);
+
+	// splits the file into chunks, stores the missing ones and writes the manifest at file_name,
+	// on_done is called once, as for ft_group_commit::write_file, the manifest is only published
+	// once every chunk it lists is committed
+	bool store(const std::string& file_name, const char* ptr, std::size_t n, std::function<void(bool)> on_done = nullptr);
+
+	// writes a manifest built by a client, only if every chunk it lists is present
+	bool store_manifest(const std::string& file_name, const char* manifest_ptr, std::size_t n, std::function<void(bool)> on_done = nullptr);
+
+	// appends to the content a stored manifest stands for : its last chunk is split again with the appended bytes,
+	// the chunks before it are kept, on_done as for store
+	bool append(const std::string& file_name, const char* manifest_ptr, std::size_t manifest_size, const char* ptr, std::size_t n,
+		std::function<void(bool)> on_done = nullptr);
+
+	// false unless the bytes are a well formed manifest whose chunks are all stored,
+	// files that merely look like one are served as they are
+	bool open_content(const char* manifest_ptr, std::size_t n, content_reader& reader) const;
+
+	// the next chunk of the content, left empty once everything was read, false if a chunk cannot be read whole
+	bool read_content(content_reader& reader, std::vector<char>& chunk) const;
+
+private:
+
+	std::string chunk_path(const ft_sha256::digest& hash) const;
+
+	// nullptr if the chunk is neither stored nor pending, the state of a pending one, or a committed state
+	chunk_state find_chunk(const ft_sha256::digest& hash) const;
+
+	// the state of the write, nullptr if it could not even be started
+	chunk_state write_chunk(const ft_sha256::digest& hash, const char* ptr, std::size_t n);
+
+	// makes a manifest wait for the chunks it lists
+	static std::function<bool()> chunks_committed(std::vector<chunk_state> states);
+};
+
+#endif // FT_CHUNK_STORE_HPP
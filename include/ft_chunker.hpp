@@ -0,0 +1,54 @@
+#ifndef FT_CHUNKER_HPP
+#define FT_CHUNKER_HPP
+
+#include "ft_includes.hpp"
+#include "ft_sha256.hpp"
+
+// content defined chunking (FastCDC with normalized chunk sizes) and the manifest format built on it
+class ft_chunker
+{
+
+public:
+
+	struct chunk
+	{
+		std::size_t offset;
+		std::size_t size;
+		ft_sha256::digest hash;
+	};
+
+	// manifests start with these 8 bytes, then u64 file size, u32 chunk count, then (32 byte hash, u32 size) per chunk
+	static constexpr const char* manifest_magic = "ftcdcmf1";
+	static constexpr std::size_t manifest_header_size = 8 + sizeof(std::uint64_t) + sizeof(std::uint32_t);
+	static constexpr std::size_t manifest_entry_size = 32 + sizeof(std::uint32_t);
+
+private:
+
+	std::size_t m_min_size = 2 * 1024;
+	std::size_t m_average_size = 8 * 1024;
+	std::size_t m_max_size = 64 * 1024;
+	std::uint64_t m_small_mask = 0;
+	std::uint64_t m_large_mask = 0;
+
+public:
+
+	ft_chunker() { set_sizes(m_min_size, m_average_size, m_max_size); }
+
+	// average_size is rounded down to a power of 2
+	void set_sizes(std::size_t min_size, std::size_t average_size, std::size_t max_size);
+
+	std::vector<chunk> split(const char* ptr, std::size_t n) const;
+
+	static std::vector<char> make_manifest(const std::vector<chunk>& chunks, std::uint64_t file_size);
+
+	static bool read_manifest(const char* ptr, std::size_t n, std::vector<chunk>& chunks, std::uint64_t& file_size);
+
+	// the whole structure is checked : magic, chunk count against n, no empty chunk, chunk sizes adding up to the file size
+	static bool is_manifest(const char* ptr, std::size_t n) noexcept;
+
+private:
+
+	std::size_t next_boundary(const char* ptr, std::size_t n) const noexcept;
+};
+
+#endif // FT_CHUNKER_HPP
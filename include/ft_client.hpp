@@ -2,6 +2,10 @@
 #define FT_CLIENT_HPP
 
 #include "ft_includes.hpp"
+#include "ft_protocol.hpp"
+#include "ft_chunker.hpp"
+#include "ft_tls.hpp"
+#include "ft_archive.hpp"
 
 class ft_client
 {
@@ -15,12 +19,45 @@ private:
 	asio::ip::tcp::endpoint m_endpoint;
 	std::function<std::int32_t(std::int32_t)> m_validation_function = [](std::int32_t x) { return x; };
 	bool m_client_validation_enabled = true;
+	std::uint64_t m_session_token = 0;
+	std::uint64_t m_connections = 0; // opened so far, uploads in flight are lost when a new one replaces the old
+	std::uint64_t m_synced_connections = 0;
+
+	bool m_auto_reconnect = true;
+	std::size_t m_max_reconnect_attempts = 8;
+	std::chrono::milliseconds m_initial_backoff{ 10 };
+	std::chrono::milliseconds m_max_backoff{ 2000 };
+
+	bool m_low_latency = false;
+	int m_busy_poll_us = 0;
+
+	std::unique_ptr<ft_tls_session> m_tls;
+#ifdef FT_ENABLE_TLS
+	ft_tls_context m_tls_context;
+	std::string m_tls_server_name;
+#endif // FT_ENABLE_TLS
 
 	std::vector<char> buff;
 	char* m_end_ptr = nullptr;
 
+	std::size_t m_send_chunk_size = 1024 * 1024;
+	std::size_t m_have_batch_size = 16 * 1024; // chunks asked about per "have", 512 KiB of hashes, far below the server request limit
+
+	ft_chunker m_chunker;
+
+	std::vector<std::string> m_watched_paths;
+	std::vector<ft_watch_event> m_pending_watch_events; // pushes read while waiting for the answer to a watch
+
 public:
 
+	// seconds
+	struct ping_statistics
+	{
+		float min;
+		float average;
+		float p99;
+	};
+
 	ft_client() : m_socket(asio::ip::tcp::socket(m_asio_context)) {}
 	ft_client(const ft_client&) = delete;
 	ft_client& operator=(const ft_client&) = delete;
@@ -46,28 +83,68 @@ public:
 
 	void set_buffer_size(std::size_t new_buffer_size);
 
+	void set_send_chunk_size(std::size_t new_chunk_size) noexcept;
+
+	void set_have_batch_size(std::size_t new_batch_size) noexcept;
+
 	float connect(const char* ip, std::uint16_t port);
 
+	// reopens the connection to the last endpoint with exponential backoff, reusing the session token if any
+	bool reconnect();
+
 	void disconnect();
 
 	void set_validation_function(std::function<std::int32_t(std::int32_t)> fn);
 
+	void enable_client_validation(bool enable) noexcept;
+
+	void set_reconnect_policy(bool auto_reconnect, std::size_t max_attempts,
+		std::chrono::milliseconds initial_backoff, std::chrono::milliseconds max_backoff) noexcept;
+
+#ifdef FT_ENABLE_TLS
+	// call before connect, server_name is checked against the certificate when verify is on, an empty one
+	// stands for the address given to connect
+	bool enable_tls(const std::string& ca_file = std::string(), const std::string& server_name = std::string(), bool verify = true);
+#endif // FT_ENABLE_TLS
+
+	// TCP_NODELAY, and SO_BUSY_POLL for busy_poll_us when it is not 0 (Linux only)
+	void enable_low_latency(bool enable, int busy_poll_us = 0);
+
 	bool no_error() const;
 
 	bool connection_running() const;
 
 	float ping();
 
+	// number_of_samples pings in a row, everything is infinite if one fails
+	ping_statistics ping(std::size_t number_of_samples);
+
+	// true once the file is written to the connection, the server puts it in place asynchronously, call sync before
+	// relying on it being there
 	bool send_file(const std::string& file_name, const std::string& destination_file_name);
 
+	// only uploads the content defined chunks the server does not hold yet, needs a server with a chunk store
+	bool send_file_deduplicated(const std::string& file_name, const std::string& destination_file_name);
+
+	// uploads through a part file on the server bound to the sha256 of the file, reconnects and resumes at the server
+	// side offset after a drop, the server checks the hash before the file replaces the destination
+	bool send_file_resumable(const std::string& file_name, const std::string& destination_file_name);
+
 	bool get_file(const std::string& file_name, const std::string& destination_file_name);
 
+	// the whole directory in one response, unpacked under destination or saved as a .tar / .tar.gz file,
+	// compression needs zlib on the server, and on the client to unpack
+	bool get_directory(const std::string& path, const std::string& destination, bool unpack = true, bool compress = false);
+
 	bool load_file(const std::string& file_name);
 
 	void remove_file(const std::string& file_name);
 
 	char check_file(const std::string& file_name);
 
+	// size, mtime and sha256 of a server file, compare hash with the local copy when state is 'y', ask again later on 'p'
+	ft_file_status check_file_status(const std::string& file_name);
+
 	std::string get_list();
 
 	bool load_list();
@@ -77,6 +154,46 @@ public:
 	bool load_list_from_path(const std::string& path);
 
 	bool append_text(const std::string& str, const std::string& destination_file_name);
+
+	// blocks until every upload sent before is in place on the server, and synced when the server has durable writes,
+	// false if one of them failed or the connection was reopened since the last sync
+	bool sync();
+
+	// a request with any opcode followed by a sized response read into the buffer, for protocol extensions
+	bool exchange(std::uint32_t opcode, const std::string& name, const void* const payload_ptr = nullptr, std::size_t payload_size = 0);
+
+	// subscribes to changes of a directory or of the files starting with a path, the server pushes events on
+	// this connection from then on, so a client that watches should not be used for anything else
+	bool watch(const std::string& path);
+
+	// blocks until the next batch of events, resubscribes after a reconnection
+	bool read_watch_events(std::vector<ft_watch_event>& events);
+
+private:
+
+	// the next sized frame of a watching connection, pushes are decoded into events, false on a broken stream
+	bool read_watch_frame(bool& push, std::vector<ft_watch_event>& events);
+
+	bool open_connection();
+
+	// handshake on the freshly connected socket when TLS is enabled
+	bool start_tls();
+
+	// the greeting of the server, false unless it speaks ft_protocol::version
+	bool read_hello();
+
+	bool write_request(std::uint32_t opcode, const std::string& name, const void* const payload_ptr = nullptr, std::size_t payload_size = 0);
+
+	// the header announces payload_size bytes, the first ones are gathered with it, write_payload sends the rest
+	bool write_request_begin(std::uint32_t opcode, const std::string& name, std::uint64_t payload_size,
+		const void* const first_payload_ptr, std::size_t first_payload_size);
+
+	bool write_payload(const void* const payload_ptr, std::size_t payload_size);
+
+	std::uint64_t read_response_size();
+
+	// reads a sized response into buff
+	bool read_response();
 };
 
 #endif // FT_CLIENT_HPP
@@ -0,0 +1,97 @@
+#ifndef FT_GROUP_COMMIT_HPP
+#define FT_GROUP_COMMIT_HPP
+
+#include "ft_includes.hpp"
+
+// coalesces fsync requests from concurrent writers into one sync cycle per latency bound
+class ft_group_commit
+{
+
+private:
+
+	struct pending_sync
+	{
+		int fd;
+		std::function<bool(bool)> on_synced;
+		std::string directory;
+		std::function<void(bool)> on_committed;
+		bool dependent;
+	};
+
+	std::vector<pending_sync> m_pending;
+	std::chrono::steady_clock::time_point m_first_pending_time;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::thread m_thread;
+
+	std::atomic<std::uint64_t> m_temp_file_counter{ 0 };
+
+	// renames waiting for their sync cycle, by destination, as tickets from m_next_ticket
+	std::unordered_map<std::string, std::set<std::uint64_t>> m_publishing;
+	std::uint64_t m_next_ticket = 0;
+	std::mutex m_publishing_mutex;
+	std::condition_variable m_published;
+
+	std::chrono::microseconds m_latency_bound{ 2000 };
+	std::size_t m_max_batch_size = 256;
+	bool m_running = false;
+
+public:
+
+	ft_group_commit() = default;
+	ft_group_commit(const ft_group_commit&) = delete;
+	ft_group_commit& operator=(const ft_group_commit&) = delete;
+	ft_group_commit(ft_group_commit&&) = delete;
+	ft_group_commit& operator=(ft_group_commit&&) = delete;
+	~ft_group_commit();
+
+	void start();
+
+	// syncs everything still pending before returning
+	void stop();
+
+	// takes ownership of fd : it is synced, on_synced is called with the fdatasync outcome and returns whether the
+	// change it publishes is done, then fd is closed, directory (if not empty) is synced once per cycle after all
+	// callbacks ran, and on_committed is told whether the whole thing is durable,
+	// a dependent item is only synced once every other item of its cycle is committed
+	void submit(int fd, std::function<bool(bool)> on_synced = nullptr, std::string directory = std::string(),
+		std::function<void(bool)> on_committed = nullptr, bool dependent = false);
+
+	// writes <file_name>.ft_tmpN and renames it over file_name, after the next sync cycle if sync is true,
+	// a temp file that fails to sync is removed instead, on_done is called exactly once, with false if the file
+	// did not make it into place, and only after its directory is synced when sync is true,
+	// with ready the file depends on files written before it : it is published after they are committed,
+	// and only if ready() then returns true
+	bool write_file(const std::string& file_name, const char* ptr, std::size_t n, bool sync = true,
+		std::function<void(bool)> on_done = nullptr, std::function<bool()> ready = nullptr);
+
+	// moves an already written file over file_name, source is renamed aside right away so it can be reused at once,
+	// on_done as for write_file
+	bool commit_file(const std::string& source_file_name, const std::string& file_name, bool sync = true,
+		std::function<void(bool)> on_done = nullptr);
+
+	// blocks until every write_file or commit_file to file_name submitted before is published or dropped,
+	// so that a later change to the same name is not undone by the rename
+	void wait_published(const std::string& file_name);
+
+	void set_latency_bound(std::chrono::microseconds latency_bound);
+
+	void set_max_batch_size(std::size_t max_batch_size);
+
+private:
+
+	void run();
+
+	void sync_batch(std::vector<pending_sync>& batch);
+
+	void sync_items(std::vector<pending_sync>& batch, bool dependent);
+
+	// renames temp_file_name over file_name if synced, removes it otherwise, true once file_name holds the new content
+	static bool publish(const std::string& temp_file_name, const std::string& file_name, bool synced);
+
+	std::uint64_t begin_publish(const std::string& file_name);
+
+	void end_publish(const std::string& file_name, std::uint64_t ticket);
+};
+
+#endif // FT_GROUP_COMMIT_HPP
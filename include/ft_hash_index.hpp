@@ -0,0 +1,150 @@
+#ifndef FT_HASH_INDEX_HPP
+#define FT_HASH_INDEX_HPP
+
+#include "ft_includes.hpp"
+#include "ft_sha256.hpp"
+
+// sha256 of every file under a root, kept in a memory mapped open addressing table that outlives the server,
+// keyed by the sha256 of the normalized path
+//
+// an entry is only trusted while the file still has the size and mtime it had when hashed, so a change the index
+// was not told about is caught at lookup, and only once it was hashed after its mtime tick was over, files are
+// (re)hashed by a background thread
+class ft_hash_index
+{
+
+public:
+
+	struct record
+	{
+		std::uint64_t size = 0;
+		std::int64_t mtime = 0; // ns since the epoch
+		bool hashed = false;
+		ft_sha256::digest hash{};
+	};
+
+	// hashes the content the bytes on disk stand for instead of the bytes themselves, for chunk store manifests,
+	// false leaves the bytes to be hashed as they are
+	using content_function = std::function<bool(const char*, std::size_t, ft_sha256&, std::uint64_t&)>;
+
+private:
+
+	struct header
+	{
+		std::uint32_t magic;
+		std::uint32_t version;
+		std::uint64_t capacity; // power of 2
+		std::uint64_t used; // valid and removed slots
+		std::uint64_t reserved[5];
+	};
+
+	enum slot_state : std::uint32_t { empty = 0, valid = 1, removed = 2 };
+
+	struct slot
+	{
+		ft_sha256::digest key;
+		ft_sha256::digest hash;
+		std::uint64_t size; // of the content
+		std::uint64_t disk_size; // size and mtime of the file that was hashed, written last
+		std::int64_t mtime;
+		std::uint32_t state;
+		std::uint32_t racy; // hashed within racy_window of its mtime, a write in the same timestamp tick would not show
+	};
+
+	static constexpr std::uint32_t index_magic = 0x78697466; // "ftix"
+	static constexpr std::uint32_t index_version = 1;
+	static constexpr std::int64_t no_mtime = INT64_MIN; // never matches a file, set while a slot is rewritten or invalidated
+	static constexpr std::int64_t racy_window = 1000000000; // ns, coarser than any file system timestamp tick we expect
+
+	std::string m_file_name;
+	std::string m_root;
+	std::vector<std::string> m_excluded;
+	std::string m_content_prefix;
+	content_function m_content_function;
+
+	header* m_header = nullptr;
+	slot* m_slots = nullptr;
+	std::size_t m_mapped_size = 0;
+#ifdef __linux__
+	int m_fd = -1;
+#else
+	std::vector<char> m_fallback_buffer; // written back by close
+#endif // __linux__
+
+	std::list<std::string> m_queue;
+	std::unordered_set<std::string> m_queued;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::thread m_thread;
+	bool m_running = false;
+
+	std::atomic<std::uint64_t> m_files_hashed{ 0 };
+	std::atomic<bool> m_scan_done{ false };
+
+public:
+
+	ft_hash_index() = default;
+	ft_hash_index(const ft_hash_index&) = delete;
+	ft_hash_index& operator=(const ft_hash_index&) = delete;
+	ft_hash_index(ft_hash_index&&) = delete;
+	ft_hash_index& operator=(ft_hash_index&&) = delete;
+	~ft_hash_index();
+
+	// maps index_file_name, created or rebuilt empty if it is missing or unreadable,
+	// files under root except the excluded paths are hashed by start
+	bool open(const std::string& index_file_name, const std::string& root, std::vector<std::string> excluded = {});
+
+	void close();
+
+	inline bool is_open() const noexcept { return m_header != nullptr; }
+
+	// only files starting with prefix are read whole and offered to fn
+	void set_content_function(std::string prefix, content_function fn);
+
+	// the background thread walks the root once, then hashes what lookup, invalidate or a failed check queued
+	void start();
+
+	void stop();
+
+	// false when there is no such regular file, hashed is false while the current content waits for the background thread,
+	// size is then the size on disk
+	bool lookup(const std::string& path, record& result);
+
+	// the file was written, it is hashed again
+	void invalidate(const std::string& path);
+
+	void remove(const std::string& path);
+
+	inline std::uint64_t files_hashed() const noexcept { return m_files_hashed.load(); }
+
+	inline bool scan_done() const noexcept { return m_scan_done.load(); }
+
+	// size and mtime in ns, false when path is not a regular file
+	static bool file_status(const std::string& path, std::uint64_t& size, std::int64_t& mtime);
+
+	// on the clock of file_status mtimes
+	static std::int64_t current_time();
+
+private:
+
+	static std::string normalize(const std::string& path);
+
+	bool map(std::size_t capacity, bool reset);
+
+	void unmap();
+
+	// m_mutex is held by the caller, nullptr when the key is absent and insert is false
+	slot* find_slot(const ft_sha256::digest& key, bool insert);
+
+	bool grow();
+
+	void enqueue(const std::string& path, bool urgent);
+
+	bool excluded(const std::string& path) const;
+
+	void hash_file(const std::string& path);
+
+	void run();
+};
+
+#endif // FT_HASH_INDEX_HPP
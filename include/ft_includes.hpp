@@ -4,15 +4,25 @@
 // get asio at : https://think-async.com/Asio/
 
 #include <cstdint>
+#include <algorithm>
+#include <array>
 #include <vector>
 #include <cstring>
 #include <string>
 #include <string_view>
+#include <charconv>
 #include <iostream>
 #include <fstream>
 #include <list>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <memory>
 #include <functional>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
 #include <chrono>
 #include <random>
 #include <cassert>
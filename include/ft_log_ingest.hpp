@@ -0,0 +1,95 @@
+#ifndef FT_LOG_INGEST_HPP
+#define FT_LOG_INGEST_HPP
+
+#include "ft_includes.hpp"
+#include "ft_group_commit.hpp"
+
+// keeps destination files open and turns many small appends into few large sequential writes,
+// elsewhere than on linux every append is written through at once
+class ft_log_ingest
+{
+
+private:
+
+	class log_file
+	{
+
+	public:
+
+		// guards buffer, times and forgotten, never held across a write
+		std::mutex mutex;
+		std::vector<char> buffer;
+		std::chrono::steady_clock::time_point last_flush_time;
+		std::chrono::steady_clock::time_point last_append_time;
+		bool forgotten = false;
+
+		// guards the handle, taken before mutex, keeps the writes of a file in append order
+		std::mutex write_mutex;
+		int fd = -1;
+		std::vector<char> write_buffer;
+		std::size_t file_size = 0;
+		std::uint64_t next_rotation = 0;
+	};
+
+	std::unordered_map<std::string, std::shared_ptr<log_file>> m_files;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::thread m_thread;
+	bool m_running = false;
+
+	std::atomic<std::size_t> m_number_of_open_files{ 0 };
+
+	std::size_t m_flush_size = 1024 * 1024;
+	std::chrono::milliseconds m_flush_interval{ 100 };
+	std::size_t m_rotation_size = 0;
+	std::size_t m_max_open_files = 64;
+	ft_group_commit* m_group_commit = nullptr;
+
+public:
+
+	ft_log_ingest() = default;
+	ft_log_ingest(const ft_log_ingest&) = delete;
+	ft_log_ingest& operator=(const ft_log_ingest&) = delete;
+	ft_log_ingest(ft_log_ingest&&) = delete;
+	ft_log_ingest& operator=(ft_log_ingest&&) = delete;
+	~ft_log_ingest();
+
+	void start();
+
+	// flushes and closes every file
+	void stop();
+
+	bool append(const std::string& file_name, const char* ptr, std::size_t n);
+
+	void flush_all();
+
+	// a file is written once this many bytes are buffered for it
+	void set_flush_size(std::size_t flush_size) noexcept;
+
+	// buffered bytes never wait longer than this
+	void set_flush_interval(std::chrono::milliseconds flush_interval) noexcept;
+
+	// a file reaching this size is moved to <name>.<n>, n being the first unused number, and started over,
+	// 0 disables rotation
+	void set_rotation_size(std::size_t rotation_size) noexcept;
+
+	// least recently used handles beyond this count are closed
+	void set_max_open_files(std::size_t max_open_files) noexcept;
+
+	// flushed data is made durable through group_commit, nullptr disables syncing
+	void set_group_commit(ft_group_commit* group_commit) noexcept;
+
+private:
+
+	void run();
+
+	bool flush(const std::string& file_name, log_file& file);
+
+	void close_file(log_file& file);
+
+	void close_least_recently_used_files(const std::vector<std::pair<std::string, std::shared_ptr<log_file>>>& files);
+
+	bool rotate(const std::string& file_name, log_file& file);
+};
+
+#endif // FT_LOG_INGEST_HPP
@@ -0,0 +1,55 @@
+#ifndef FT_MAPPED_FILE_HPP
+#define FT_MAPPED_FILE_HPP
+
+#include "ft_includes.hpp"
+
+// read-only view of a whole file, backed by the page cache where mmap is available
+class ft_mapped_file
+{
+
+private:
+
+	const char* m_data = nullptr;
+	std::size_t m_size = 0;
+	bool m_open = false;
+
+#ifdef __linux__
+	int m_fd = -1;
+#else
+	std::vector<char> m_fallback_buffer;
+#endif // __linux__
+
+public:
+
+	ft_mapped_file() = default;
+	ft_mapped_file(const ft_mapped_file&) = delete;
+	ft_mapped_file& operator=(const ft_mapped_file&) = delete;
+	ft_mapped_file(ft_mapped_file&&) = delete;
+	ft_mapped_file& operator=(ft_mapped_file&&) = delete;
+	~ft_mapped_file();
+
+	// unmapped, only the descriptor is kept where mmap is available and data() is nullptr, the file is then read
+	// through read_at : another process truncating it fails a read instead of faulting on a mapped page
+	bool open(const std::string& file_name, bool map = true);
+
+	void close() noexcept;
+
+	inline bool is_open() const noexcept { return m_open; }
+	inline const char* data() const noexcept { return m_data; }
+	inline std::size_t size() const noexcept { return m_size; }
+
+#ifdef __linux__
+	inline int native_handle() const noexcept { return m_fd; }
+#endif // __linux__
+
+	// false if the file no longer holds n bytes at offset
+	bool read_at(std::uint64_t offset, char* ptr, std::size_t n) const noexcept;
+
+	// hint that [offset, offset + n) is about to be read
+	void will_need(std::size_t offset, std::size_t n) const noexcept;
+
+	// hint that [offset, offset + n) will not be read again so its pages can leave the resident set
+	void release(std::size_t offset, std::size_t n) const noexcept;
+};
+
+#endif // FT_MAPPED_FILE_HPP
@@ -0,0 +1,73 @@
+#ifndef FT_POSIX_IO_HPP
+#define FT_POSIX_IO_HPP
+
+#include "ft_includes.hpp"
+
+#ifdef __linux__
+
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// write(2) until everything is written or a real error occurs
+inline bool ft_write_all(int fd, const char* ptr, std::size_t n)
+{
+	while (n != 0)
+	{
+		ssize_t written = ::write(fd, ptr, n);
+		if (written < 0)
+		{
+			if (errno == EINTR) { continue; }
+			return false;
+		}
+		ptr += written;
+		n -= static_cast<std::size_t>(written);
+	}
+	return true;
+}
+
+// pwrite(2) until everything is written or a real error occurs
+inline bool ft_pwrite_all(int fd, const char* ptr, std::size_t n, std::uint64_t offset)
+{
+	while (n != 0)
+	{
+		ssize_t written = ::pwrite(fd, ptr, n, static_cast<off_t>(offset));
+		if (written < 0)
+		{
+			if (errno == EINTR) { continue; }
+			return false;
+		}
+		ptr += written;
+		offset += static_cast<std::uint64_t>(written);
+		n -= static_cast<std::size_t>(written);
+	}
+	return true;
+}
+
+// send(2) on a socket without blocking longer than timeout_ms for the peer to drain it
+inline bool ft_send_all(int fd, const char* ptr, std::size_t n, int timeout_ms)
+{
+	while (n != 0)
+	{
+		ssize_t sent = ::send(fd, ptr, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (sent < 0)
+		{
+			if (errno == EINTR) { continue; }
+			if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) { return false; }
+			pollfd item = { fd, POLLOUT, 0 };
+			if (::poll(&item, 1, timeout_ms) <= 0) { return false; }
+			continue;
+		}
+		ptr += sent;
+		n -= static_cast<std::size_t>(sent);
+	}
+	return true;
+}
+
+#endif // __linux__
+
+#endif // FT_POSIX_IO_HPP
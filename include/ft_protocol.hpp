@@ -0,0 +1,236 @@
+#ifndef FT_PROTOCOL_HPP
+#define FT_PROTOCOL_HPP
+
+#include "ft_includes.hpp"
+
+// the 4 chars of a command read as a little endian 32-bit integer
+constexpr std::uint32_t ft_opcode(const char(&name)[5]) noexcept
+{
+	return static_cast<std::uint32_t>(static_cast<std::uint8_t>(name[0]))
+		| (static_cast<std::uint32_t>(static_cast<std::uint8_t>(name[1])) << 8)
+		| (static_cast<std::uint32_t>(static_cast<std::uint8_t>(name[2])) << 16)
+		| (static_cast<std::uint32_t>(static_cast<std::uint8_t>(name[3])) << 24);
+}
+
+// wire format shared by ft_client and ft_server
+//
+// the server opens every connection, after the TLS handshake if any, with "ftpv" + u32 version, clients give up on
+// any other version, version 1 was the unframed format, which had no such greeting
+//
+// request : u32 opcode, u32 name size, u64 payload size, name, payload
+// variable length responses (get, list, lsfp) : u64 size, data, size is no_content when there is nothing to send
+// requests with an opcode the server does not know are answered with a no_content size
+//
+// handshake when validation is enabled : the server sends an i32 challenge, the client answers "vali" + i32 and
+// receives a u64 session token, or sends "resm" + token right away and receives 'r' (resumed) or 'n' (rejected)
+//
+// "watch" is answered with a 1-byte sized response 'y' or 'n', after a 'y' the server pushes sized responses made of
+// 'e' then watch event records : char kind ('c' created, 'm' modified, 'r' removed), u64 size, i64 mtime in ns since
+// the epoch, u32 path size, path ; the leading byte tells a push from the answer to a later "watch" on the connection
+//
+// swarm : "sjoi" (payload u16 serving port) answers u64 file size, u32 piece size, u32 piece count, 32-byte sha256
+// per piece ; "spln" (payload u16 serving port, one byte per piece, 1 when held) answers records of u32 piece,
+// u16 address size, "ip:port" of the peer to fetch it from, empty for the server ; "spce" (server) and "ppce"
+// (peers) take a u32 piece index and answer the piece as a sized response
+//
+// "gdir" (payload u8 flags, bit 0 asks for gzip) answers no_content for a missing directory, otherwise a 1-byte
+// sized response 't' (tar) or 'g' (tar.gz) then the archive as sized responses ended by a 0 size one
+//
+// resumable uploads are bound to an upload id, u64 file size then the sha256 of the whole file : "offs" (payload id)
+// answers the u64 offset to resume at, 0 for a new upload ; "part" (payload id, u64 offset, data) writes at the
+// offset ; "fin" (payload id) answers 'y' once the received content is complete and matches the hash
+//
+// chunk store : "have" (payload 32-byte sha256 per chunk) answers a sized response of one char per chunk, 'y' stored,
+// 'n' missing, 'u' no chunk store on the server ; "cput" (payload the chunk) is not answered ; "mani" (payload a
+// manifest) answers a single unsized byte, 'y' when the manifest is accepted, 'n' when it is malformed or lists a
+// missing chunk, the file is in place only once "sync" says so
+//
+// "stat" answers no_content for a missing file, otherwise a sized file status : char state ('y' the hash is current,
+// 'p' the server is still hashing this content, 's' the server keeps no hash index), u64 size, i64 mtime in ns, sha256
+//
+// uploads (send, app, fin, mani) are not acknowledged once their data is in place, "sync" is : 'y' once every upload read
+// before it on the connection is renamed into place and, with durable writes, synced, 'n' if one of them failed since
+// the previous "sync", appends buffered by the log-ingest mode are not covered
+class ft_protocol
+{
+
+public:
+
+	static constexpr std::uint32_t ping = ft_opcode("ping");
+	static constexpr std::uint32_t send = ft_opcode("send");
+	static constexpr std::uint32_t app = ft_opcode("app ");
+	static constexpr std::uint32_t get = ft_opcode("get ");
+	static constexpr std::uint32_t list = ft_opcode("list");
+	static constexpr std::uint32_t lsfp = ft_opcode("lsfp");
+	static constexpr std::uint32_t rem = ft_opcode("rem ");
+	static constexpr std::uint32_t chck = ft_opcode("chck");
+	static constexpr std::uint32_t have = ft_opcode("have");
+	static constexpr std::uint32_t cput = ft_opcode("cput");
+	static constexpr std::uint32_t mani = ft_opcode("mani");
+	static constexpr std::uint32_t part = ft_opcode("part");
+	static constexpr std::uint32_t offs = ft_opcode("offs");
+	static constexpr std::uint32_t fin = ft_opcode("fin ");
+	static constexpr std::uint32_t watch = ft_opcode("wtch");
+	static constexpr std::uint32_t swarm_join = ft_opcode("sjoi");
+	static constexpr std::uint32_t swarm_plan = ft_opcode("spln");
+	static constexpr std::uint32_t swarm_piece = ft_opcode("spce");
+	static constexpr std::uint32_t peer_piece = ft_opcode("ppce");
+	static constexpr std::uint32_t gdir = ft_opcode("gdir");
+	static constexpr std::uint32_t stat = ft_opcode("stat");
+	static constexpr std::uint32_t sync = ft_opcode("sync");
+
+	// greeting of the server, followed by the u32 version
+	static constexpr std::uint32_t hello = ft_opcode("ftpv");
+	static constexpr std::uint32_t version = 2;
+	static constexpr std::size_t hello_size = 2 * sizeof(std::uint32_t);
+
+	// first 4 bytes a client sends after the challenge : "vali" then the i32 answer, or "resm" then its u64 session token
+	static constexpr std::uint32_t vali = ft_opcode("vali");
+	static constexpr std::uint32_t resm = ft_opcode("resm");
+
+	static constexpr std::size_t request_header_size = 2 * sizeof(std::uint32_t) + sizeof(std::uint64_t);
+	static constexpr std::size_t response_header_size = sizeof(std::uint64_t);
+	static constexpr std::uint64_t no_content = ~std::uint64_t(0);
+	static constexpr std::size_t swarm_table_header_size = sizeof(std::uint64_t) + 2 * sizeof(std::uint32_t);
+	static constexpr std::size_t watch_event_header_size = sizeof(char) + 2 * sizeof(std::uint64_t) + sizeof(std::uint32_t);
+	static constexpr char watch_push = 'e';
+	static constexpr std::uint8_t archive_gzip = 1;
+	static constexpr std::size_t upload_id_size = sizeof(std::uint64_t) + 32;
+	static constexpr std::size_t file_status_size = sizeof(char) + 2 * sizeof(std::uint64_t) + 32;
+
+	struct request_header
+	{
+		std::uint32_t opcode;
+		std::uint32_t name_size;
+		std::uint64_t payload_size;
+	};
+
+	static inline void encode_request_header(char* dst, std::uint32_t opcode, std::uint32_t name_size, std::uint64_t payload_size) noexcept
+	{
+		char opcode_chars[4] = {
+			static_cast<char>(opcode & 255), static_cast<char>((opcode >> 8) & 255),
+			static_cast<char>((opcode >> 16) & 255), static_cast<char>((opcode >> 24) & 255)
+		};
+		std::memcpy(dst, opcode_chars, 4 * sizeof(char));
+		std::memcpy(dst + 4 * sizeof(char), &name_size, sizeof(std::uint32_t));
+		std::memcpy(dst + 4 * sizeof(char) + sizeof(std::uint32_t), &payload_size, sizeof(std::uint64_t));
+	}
+
+	static inline void encode_hello(char* dst) noexcept
+	{
+		std::memcpy(dst, "ftpv", 4 * sizeof(char));
+		std::memcpy(dst + 4 * sizeof(char), &version, sizeof(std::uint32_t));
+	}
+
+	static inline bool check_hello(const char* src) noexcept
+	{
+		std::uint32_t peer_version;
+		std::memcpy(&peer_version, src + 4 * sizeof(char), sizeof(std::uint32_t));
+		return (std::memcmp(src, "ftpv", 4 * sizeof(char)) == 0) && (peer_version == version);
+	}
+
+	static inline request_header decode_request_header(const char* src) noexcept
+	{
+		request_header header;
+		header.opcode = static_cast<std::uint32_t>(static_cast<std::uint8_t>(src[0]))
+			| (static_cast<std::uint32_t>(static_cast<std::uint8_t>(src[1])) << 8)
+			| (static_cast<std::uint32_t>(static_cast<std::uint8_t>(src[2])) << 16)
+			| (static_cast<std::uint32_t>(static_cast<std::uint8_t>(src[3])) << 24);
+		std::memcpy(&header.name_size, src + 4 * sizeof(char), sizeof(std::uint32_t));
+		std::memcpy(&header.payload_size, src + 4 * sizeof(char) + sizeof(std::uint32_t), sizeof(std::uint64_t));
+		return header;
+	}
+};
+
+// a decoded request, name and payload point into the connection buffer and are only valid inside the handler
+struct ft_request
+{
+	std::uint32_t opcode;
+	std::string_view name;
+	std::string_view payload;
+
+	inline std::string name_string() const { return std::string(name); }
+};
+
+// a change pushed to a watching client, size and mtime are 0 for a removed file
+struct ft_watch_event
+{
+	char kind;
+	std::uint64_t size;
+	std::int64_t mtime;
+	std::string path;
+};
+
+inline void ft_append_watch_event(std::string& dst, char kind, std::uint64_t size, std::int64_t mtime, std::string_view path)
+{
+	char header[ft_protocol::watch_event_header_size];
+	std::uint32_t path_size = static_cast<std::uint32_t>(path.size());
+	header[0] = kind;
+	std::memcpy(header + 1, &size, sizeof(std::uint64_t));
+	std::memcpy(header + 1 + sizeof(std::uint64_t), &mtime, sizeof(std::int64_t));
+	std::memcpy(header + 1 + 2 * sizeof(std::uint64_t), &path_size, sizeof(std::uint32_t));
+	dst.append(header, sizeof(header));
+	dst.append(path.data(), path.size());
+}
+
+inline bool ft_decode_watch_events(const char* ptr, std::size_t n, std::vector<ft_watch_event>& events)
+{
+	while (n != 0)
+	{
+		if (n < ft_protocol::watch_event_header_size)
+		{
+			return false;
+		}
+		ft_watch_event event;
+		std::uint32_t path_size;
+		event.kind = ptr[0];
+		std::memcpy(&event.size, ptr + 1, sizeof(std::uint64_t));
+		std::memcpy(&event.mtime, ptr + 1 + sizeof(std::uint64_t), sizeof(std::int64_t));
+		std::memcpy(&path_size, ptr + 1 + 2 * sizeof(std::uint64_t), sizeof(std::uint32_t));
+		ptr += ft_protocol::watch_event_header_size;
+		n -= ft_protocol::watch_event_header_size;
+		if (n < path_size)
+		{
+			return false;
+		}
+		event.path.assign(ptr, path_size);
+		ptr += path_size;
+		n -= path_size;
+		events.push_back(std::move(event));
+	}
+	return true;
+}
+
+// what "stat" tells about a server file, state is 'n' when there is no such file and 'u' when the request failed
+struct ft_file_status
+{
+	char state = 'u';
+	std::uint64_t size = 0;
+	std::int64_t mtime = 0;
+	std::array<std::uint8_t, 32> hash{};
+
+	inline bool hashed() const noexcept { return state == 'y'; }
+};
+
+inline void ft_encode_file_status(char* dst, const ft_file_status& status)
+{
+	dst[0] = status.state;
+	std::memcpy(dst + 1, &status.size, sizeof(std::uint64_t));
+	std::memcpy(dst + 1 + sizeof(std::uint64_t), &status.mtime, sizeof(std::int64_t));
+	std::memcpy(dst + 1 + 2 * sizeof(std::uint64_t), status.hash.data(), status.hash.size());
+}
+
+inline bool ft_decode_file_status(const char* ptr, std::size_t n, ft_file_status& status)
+{
+	if (n != ft_protocol::file_status_size)
+	{
+		return false;
+	}
+	status.state = ptr[0];
+	std::memcpy(&status.size, ptr + 1, sizeof(std::uint64_t));
+	std::memcpy(&status.mtime, ptr + 1 + sizeof(std::uint64_t), sizeof(std::int64_t));
+	std::memcpy(status.hash.data(), ptr + 1 + 2 * sizeof(std::uint64_t), status.hash.size());
+	return true;
+}
+
+#endif // FT_PROTOCOL_HPP
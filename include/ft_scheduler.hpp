@@ -0,0 +1,80 @@
+#ifndef FT_SCHEDULER_HPP
+#define FT_SCHEDULER_HPP
+
+#include "ft_includes.hpp"
+
+// runs jobs in steps on a pool of threads, sharing them between flows (one per client) by weighted deficit round-robin :
+// each turn a flow is credited quantum * weight bytes and runs steps until the bytes they moved use the credit up
+class ft_scheduler
+{
+
+public:
+
+	enum class step_result { more, wait, done };
+
+	// one piece of work, bytes moved are added to cost, wait parks the flow until resume is called
+	using step_function = std::function<step_result(std::size_t& cost)>;
+
+	using flow_id = const void*;
+
+private:
+
+	struct job
+	{
+		step_function step;
+		std::function<void()> on_done;
+	};
+
+	enum class flow_state { queued, running, parked };
+
+	struct flow
+	{
+		std::list<job> jobs;
+		std::uint32_t weight = 1;
+		std::int64_t deficit = 0;
+		flow_state state = flow_state::queued;
+		bool woken = false; // resumed while its step was still running
+	};
+
+	std::unordered_map<flow_id, flow> m_flows;
+	std::list<flow_id> m_ready;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	std::vector<std::thread> m_threads;
+	std::size_t m_quantum = 256 * 1024;
+	bool m_running = false;
+
+	std::atomic<std::uint64_t> m_steps{ 0 };
+
+public:
+
+	ft_scheduler() = default;
+	ft_scheduler(const ft_scheduler&) = delete;
+	ft_scheduler& operator=(const ft_scheduler&) = delete;
+	ft_scheduler(ft_scheduler&&) = delete;
+	ft_scheduler& operator=(ft_scheduler&&) = delete;
+	~ft_scheduler();
+
+	void start(std::size_t number_of_threads);
+
+	// running steps finish, jobs still queued are dropped without on_done
+	void stop();
+
+	void set_quantum(std::size_t bytes) noexcept;
+
+	std::size_t quantum() const noexcept;
+
+	// jobs of a flow run one after the other, on_done is called from a scheduler thread once the job is over
+	void submit(flow_id id, std::uint32_t weight, step_function step, std::function<void()> on_done);
+
+	// a flow parked by a step that returned wait is queued again
+	void resume(flow_id id);
+
+	std::uint64_t number_of_steps() const noexcept;
+
+private:
+
+	void run();
+};
+
+#endif // FT_SCHEDULER_HPP
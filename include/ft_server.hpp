@@ -2,20 +2,104 @@
 #define FT_SERVER_HPP
 
 #include "ft_includes.hpp"
+#include "ft_protocol.hpp"
+#include "ft_group_commit.hpp"
+#include "ft_log_ingest.hpp"
+#include "ft_chunk_store.hpp"
+#include "ft_watcher.hpp"
+#include "ft_mapped_file.hpp"
+#include "ft_sha256.hpp"
+#include "ft_tls.hpp"
+#include "ft_archive.hpp"
+#include "ft_scheduler.hpp"
+#include "ft_hash_index.hpp"
 
 class ft_server
 {
 
 public:
 
+	// metadata requests are answered on the io threads as they arrive, bulk ones are handed to the scheduler
+	enum class request_class { metadata, bulk };
+
+	// sized chunks made by another thread, which resumes the flow after each one
+	struct chunk_queue
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::list<std::vector<char>> chunks;
+		bool produced = false; // true once no more chunks are to come
+		bool failed = false;
+		bool cancelled = false; // the transfer is gone, the producer stops at its next chunk
+	};
+
+	// the answer to a bulk request, written by scheduler steps of at most one quantum each
+	struct transfer
+	{
+		std::vector<char> head; // held back answers and the response size, or the chunk being sent
+		std::size_t head_offset = 0;
+
+		std::shared_ptr<ft_mapped_file> file; // sent with sendfile where possible, read through the head otherwise
+		std::uint64_t start = 0; // of the range in the file
+		std::uint64_t size = 0;
+		std::uint64_t offset = 0;
+
+		// pulled for the next chunk once everything before is sent, an empty chunk ends it, false on failure
+		std::function<bool(std::vector<char>&)> source;
+		bool failed = false;
+
+		// shared with the thread making the chunks, which may outlive the transfer
+		std::shared_ptr<chunk_queue> queue;
+
+		transfer() = default;
+		transfer(const transfer&) = delete;
+		transfer& operator=(const transfer&) = delete;
+		transfer(transfer&&) = delete;
+		transfer& operator=(transfer&&) = delete;
+		~transfer();
+	};
+
+	// uploads of a connection still on their way through the group commit, "sync" is answered once there are none
+	struct commit_tracker
+	{
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::size_t pending = 0;
+		bool failed = false; // since the last "sync"
+		std::vector<std::function<void(bool)>> waiters;
+	};
+
+	// watch pushes of a connection waiting for the socket, shared with the handlers writing them, under the write mutex
+	struct watch_queue
+	{
+		std::vector<char> frames;
+		bool draining = false; // a drain is posted or waits for the socket
+		bool closed = false; // the connection is gone, handlers must not touch it
+		std::chrono::steady_clock::time_point stalled_since{};
+	};
+
 	class client_connection
 	{
 
 	public:
 
 		asio::ip::tcp::socket socket;
+		char header[ft_protocol::request_header_size];
+		std::int32_t challenge = 0;
 		std::vector<char> buffer;
 		std::list<client_connection>::iterator iterator;
+		std::shared_ptr<std::mutex> write_mutex = std::make_shared<std::mutex>();
+		std::vector<char> output;
+		bool coalesce = false;
+		std::shared_ptr<ft_tls_session> tls;
+		std::uint32_t weight = 1;
+		bool scheduled = false; // the request being handled runs on the scheduler
+		std::shared_ptr<transfer> pending_transfer;
+		std::shared_ptr<commit_tracker> commits = std::make_shared<commit_tracker>();
+		std::shared_ptr<watch_queue> watch_events = std::make_shared<watch_queue>();
+		bool transferring = false; // a scheduler transfer owns the socket between its steps, under the write mutex
+		std::shared_ptr<ft_mapped_file> spool; // the payload of a large upload, viewed by the request being handled
+		std::string spool_file_name;
 
 		client_connection() = default;
 		client_connection(const client_connection&) = default;
@@ -32,6 +116,9 @@ public:
 	asio::ip::tcp::acceptor* m_asio_acceptor = nullptr;
 	std::list<client_connection> m_clients;
 	std::size_t m_buffer_size = 1024;
+	std::uint64_t m_max_request_size = 64 * 1024 * 1024;
+	std::size_t m_upload_piece_size = 1024 * 1024;
+	std::atomic<std::uint64_t> m_spool_counter{ 0 };
 
 	std::function<std::int32_t(std::int32_t)> m_validation_function = [](std::int32_t x) { return x; };
 	std::random_device rd;
@@ -39,6 +126,11 @@ public:
 	std::uniform_int_distribution<> rng{ -(1 << 30), (1 << 30) };
 	bool m_client_validation_enabled = true;
 
+	std::unordered_map<std::uint64_t, std::chrono::steady_clock::time_point> m_sessions;
+	std::mt19937_64 m_session_rng{ (static_cast<std::uint64_t>(rd()) << 32) | static_cast<std::uint64_t>(rd()) };
+	std::chrono::seconds m_session_lifetime{ 600 };
+	std::mutex m_session_mutex;
+
 	std::mutex m_mutex;
 	std::mutex m_write_mutex;
 	asio::error_code m_error_code;
@@ -46,6 +138,103 @@ public:
 	std::mutex m_connect_disconnect_mutex;
 	bool m_running = false;
 
+	bool m_low_latency = false;
+	int m_busy_poll_us = 0;
+	std::size_t m_coalesce_limit = 64 * 1024;
+
+#ifdef FT_ENABLE_TLS
+	ft_tls_context m_tls_context;
+	bool m_tls_enabled = false;
+#endif // FT_ENABLE_TLS
+
+	ft_group_commit m_group_commit;
+	bool m_durable_writes = true;
+
+	ft_log_ingest m_log_ingest;
+	bool m_log_ingest_enabled = false;
+
+	ft_chunk_store m_chunk_store;
+	std::string m_chunk_store_path;
+	bool m_chunk_store_enabled = false;
+
+	ft_hash_index m_hash_index;
+	std::string m_hash_index_path;
+	std::string m_hash_index_root;
+	bool m_hash_index_enabled = false;
+
+	struct watch_subscription
+	{
+		client_connection* client;
+		std::string directory;
+		std::string base; // prepended to the file name in pushed events
+		std::string prefix; // only files starting with it are reported
+	};
+
+	ft_watcher m_watcher;
+	std::list<watch_subscription> m_watch_subscriptions;
+	std::mutex m_watch_mutex;
+	std::chrono::milliseconds m_watch_send_timeout{ 1000 };
+
+	struct swarm_peer
+	{
+		client_connection* client;
+		std::string address; // "ip:port" the peer serves pieces on
+		std::vector<char> have;
+		std::size_t uploads = 0;
+	};
+
+	// one per file being distributed, the server seeds pieces nobody holds yet and tells peers where to find the others
+	struct swarm
+	{
+		std::shared_ptr<ft_mapped_file> file;
+		std::filesystem::file_time_type write_time;
+		std::uint32_t piece_size = 0;
+		std::vector<ft_sha256::digest> hashes;
+		std::vector<std::uint32_t> availability;
+		std::vector<std::chrono::steady_clock::time_point> seeded; // last time the server handed out a piece no peer has
+		std::list<swarm_peer> peers;
+	};
+
+	std::unordered_map<std::string, swarm> m_swarms;
+	std::mutex m_swarm_mutex;
+	std::mt19937 m_swarm_rng{ rd() };
+	std::uint32_t m_swarm_piece_size = 1024 * 1024;
+	std::size_t m_swarm_plan_size = 8;
+	std::chrono::milliseconds m_swarm_seed_timeout{ 2000 };
+	std::atomic<std::uint64_t> m_swarm_bytes_sent{ 0 };
+
+	std::size_t m_archive_readahead_files = 64;
+	std::size_t m_archive_readahead_bytes = 64 * 1024 * 1024;
+	std::size_t m_archive_threads = 4;
+	int m_archive_compression_level = 6;
+
+	// archives for scheduled "gdir" are made by a fixed set of producers, later requests wait for a free one
+	struct archive_job
+	{
+		std::shared_ptr<chunk_queue> queue;
+		std::string path;
+		bool gzip = false;
+		ft_scheduler::flow_id id = nullptr;
+	};
+
+	std::size_t m_archive_producers = 2;
+	std::vector<std::thread> m_archive_producer_threads;
+	std::list<archive_job> m_archive_jobs;
+	std::mutex m_archive_jobs_mutex;
+	std::condition_variable m_archive_jobs_condition;
+	bool m_archive_producers_running = false;
+
+	ft_scheduler m_scheduler;
+	std::size_t m_scheduler_threads = 2;
+	std::size_t m_max_pending_chunks = 2;
+	std::unordered_set<std::uint32_t> m_bulk_opcodes{ ft_protocol::send, ft_protocol::app, ft_protocol::rem, ft_protocol::get, ft_protocol::cput,
+		ft_protocol::part, ft_protocol::fin, ft_protocol::mani, ft_protocol::swarm_join, ft_protocol::swarm_piece, ft_protocol::gdir,
+		ft_protocol::sync };
+	std::function<std::uint32_t(const asio::ip::tcp::endpoint&)> m_weight_function = [](const asio::ip::tcp::endpoint&) { return 1u; };
+
+	using command_handler = std::function<void(client_connection&, const ft_request&)>;
+	std::unordered_map<std::uint32_t, command_handler> m_custom_commands;
+
 	ft_server() = default;
 	ft_server(const ft_server&) = delete;
 	ft_server& operator=(const ft_server&) = delete;
@@ -71,30 +260,221 @@ public:
 
 	void set_buffer_size(std::size_t new_size) noexcept;
 
+	// how long a session token lets a client reconnect without the challenge
+	void set_session_lifetime(std::chrono::seconds lifetime) noexcept;
+
+	// connections sending a larger name + payload are dropped, send and part payloads excepted, 64 MiB by default
+	void set_max_request_size(std::uint64_t new_size) noexcept;
+
+	// send and part payloads larger than this are received piece by piece into a spool file next to the destination
+	// instead of memory, 1 MiB by default
+	void set_upload_piece_size(std::size_t piece_size) noexcept;
+
+	void enable_durable_writes(bool enable) noexcept;
+
+	void set_sync_latency(std::chrono::microseconds latency);
+
+	void enable_log_ingest(bool enable) noexcept;
+
+	// uploads are deduplicated into a chunk store at store_path, an empty path disables it
+	void enable_chunk_store(const std::string& store_path);
+
+	// "stat" answers with the sha256 of files under root, kept in index_path across restarts, an empty path disables it
+	void enable_hash_index(const std::string& index_path, const std::string& root = ".");
+
+	// TCP_NODELAY on accepted connections, SO_BUSY_POLL for busy_poll_us when it is not 0 (Linux only),
+	// and answers to pipelined requests are gathered into one write, call before start
+	void enable_low_latency(bool enable, int busy_poll_us = 0) noexcept;
+
+#ifdef FT_ENABLE_TLS
+	// every connection starts with a TLS handshake, the integer challenge still follows when validation is on
+	bool enable_tls(const std::string& certificate_file, const std::string& private_key_file);
+#endif // FT_ENABLE_TLS
+
+	// watch events are pushed at most once per interval to each subscriber
+	void set_watch_interval(std::chrono::milliseconds interval) noexcept;
+
+	// a subscriber whose socket takes none of its queued pushes for this long is disconnected
+	void set_watch_send_timeout(std::chrono::milliseconds timeout) noexcept;
+
+	// takes effect for swarms started afterwards
+	void set_swarm_piece_size(std::uint32_t piece_size) noexcept;
+
+	// directory archives : files opened ahead of the one being sent, bounded by count and bytes held in memory
+	void set_archive_readahead(std::size_t files, std::size_t bytes, std::size_t number_of_threads) noexcept;
+
+	// gzip level used when a client asks for a compressed archive, 0 always sends plain tar
+	void set_archive_compression_level(int level) noexcept;
+
+	// directory archives made at once, each with its own readahead threads, call before start
+	void set_archive_producers(std::size_t number_of_producers) noexcept;
+
+	// threads running bulk requests, call before start
+	void set_scheduler_threads(std::size_t number_of_threads) noexcept;
+
+	// bytes a client of weight 1 may send per round, also the most a single step writes
+	void set_scheduler_quantum(std::size_t bytes) noexcept;
+
+	// weight of a new connection from its remote endpoint, a client of weight 2 gets twice the bulk bandwidth of one of weight 1
+	void set_weight_function(std::function<std::uint32_t(const asio::ip::tcp::endpoint&)> fn);
+
+	// send, app, rem, get, cput, part, fin, mani, sjoi, spce, gdir and sync are bulk, everything else metadata, call before start
+	// app and rem wait for a pending upload of their name to be published, only bulk threads should block on that
+	void set_request_class(std::uint32_t opcode, request_class new_class);
+
+	// handles opcodes that have no built-in subroutine, call before start
+	void register_command(std::uint32_t opcode, command_handler handler);
+
+	void write_response(client_connection& client_socket, const void* const ptr, std::size_t n);
+
+	// u64 size then the data, n == ft_protocol::no_content sends the size alone
+	void write_sized_response(client_connection& client_socket, const void* const ptr, std::uint64_t n);
+
 private:
 
+	using subroutine = void (ft_server::*)(client_connection&, const ft_request&);
+
+	struct dispatch_entry
+	{
+		std::uint32_t opcode = 0;
+		subroutine function = nullptr;
+	};
+
+	static constexpr std::size_t dispatch_table_size = 64;
+	using dispatch_table = std::array<dispatch_entry, dispatch_table_size>;
+
+	static constexpr std::size_t dispatch_slot(std::uint32_t opcode) noexcept
+	{
+		return static_cast<std::size_t>(static_cast<std::uint32_t>(opcode * 2654435761u) >> 26);
+	}
+
+	static constexpr dispatch_table make_dispatch_table() noexcept;
+
 	void listen();
 
+	void accept_client(client_connection& client_socket);
+
+#ifdef FT_ENABLE_TLS
+	void handle_tls_handshake(client_connection& client_socket);
+#endif // FT_ENABLE_TLS
+
 	void handle_client_validation(client_connection& client_socket);
 
 	void handle_client_request(client_connection& client_socket);
 
+	// runs or schedules a request whose body is received
+	void process_request(client_connection& client_socket, const ft_request& request);
+
+	// the name is in the connection buffer, the payload follows in pieces
+	void receive_upload(client_connection& client_socket, const ft_protocol::request_header& header);
+
+	void receive_upload_piece(client_connection& client_socket, const ft_protocol::request_header& header,
+		std::shared_ptr<std::ofstream> spool, std::uint64_t remaining);
+
+	// reads the next request once the current one is answered
+	void finish_request(client_connection& client_socket);
+
+	void schedule_request(client_connection& client_socket, const ft_request& request);
+
+	// takes the held back answers, the transfer is written by the scheduler once the subroutine returns
+	void start_transfer(client_connection& client_socket, std::shared_ptr<transfer> new_transfer);
+
+	ft_scheduler::step_result transfer_step(client_connection& client_socket, transfer& current, std::size_t& cost);
+
+	void dispatch(client_connection& client_socket, const ft_request& request);
+
+	void remove_client(client_connection& client_socket);
+
+	void flush_output(client_connection& client_socket);
+
+	// the write mutex is held by the caller
+	template <std::size_t N>
+	void write_buffers(client_connection& client_socket, const std::array<asio::const_buffer, N>& buffers);
+
+	bool request_pending(client_connection& client_socket);
+
+	// sized response of n bytes of a file from offset, through sendfile where possible
+	void write_file_response(client_connection& client_socket, const std::shared_ptr<ft_mapped_file>& file, std::uint64_t offset, std::uint64_t n);
+
+	// a sized answer of n bytes pulled from source, as for transfer::source
+	void write_stream_response(client_connection& client_socket, std::uint64_t n, std::function<bool(std::vector<char>&)> source);
+
+	// counts an upload of the connection as pending until the returned callback is called with its outcome,
+	// on_committed runs first when it made it into place
+	std::function<void(bool)> track_commit(client_connection& client_socket, std::function<void()> on_committed = nullptr);
+
+	// the archive of a directory as sized responses through output, false if the stream broke off
+	bool write_archive(const std::string& path, bool gzip, const std::function<bool(const void*, std::uint64_t)>& output);
+
+	// body of the archive producers, each takes the next queued job once done with the previous one
+	void run_archive_producer();
+
+	// the swarm for file_name if it was built from the content at write_time, m_swarm_mutex is held by the caller
+	swarm* find_swarm(const std::string& file_name, std::filesystem::file_time_type write_time);
+
+	// maps and hashes the file into a fresh swarm, without m_swarm_mutex
+	bool build_swarm(const std::string& file_name, std::filesystem::file_time_type write_time, swarm& target);
+
+	// false unless the chunk store is enabled and the file is one of its manifests, read without mapping it
+	bool open_stored_content(const ft_mapped_file& file, ft_chunk_store::content_reader& reader) const;
+
+	// called by the watcher thread with the coalesced changes of a directory
+	void push_watch_events(const std::string& directory, const std::vector<ft_watcher::event>& events);
+
+	// posts a drain of the queued pushes unless one is on its way, the write mutex is held by the caller
+	void post_watch_drain(client_connection& client_socket);
+
+	// writes queued pushes as far as the socket takes them without blocking, then waits for it on the io context
+	void drain_watch_events(client_connection& client_socket);
+
+	std::uint64_t open_session();
+
+	bool resume_session(std::uint64_t token);
+
+	void ping_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void send_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void app_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void get_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void list_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void lsfp_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void rem_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void chck_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void have_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void cput_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void mani_subroutine(client_connection& client_socket, const ft_request& request);
+
+	// <name>.ft_part.<hex of the first 16 bytes of the hash>, a different upload never resumes another one's part
+	static std::string part_file_name(const std::string& file_name, const char* upload_id);
+
+	void part_subroutine(client_connection& client_socket, const ft_request& request);
+
+	void offs_subroutine(client_connection& client_socket, const ft_request& request);
 
-	void ping_subroutine(client_connection& client_socket);
+	void fin_subroutine(client_connection& client_socket, const ft_request& request);
 
-	void send_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length);
+	void watch_subroutine(client_connection& client_socket, const ft_request& request);
 
-	void app_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length);
+	void swarm_join_subroutine(client_connection& client_socket, const ft_request& request);
 
-	void get_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length);
+	void swarm_plan_subroutine(client_connection& client_socket, const ft_request& request);
 
-	void list_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length);
+	void swarm_piece_subroutine(client_connection& client_socket, const ft_request& request);
 
-	void lsfp_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length);
+	void gdir_subroutine(client_connection& client_socket, const ft_request& request);
 
-	void rem_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length);
+	void stat_subroutine(client_connection& client_socket, const ft_request& request);
 
-	void chck_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length);
+	void sync_subroutine(client_connection& client_socket, const ft_request& request);
 };
 
 #endif // FT_SERVER_HPP
@@ -0,0 +1,39 @@
+#ifndef FT_SHA256_HPP
+#define FT_SHA256_HPP
+
+#include "ft_includes.hpp"
+
+class ft_sha256
+{
+
+public:
+
+	using digest = std::array<std::uint8_t, 32>;
+
+private:
+
+	std::uint32_t m_state[8];
+	std::uint8_t m_block[64];
+	std::size_t m_block_size = 0;
+	std::uint64_t m_total_size = 0;
+
+public:
+
+	ft_sha256() noexcept { reset(); }
+
+	void reset() noexcept;
+
+	void update(const void* const ptr, std::size_t n) noexcept;
+
+	digest finish() noexcept;
+
+	static digest hash(const void* const ptr, std::size_t n) noexcept;
+
+	static std::string to_hex(const digest& value);
+
+private:
+
+	void compress(const std::uint8_t* block) noexcept;
+};
+
+#endif // FT_SHA256_HPP
@@ -0,0 +1,91 @@
+#ifndef FT_SHARDED_CLIENT_HPP
+#define FT_SHARDED_CLIENT_HPP
+
+#include "ft_includes.hpp"
+#include "ft_client.hpp"
+
+// spreads files over several servers with rendezvous hashing, each file lives on the replication factor
+// servers that score highest for its name, so adding or removing a server only moves the files it owns
+class ft_sharded_client
+{
+
+private:
+
+	struct server
+	{
+		std::string ip;
+		std::uint16_t port = 0;
+		std::uint64_t key = 0;
+		float latency = 1.0f / 0.0f;
+		std::unique_ptr<ft_client> client;
+	};
+
+	std::vector<server> m_servers;
+	std::size_t m_replication_factor = 1;
+	std::size_t m_ping_samples = 8;
+	bool m_client_validation_enabled = true;
+	std::function<std::int32_t(std::int32_t)> m_validation_function = [](std::int32_t x) { return x; };
+
+public:
+
+	ft_sharded_client() = default;
+	ft_sharded_client(const ft_sharded_client&) = delete;
+	ft_sharded_client& operator=(const ft_sharded_client&) = delete;
+	ft_sharded_client(ft_sharded_client&&) = delete;
+	ft_sharded_client& operator=(ft_sharded_client&&) = delete;
+	~ft_sharded_client();
+
+	// call before connect
+	void add_server(const std::string& ip, std::uint16_t port);
+
+	void set_replication_factor(std::size_t replication_factor) noexcept;
+
+	void set_validation_function(std::function<std::int32_t(std::int32_t)> fn);
+
+	void enable_client_validation(bool enable) noexcept;
+
+	// returns the number of servers reached
+	std::size_t connect();
+
+	void disconnect();
+
+	// pings every server again, reads go to the replica with the lowest average
+	void refresh_latencies();
+
+	std::size_t number_of_servers() const noexcept;
+
+	// indices of the servers holding file_name, highest score first
+	std::vector<std::size_t> replicas(const std::string& file_name) const;
+
+	ft_client& client(std::size_t index);
+
+	// true when every replica acknowledged the file in place, through ft_client::sync
+	bool send_file(const std::string& file_name, const std::string& destination_file_name);
+
+	// the fastest replica first, the others if it fails
+	bool get_file(const std::string& file_name, const std::string& destination_file_name);
+
+	// 'y' if any replica has the file, 'n' if none has it and at least one answered
+	char check_file(const std::string& file_name);
+
+	void remove_file(const std::string& file_name);
+
+	// merged from every server, duplicates removed, ';' separated like ft_client::get_list
+	std::string get_list();
+
+	std::string get_list_from_path(const std::string& path);
+
+private:
+
+	static std::uint64_t hash(const char* ptr, std::size_t n, std::uint64_t seed) noexcept;
+
+	// replicas sorted by measured latency
+	std::vector<std::size_t> read_order(const std::string& file_name) const;
+
+	template <class F>
+	void for_each_parallel(const std::vector<std::size_t>& indices, F&& function);
+
+	static std::string merge_lists(const std::vector<std::string>& lists);
+};
+
+#endif // FT_SHARDED_CLIENT_HPP
@@ -0,0 +1,31 @@
+#ifndef FT_SOCKET_OPTIONS_HPP
+#define FT_SOCKET_OPTIONS_HPP
+
+#include "ft_includes.hpp"
+
+#ifdef __linux__
+#include <sys/socket.h>
+#endif // __linux__
+
+// options shared by ft_client and ft_server sockets
+//
+// low latency : Nagle off so small requests and answers leave at once, and optionally SO_BUSY_POLL so a blocking
+// read spins on the device queue for busy_poll_us instead of sleeping until the interrupt (Linux only, may need
+// CAP_NET_ADMIN to go above net.core.busy_read)
+inline void ft_set_socket_options(asio::ip::tcp::socket& socket, bool low_latency, int busy_poll_us)
+{
+	asio::error_code ec;
+	socket.set_option(asio::socket_base::keep_alive(true), ec);
+	socket.set_option(asio::ip::tcp::no_delay(low_latency), ec);
+
+#ifdef __linux__
+#ifdef SO_BUSY_POLL
+	if (low_latency && (busy_poll_us > 0))
+	{
+		::setsockopt(socket.native_handle(), SOL_SOCKET, SO_BUSY_POLL, &busy_poll_us, sizeof(int));
+	}
+#endif // SO_BUSY_POLL
+#endif // __linux__
+}
+
+#endif // FT_SOCKET_OPTIONS_HPP
@@ -0,0 +1,107 @@
+#ifndef FT_SWARM_PEER_HPP
+#define FT_SWARM_PEER_HPP
+
+#include "ft_includes.hpp"
+#include "ft_protocol.hpp"
+#include "ft_client.hpp"
+#include "ft_sha256.hpp"
+
+// downloads a file from a swarm : the server tells which piece to take from which peer, pieces are checked
+// against their sha256 and served to the other peers by a small embedded loop as soon as they are written
+class ft_swarm_peer
+{
+
+private:
+
+	struct connection
+	{
+		asio::ip::tcp::socket socket;
+		char header[ft_protocol::request_header_size];
+		std::int32_t challenge = 0;
+		std::vector<char> body;
+		std::vector<char> response; // held here until the write of the answer completes
+
+		connection(asio::ip::tcp::socket& new_socket) : socket(std::move(new_socket)) {}
+	};
+
+	ft_client m_tracker;
+
+	asio::io_context m_asio_context;
+	std::unique_ptr<asio::ip::tcp::acceptor> m_asio_acceptor;
+	std::thread m_thread;
+	std::uint16_t m_port = 0;
+
+	std::function<std::int32_t(std::int32_t)> m_validation_function = [](std::int32_t x) { return x; };
+	bool m_client_validation_enabled = true;
+	std::random_device rd;
+	std::mt19937 mt{ rd() };
+
+	std::string m_file_name;
+	std::fstream m_file;
+	std::mutex m_file_mutex;
+	std::uint64_t m_file_size = 0;
+	std::uint32_t m_piece_size = 0;
+	std::vector<ft_sha256::digest> m_hashes;
+	std::vector<char> m_have;
+
+	std::unordered_map<std::string, std::unique_ptr<ft_client>> m_peers;
+	std::chrono::milliseconds m_download_timeout{ 30000 };
+
+public:
+
+	std::atomic<std::uint64_t> m_bytes_from_server{ 0 };
+	std::atomic<std::uint64_t> m_bytes_from_peers{ 0 };
+	std::atomic<std::uint64_t> m_bytes_served{ 0 };
+
+	ft_swarm_peer() = default;
+	ft_swarm_peer(const ft_swarm_peer&) = delete;
+	ft_swarm_peer& operator=(const ft_swarm_peer&) = delete;
+	ft_swarm_peer(ft_swarm_peer&&) = delete;
+	ft_swarm_peer& operator=(ft_swarm_peer&&) = delete;
+	~ft_swarm_peer();
+
+	// the same validation applies to the server and to the other peers
+	void set_validation_function(std::function<std::int32_t(std::int32_t)> fn);
+
+	void enable_client_validation(bool enable) noexcept;
+
+#ifdef FT_ENABLE_TLS
+	// for the connection to the server only, what comes from other peers is checked against the piece hashes it gives
+	bool enable_tls(const std::string& ca_file = std::string(), const std::string& server_name = std::string(), bool verify = true);
+#endif // FT_ENABLE_TLS
+
+	// download gives up once no piece arrived for this long
+	void set_download_timeout(std::chrono::milliseconds timeout) noexcept;
+
+	// starts serving pieces, port 0 picks a free one
+	bool start(std::uint16_t port = 0);
+
+	void stop();
+
+	std::uint16_t port() const noexcept;
+
+	float connect(const char* ip, std::uint16_t port);
+
+	// blocks until every piece is written to destination_file_name, keeps serving them afterwards until stop
+	bool download(const std::string& file_name, const std::string& destination_file_name);
+
+private:
+
+	void accept();
+
+	void handle_validation(std::shared_ptr<connection> client);
+
+	void handle_request(std::shared_ptr<connection> client);
+
+	// sends client->response without blocking the loop, then reads the next request
+	void write_response(std::shared_ptr<connection> client);
+
+	bool send_plan_request(std::vector<std::pair<std::uint32_t, std::string>>& plan);
+
+	// fetches, checks and writes one piece, source is empty for the server
+	bool fetch_piece(std::uint32_t piece, const std::string& source);
+
+	ft_client* peer(const std::string& address);
+};
+
+#endif // FT_SWARM_PEER_HPP
@@ -0,0 +1,262 @@
+#ifndef FT_TLS_HPP
+#define FT_TLS_HPP
+
+#include "ft_includes.hpp"
+
+#ifdef FT_ENABLE_TLS
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#endif // FT_ENABLE_TLS
+
+// optional TLS, built with -DFT_ENABLE_TLS=ON
+//
+// the handshake runs through OpenSSL directly on the connection socket so that, with SSL_OP_ENABLE_KTLS, the kernel
+// takes over record encryption afterwards : the socket is then read and written exactly like a plain one and files
+// go out with SSL_sendfile. When the kernel or the negotiated cipher does not allow it, every byte goes through
+// SSL_read / SSL_write instead, which is why connections are only ever read and written through ft_stream_*
+
+#ifdef FT_ENABLE_TLS
+
+class ft_tls_context
+{
+
+private:
+
+	SSL_CTX* m_context = nullptr;
+
+public:
+
+	ft_tls_context() = default;
+	ft_tls_context(const ft_tls_context&) = delete;
+	ft_tls_context& operator=(const ft_tls_context&) = delete;
+	ft_tls_context(ft_tls_context&&) = delete;
+	ft_tls_context& operator=(ft_tls_context&&) = delete;
+	~ft_tls_context();
+
+	bool init_server(const std::string& certificate_file, const std::string& private_key_file);
+
+	// an empty ca_file uses the system trust store, verify false accepts any certificate
+	bool init_client(const std::string& ca_file, bool verify);
+
+	inline SSL_CTX* native_handle() const noexcept { return m_context; }
+	inline bool is_open() const noexcept { return m_context != nullptr; }
+};
+
+#endif // FT_ENABLE_TLS
+
+// one per connection, empty when TLS is not built in
+class ft_tls_session
+{
+
+#ifdef FT_ENABLE_TLS
+
+public:
+
+	enum class status { done, want_read, want_write, failed };
+
+	SSL* ssl = nullptr;
+
+	// the kernel encrypts or decrypts that direction, the socket is used as is
+	bool ktls_send = false;
+	bool ktls_recv = false;
+
+	// watch pushes write from another thread than the one reading
+	std::mutex mutex;
+
+	ft_tls_session(SSL_CTX* context, int fd, bool server, const std::string& server_name);
+	ft_tls_session(const ft_tls_session&) = delete;
+	ft_tls_session& operator=(const ft_tls_session&) = delete;
+	~ft_tls_session();
+
+	status handshake_step();
+
+	// looks at what the handshake ended up with, call once it is done
+	void check_offload();
+
+	status read_some(void* ptr, std::size_t n, std::size_t& transferred);
+
+	status write_some(const void* ptr, std::size_t n, std::size_t& transferred);
+
+	// only with ktls_send
+	status sendfile(int file_fd, std::uint64_t offset, std::size_t n, std::size_t& transferred);
+
+private:
+
+	status to_status(int result);
+
+#endif // FT_ENABLE_TLS
+};
+
+
+#ifdef FT_ENABLE_TLS
+
+inline bool ft_tls_wait(asio::ip::tcp::socket& socket, ft_tls_session::status status, asio::error_code& ec)
+{
+	if (status == ft_tls_session::status::failed)
+	{
+		ec = asio::error::connection_reset;
+		return false;
+	}
+	socket.wait((status == ft_tls_session::status::want_write) ? asio::socket_base::wait_write : asio::socket_base::wait_read, ec);
+	return !ec;
+}
+
+inline bool ft_tls_handshake(asio::ip::tcp::socket& socket, ft_tls_session& tls, asio::error_code& ec)
+{
+	ec = asio::error_code();
+	for (ft_tls_session::status status = tls.handshake_step(); status != ft_tls_session::status::done; status = tls.handshake_step())
+	{
+		if (!ft_tls_wait(socket, status, ec))
+		{
+			return false;
+		}
+	}
+	tls.check_offload();
+	return true;
+}
+
+template <class Handler>
+void ft_tls_async_read(asio::ip::tcp::socket& socket, ft_tls_session& tls, asio::mutable_buffer buffer, std::size_t done, Handler handler)
+{
+	while (done < buffer.size())
+	{
+		std::size_t transferred = 0;
+		ft_tls_session::status status = tls.read_some(static_cast<char*>(buffer.data()) + done, buffer.size() - done, transferred);
+		if (status == ft_tls_session::status::done)
+		{
+			done += transferred;
+			continue;
+		}
+		if (status == ft_tls_session::status::failed)
+		{
+			asio::post(socket.get_executor(), [handler, done]() mutable { handler(asio::error_code(asio::error::connection_reset), done); });
+			return;
+		}
+
+		socket.async_wait((status == ft_tls_session::status::want_write) ? asio::socket_base::wait_write : asio::socket_base::wait_read,
+			[&socket, &tls, buffer, done, handler](const asio::error_code& ec) mutable
+			{
+				if (ec)
+				{
+					handler(ec, done);
+				}
+				else
+				{
+					ft_tls_async_read(socket, tls, buffer, done, std::move(handler));
+				}
+			}
+		);
+		return;
+	}
+
+	// posted, a connection that keeps the socket busy must not grow the stack
+	asio::post(socket.get_executor(), [handler, done]() mutable { handler(asio::error_code(), done); });
+}
+
+#endif // FT_ENABLE_TLS
+
+// every read and write of a connection goes through these, tls is nullptr for a plain connection
+
+template <class ConstBufferSequence>
+void ft_stream_write(asio::ip::tcp::socket& socket, ft_tls_session* tls, const ConstBufferSequence& buffers, asio::error_code& ec)
+{
+#ifdef FT_ENABLE_TLS
+	if ((tls != nullptr) && !tls->ktls_send)
+	{
+		// small pieces are gathered first, one record each would cost more than the copy
+		std::vector<char> gathered;
+		if (asio::buffer_size(buffers) <= 64 * 1024)
+		{
+			gathered.resize(asio::buffer_size(buffers));
+			asio::buffer_copy(asio::buffer(gathered), buffers);
+		}
+
+		ec = asio::error_code();
+		auto write_all = [&](const char* ptr, std::size_t n)
+		{
+			while (n != 0)
+			{
+				std::size_t transferred = 0;
+				ft_tls_session::status status = tls->write_some(ptr, n, transferred);
+				if (status == ft_tls_session::status::done)
+				{
+					ptr += transferred;
+					n -= transferred;
+				}
+				else if (!ft_tls_wait(socket, status, ec))
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+
+		if (!gathered.empty())
+		{
+			write_all(gathered.data(), gathered.size());
+			return;
+		}
+		for (auto iter = asio::buffer_sequence_begin(buffers); iter != asio::buffer_sequence_end(buffers); ++iter)
+		{
+			asio::const_buffer buffer(*iter);
+			if (!write_all(static_cast<const char*>(buffer.data()), buffer.size()))
+			{
+				return;
+			}
+		}
+		return;
+	}
+#endif // FT_ENABLE_TLS
+
+	asio::write(socket, buffers, ec);
+}
+
+template <class MutableBufferSequence>
+void ft_stream_read(asio::ip::tcp::socket& socket, ft_tls_session* tls, const MutableBufferSequence& buffers, asio::error_code& ec)
+{
+#ifdef FT_ENABLE_TLS
+	if ((tls != nullptr) && !tls->ktls_recv)
+	{
+		ec = asio::error_code();
+		for (auto iter = asio::buffer_sequence_begin(buffers); iter != asio::buffer_sequence_end(buffers); ++iter)
+		{
+			asio::mutable_buffer buffer(*iter);
+			char* ptr = static_cast<char*>(buffer.data());
+			std::size_t n = buffer.size();
+			while (n != 0)
+			{
+				std::size_t transferred = 0;
+				ft_tls_session::status status = tls->read_some(ptr, n, transferred);
+				if (status == ft_tls_session::status::done)
+				{
+					ptr += transferred;
+					n -= transferred;
+				}
+				else if (!ft_tls_wait(socket, status, ec))
+				{
+					return;
+				}
+			}
+		}
+		return;
+	}
+#endif // FT_ENABLE_TLS
+
+	asio::read(socket, buffers, ec);
+}
+
+template <class Handler>
+void ft_stream_async_read(asio::ip::tcp::socket& socket, ft_tls_session* tls, asio::mutable_buffer buffer, Handler handler)
+{
+#ifdef FT_ENABLE_TLS
+	if ((tls != nullptr) && !tls->ktls_recv)
+	{
+		ft_tls_async_read(socket, *tls, buffer, 0, std::move(handler));
+		return;
+	}
+#endif // FT_ENABLE_TLS
+
+	asio::async_read(socket, buffer, std::move(handler));
+}
+
+#endif // FT_TLS_HPP
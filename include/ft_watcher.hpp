@@ -0,0 +1,62 @@
+#ifndef FT_WATCHER_HPP
+#define FT_WATCHER_HPP
+
+#include "ft_includes.hpp"
+
+// inotify backed directory watcher, changes are coalesced per file and delivered at most once per interval
+class ft_watcher
+{
+
+public:
+
+	struct event
+	{
+		char kind; // 'c' created, 'm' modified, 'r' removed
+		std::string name;
+	};
+
+	using callback = std::function<void(const std::string& directory, const std::vector<event>& events)>;
+
+private:
+
+	int m_inotify_fd = -1;
+	int m_wake_fd = -1;
+
+	std::unordered_map<int, std::string> m_directories;
+	std::unordered_map<std::string, std::pair<int, std::size_t>> m_watches;
+	std::unordered_map<int, std::unordered_map<std::string, char>> m_pending;
+
+	std::mutex m_mutex;
+	std::thread m_thread;
+	bool m_running = false;
+	callback m_callback;
+	std::chrono::milliseconds m_interval{ 100 };
+
+public:
+
+	ft_watcher() = default;
+	ft_watcher(const ft_watcher&) = delete;
+	ft_watcher& operator=(const ft_watcher&) = delete;
+	ft_watcher(ft_watcher&&) = delete;
+	ft_watcher& operator=(ft_watcher&&) = delete;
+	~ft_watcher();
+
+	bool start(callback fn);
+
+	void stop();
+
+	// watches are reference counted per directory
+	bool add_watch(const std::string& directory);
+
+	void remove_watch(const std::string& directory);
+
+	void set_interval(std::chrono::milliseconds interval) noexcept;
+
+private:
+
+	void run();
+
+	void read_events();
+};
+
+#endif // FT_WATCHER_HPP
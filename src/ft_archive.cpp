@@ -0,0 +1,859 @@
+#include "ft_archive.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // __linux__
+
+
+namespace
+{
+	// octal with a terminating nul when it fits, GNU base-256 otherwise
+	void put_number(char* field, std::size_t field_size, std::uint64_t value)
+	{
+		if ((field_size * 3 >= 64) || (value < (std::uint64_t(1) << (3 * (field_size - 1)))))
+		{
+			std::memset(field, '0', field_size - 1);
+			field[field_size - 1] = '\0';
+			for (std::size_t n = field_size - 1; (n != 0) && (value != 0); n--, value >>= 3)
+			{
+				field[n - 1] = static_cast<char>('0' + (value & 7));
+			}
+		}
+		else
+		{
+			std::memset(field, 0, field_size);
+			field[0] = static_cast<char>(0x80);
+			for (std::size_t n = field_size - 1; (n != 0) && (value != 0); n--, value >>= 8)
+			{
+				field[n] = static_cast<char>(value & 255);
+			}
+		}
+	}
+
+	std::uint64_t get_number(const char* field, std::size_t field_size)
+	{
+		std::uint64_t value = 0;
+		if ((static_cast<std::uint8_t>(field[0]) & 0x80) != 0)
+		{
+			for (std::size_t n = 1; n < field_size; n++)
+			{
+				value = (value << 8) | static_cast<std::uint8_t>(field[n]);
+			}
+			return value;
+		}
+		for (std::size_t n = 0; n < field_size; n++)
+		{
+			if ((field[n] >= '0') && (field[n] <= '7'))
+			{
+				value = (value << 3) | static_cast<std::uint64_t>(field[n] - '0');
+			}
+			else if ((field[n] != ' ') || (value != 0))
+			{
+				break;
+			}
+		}
+		return value;
+	}
+
+	std::uint32_t header_checksum(const char* header)
+	{
+		// the checksum field itself counts as spaces
+		std::uint32_t sum = 0;
+		for (std::size_t n = 0; n < ft_tar_writer::block_size; n++)
+		{
+			sum += ((n >= 148) && (n < 156)) ? static_cast<std::uint32_t>(' ') : static_cast<std::uint32_t>(static_cast<std::uint8_t>(header[n]));
+		}
+		return sum;
+	}
+}
+
+
+ft_tar_writer::~ft_tar_writer()
+{
+#ifdef FT_ENABLE_ZLIB
+	if (m_zstream_open)
+	{
+		deflateEnd(&m_zstream);
+	}
+#endif // FT_ENABLE_ZLIB
+}
+
+bool ft_tar_writer::open(output out, int compression_level)
+{
+	m_output = std::move(out);
+	m_buffer.clear();
+	m_buffer.reserve(m_chunk_size);
+	m_bytes_written = 0;
+	m_compress = false;
+
+#ifdef FT_ENABLE_ZLIB
+	if (compression_level > 0)
+	{
+		// gzip wrapper so that the saved stream is a plain .tar.gz
+		std::memset(&m_zstream, 0, sizeof(z_stream));
+		if (deflateInit2(&m_zstream, std::min(compression_level, 9), Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			return false;
+		}
+		m_zstream_open = true;
+		m_compress = true;
+		m_compressed.resize(m_chunk_size);
+	}
+#endif // FT_ENABLE_ZLIB
+	return true;
+}
+
+void ft_tar_writer::set_readahead(std::size_t files, std::size_t bytes, std::size_t number_of_threads) noexcept
+{
+	m_readahead_files = (files != 0) ? files : 1;
+	m_readahead_bytes = bytes;
+	m_number_of_threads = (number_of_threads != 0) ? number_of_threads : 1;
+}
+
+void ft_tar_writer::set_content_function(std::string prefix, content_function fn)
+{
+	m_content_prefix = std::move(prefix);
+	m_content_function = std::move(fn);
+}
+
+void ft_tar_writer::set_excluded(const std::vector<std::string>& paths)
+{
+	m_excluded.clear();
+	for (const std::string& path : paths)
+	{
+		std::error_code ec;
+		m_excluded.push_back(std::filesystem::weakly_canonical(path, ec));
+	}
+}
+
+bool ft_tar_writer::write_directory(const std::string& path)
+{
+	std::error_code ec;
+	std::filesystem::path root(path);
+	if (!std::filesystem::is_directory(root, ec))
+	{
+		return false;
+	}
+
+	// the listing is taken once, files that appear afterwards are not part of the archive
+	std::string top = root.filename().generic_string();
+	if ((top.empty() || (top == ".")) && root.has_parent_path())
+	{
+		top = root.parent_path().filename().generic_string();
+	}
+	std::string prefix = (top.empty() || (top == ".") || (top == "..")) ? std::string() : top + '/';
+
+	std::vector<entry> entries;
+	if (!prefix.empty())
+	{
+		entries.emplace_back();
+		entries.back().path = root.generic_string();
+		entries.back().name = prefix;
+		entries.back().directory = true;
+	}
+	for (std::filesystem::recursive_directory_iterator iter(root, std::filesystem::directory_options::skip_permission_denied, ec);
+		!ec && (iter != std::filesystem::recursive_directory_iterator()); iter.increment(ec))
+	{
+		std::string relative = iter->path().lexically_relative(root).generic_string();
+
+		// uploads in progress are not files yet
+		if ((relative.find(".ft_tmp") != std::string::npos) || (relative.find(".ft_part") != std::string::npos))
+		{
+			continue;
+		}
+
+		std::error_code type_ec;
+		bool directory = iter->is_directory(type_ec);
+		if (!directory && !iter->is_regular_file(type_ec))
+		{
+			continue;
+		}
+		if (directory && !m_excluded.empty()
+			&& (std::find(m_excluded.begin(), m_excluded.end(), std::filesystem::weakly_canonical(iter->path(), type_ec)) != m_excluded.end()))
+		{
+			iter.disable_recursion_pending();
+			continue;
+		}
+		entries.emplace_back();
+		entries.back().path = iter->path().generic_string();
+		entries.back().name = prefix + relative + (directory ? "/" : "");
+		entries.back().directory = directory;
+	}
+	std::sort(entries.begin() + (prefix.empty() ? 0 : 1), entries.end(),
+		[](const entry& a, const entry& b) { return a.name < b.name; });
+
+	// workers prepare entries in order within the readahead window, this thread writes them in the same order
+	std::mutex mutex;
+	std::condition_variable condition;
+	std::size_t next_prepare = 0;
+	std::size_t next_write = 0;
+	std::size_t bytes_ahead = 0;
+	bool stop = false;
+
+	std::vector<std::thread> workers;
+	for (std::size_t n = 0; n < std::min(m_number_of_threads, entries.size()); n++)
+	{
+		workers.emplace_back(
+			[&]()
+			{
+				while (true)
+				{
+					std::size_t index;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						condition.wait(lock,
+							[&]()
+							{
+								return stop || (next_prepare == entries.size())
+									|| ((next_prepare < next_write + m_readahead_files) && (bytes_ahead < m_readahead_bytes));
+							}
+						);
+						if (stop || (next_prepare == entries.size()))
+						{
+							return;
+						}
+						index = next_prepare++;
+					}
+
+					prepare(entries[index]);
+
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						entries[index].ready = true;
+						bytes_ahead += entries[index].data.size();
+					}
+					condition.notify_all();
+				}
+			}
+		);
+	}
+
+	bool success = true;
+	for (std::size_t index = 0; index < entries.size(); index++)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock, [&]() { return entries[index].ready; });
+		}
+
+		// a file removed since the listing is left out
+		if (success && entries[index].open)
+		{
+			success = write_entry(entries[index]);
+		}
+
+		std::size_t released = entries[index].data.size();
+		close_entry(entries[index]);
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			bytes_ahead -= released;
+			next_write = index + 1;
+			stop = !success;
+		}
+		condition.notify_all();
+
+		if (!success)
+		{
+			break;
+		}
+	}
+
+	for (std::thread& worker : workers)
+	{
+		worker.join();
+	}
+	for (entry& item : entries)
+	{
+		close_entry(item);
+	}
+
+	if (success)
+	{
+		// end of archive : two empty blocks
+		char zeros[2 * block_size] = {};
+		success = write(zeros, sizeof(zeros)) && flush(true);
+	}
+	return success;
+}
+
+std::uint64_t ft_tar_writer::bytes_written() const noexcept
+{
+	return m_bytes_written;
+}
+
+
+bool ft_tar_writer::write(const char* ptr, std::size_t n)
+{
+	m_bytes_written += n;
+
+#ifdef FT_ENABLE_ZLIB
+	if (m_compress)
+	{
+		m_zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(ptr));
+		m_zstream.avail_in = static_cast<uInt>(n);
+		while (m_zstream.avail_in != 0)
+		{
+			m_zstream.next_out = reinterpret_cast<Bytef*>(m_compressed.data());
+			m_zstream.avail_out = static_cast<uInt>(m_compressed.size());
+			deflate(&m_zstream, Z_NO_FLUSH);
+			std::size_t produced = m_compressed.size() - m_zstream.avail_out;
+			m_buffer.insert(m_buffer.end(), m_compressed.data(), m_compressed.data() + produced);
+			if ((m_buffer.size() >= m_chunk_size) && !flush(false))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+#endif // FT_ENABLE_ZLIB
+
+	// large pieces go out as they are
+	if (n >= m_chunk_size)
+	{
+		return flush(false) && m_output(ptr, n);
+	}
+	m_buffer.insert(m_buffer.end(), ptr, ptr + n);
+	return (m_buffer.size() < m_chunk_size) || flush(false);
+}
+
+bool ft_tar_writer::flush(bool finish)
+{
+#ifdef FT_ENABLE_ZLIB
+	if (finish && m_compress)
+	{
+		m_zstream.next_in = nullptr;
+		m_zstream.avail_in = 0;
+		int result = Z_OK;
+		while (result != Z_STREAM_END)
+		{
+			m_zstream.next_out = reinterpret_cast<Bytef*>(m_compressed.data());
+			m_zstream.avail_out = static_cast<uInt>(m_compressed.size());
+			result = deflate(&m_zstream, Z_FINISH);
+			if ((result != Z_OK) && (result != Z_STREAM_END) && (result != Z_BUF_ERROR))
+			{
+				return false;
+			}
+			m_buffer.insert(m_buffer.end(), m_compressed.data(), m_compressed.data() + (m_compressed.size() - m_zstream.avail_out));
+		}
+	}
+#endif // FT_ENABLE_ZLIB
+
+	if (m_buffer.empty())
+	{
+		return true;
+	}
+	bool success = m_output(m_buffer.data(), m_buffer.size());
+	m_buffer.clear();
+	return success;
+}
+
+bool ft_tar_writer::write_header(const std::string& name, char type, std::uint64_t size, std::int64_t mtime, std::uint32_t mode)
+{
+	char header[block_size] = {};
+
+	// the name is split between prefix and name on a '/' when it can be, a long name entry comes first otherwise
+	std::size_t split = std::string::npos;
+	if (name.size() > 100)
+	{
+		split = name.rfind('/', std::min<std::size_t>(155, name.size() - 2));
+		while ((split != std::string::npos) && (name.size() - split - 1 > 100))
+		{
+			split = std::string::npos;
+		}
+		if (split == std::string::npos)
+		{
+			if (!write_header("././@LongLink", 'L', name.size() + 1, 0, 0644)
+				|| !write(name.c_str(), name.size() + 1))
+			{
+				return false;
+			}
+			std::size_t padding = (block_size - (name.size() + 1) % block_size) % block_size;
+			char zeros[block_size] = {};
+			if (!write(zeros, padding))
+			{
+				return false;
+			}
+		}
+	}
+
+	if (split != std::string::npos)
+	{
+		std::memcpy(header + 345, name.data(), split);
+		std::memcpy(header, name.data() + split + 1, name.size() - split - 1);
+	}
+	else
+	{
+		std::memcpy(header, name.data(), std::min<std::size_t>(name.size(), 100));
+	}
+
+	put_number(header + 100, 8, mode & 07777);
+	put_number(header + 108, 8, 0);
+	put_number(header + 116, 8, 0);
+	put_number(header + 124, 12, size);
+	put_number(header + 136, 12, static_cast<std::uint64_t>(std::max<std::int64_t>(mtime, 0)));
+	header[156] = type;
+	std::memcpy(header + 257, "ustar", 6);
+	std::memcpy(header + 263, "00", 2);
+
+	std::uint32_t sum = header_checksum(header);
+	put_number(header + 148, 7, sum);
+	header[155] = ' ';
+
+	return write(header, block_size);
+}
+
+bool ft_tar_writer::write_entry(entry& item)
+{
+	if (item.directory)
+	{
+		return write_header(item.name, '5', 0, item.mtime, item.mode);
+	}
+	if (!write_header(item.name, '0', item.size, item.mtime, item.mode))
+	{
+		return false;
+	}
+
+	if (item.source)
+	{
+		// a source that breaks off or falls short is padded with zeros as a truncated file is
+		std::vector<char> piece;
+		std::uint64_t offset = 0;
+		while ((offset < item.size) && item.source(piece) && !piece.empty())
+		{
+			std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(item.size - offset, piece.size()));
+			if (!write(piece.data(), n))
+			{
+				return false;
+			}
+			offset += n;
+		}
+		piece.assign(static_cast<std::size_t>(std::min<std::uint64_t>(item.size - offset, m_chunk_size)), 0);
+		while (offset < item.size)
+		{
+			std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(item.size - offset, piece.size()));
+			if (!write(piece.data(), n))
+			{
+				return false;
+			}
+			offset += n;
+		}
+	}
+	else if (item.data.size() == item.size)
+	{
+		if (!write(item.data.data(), item.data.size()))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		// the size announced is the size at open, a file truncated since then is padded with zeros
+		std::vector<char> piece(std::min<std::uint64_t>(item.size, m_chunk_size));
+		for (std::uint64_t offset = 0; offset < item.size;)
+		{
+			std::size_t n = static_cast<std::size_t>(std::min<std::uint64_t>(item.size - offset, piece.size()));
+			if (!read_at(item, offset, piece.data(), n))
+			{
+				std::memset(piece.data(), 0, n);
+			}
+			if (!write(piece.data(), n))
+			{
+				return false;
+			}
+			offset += n;
+		}
+	}
+
+	char zeros[block_size] = {};
+	return write(zeros, static_cast<std::size_t>((block_size - item.size % block_size) % block_size));
+}
+
+void ft_tar_writer::prepare(entry& item) const
+{
+	std::size_t small_file_size = m_small_file_size;
+	std::error_code ec;
+	std::filesystem::file_status status = std::filesystem::status(item.path, ec);
+	item.mode = ec ? 0644 : static_cast<std::uint32_t>(status.permissions() & std::filesystem::perms::mask);
+
+#ifdef __linux__
+	if (item.directory)
+	{
+		struct stat directory_stat;
+		item.open = (::stat(item.path.c_str(), &directory_stat) == 0);
+		item.mtime = item.open ? static_cast<std::int64_t>(directory_stat.st_mtime) : 0;
+		return;
+	}
+
+	// an open file keeps the content it had, a server upload replacing it meanwhile does not show through
+	item.fd = ::open(item.path.c_str(), O_RDONLY | O_CLOEXEC);
+	struct stat file_stat;
+	if ((item.fd < 0) || (::fstat(item.fd, &file_stat) != 0))
+	{
+		return;
+	}
+	item.open = true;
+	item.size = static_cast<std::uint64_t>(file_stat.st_size);
+	item.mtime = static_cast<std::int64_t>(file_stat.st_mtime);
+
+	if (item.size <= small_file_size)
+	{
+		item.data.resize(static_cast<std::size_t>(item.size));
+		if (!read_at(item, 0, item.data.data(), item.data.size()))
+		{
+			item.data.assign(item.data.size(), 0);
+		}
+		::close(item.fd);
+		item.fd = -1;
+	}
+	else
+	{
+		::posix_fadvise(item.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		::posix_fadvise(item.fd, 0, static_cast<off_t>(small_file_size), POSIX_FADV_WILLNEED);
+	}
+	expand(item);
+#else
+	if (item.directory)
+	{
+		item.open = std::filesystem::exists(item.path, ec);
+		return;
+	}
+
+	item.file = std::make_shared<std::ifstream>(item.path, std::ios::binary | std::ios::ate);
+	if (!item.file->is_open())
+	{
+		item.file.reset();
+		return;
+	}
+	item.open = true;
+	item.size = static_cast<std::uint64_t>(item.file->tellg());
+
+	if (item.size <= small_file_size)
+	{
+		item.data.resize(static_cast<std::size_t>(item.size));
+		if (!read_at(item, 0, item.data.data(), item.data.size()))
+		{
+			item.data.assign(item.data.size(), 0);
+		}
+		item.file.reset();
+	}
+	expand(item);
+#endif // __linux__
+}
+
+void ft_tar_writer::expand(entry& item) const
+{
+	if (!m_content_function || (item.size < m_content_prefix.size()))
+	{
+		return;
+	}
+
+	// a small file is already whole in data, a larger one is only read whole past a matching prefix
+	bool whole = (item.data.size() == item.size);
+	std::vector<char> stored;
+	if (whole)
+	{
+		stored.swap(item.data);
+	}
+	else
+	{
+		stored.resize(m_content_prefix.size());
+		if (!read_at(item, 0, stored.data(), stored.size()) || (std::memcmp(stored.data(), m_content_prefix.data(), stored.size()) != 0))
+		{
+			return;
+		}
+		stored.resize(static_cast<std::size_t>(item.size));
+		if (!read_at(item, 0, stored.data(), stored.size()))
+		{
+			return;
+		}
+	}
+
+	std::uint64_t size = 0;
+	content_source source;
+	if ((std::memcmp(stored.data(), m_content_prefix.data(), m_content_prefix.size()) == 0) && m_content_function(stored, size, source))
+	{
+		close_entry(item);
+		item.size = size;
+		item.source = std::move(source);
+	}
+	else if (whole)
+	{
+		item.data.swap(stored);
+	}
+}
+
+void ft_tar_writer::close_entry(entry& item)
+{
+#ifdef __linux__
+	if (item.fd >= 0)
+	{
+		::close(item.fd);
+		item.fd = -1;
+	}
+#endif // __linux__
+	item.file.reset();
+	item.source = nullptr;
+	item.data.clear();
+	item.data.shrink_to_fit();
+}
+
+bool ft_tar_writer::read_at(entry& item, std::uint64_t offset, char* ptr, std::size_t n)
+{
+#ifdef __linux__
+	while (n != 0)
+	{
+		ssize_t result = ::pread(item.fd, ptr, n, static_cast<off_t>(offset));
+		if (result <= 0)
+		{
+			if ((result < 0) && (errno == EINTR)) { continue; }
+			return false;
+		}
+		ptr += result;
+		offset += static_cast<std::uint64_t>(result);
+		n -= static_cast<std::size_t>(result);
+	}
+	return true;
+#else
+	item.file->seekg(static_cast<std::streamoff>(offset));
+	item.file->read(ptr, static_cast<std::streamsize>(n));
+	return item.file->good();
+#endif // __linux__
+}
+
+
+ft_tar_reader::~ft_tar_reader()
+{
+#ifdef FT_ENABLE_ZLIB
+	if (m_zstream_open)
+	{
+		inflateEnd(&m_zstream);
+	}
+#endif // FT_ENABLE_ZLIB
+}
+
+bool ft_tar_reader::open(const std::string& destination, bool compressed)
+{
+	m_destination = std::filesystem::path(destination);
+	std::error_code ec;
+	std::filesystem::create_directories(m_destination, ec);
+	if (!std::filesystem::is_directory(m_destination, ec))
+	{
+		return false;
+	}
+
+	m_compressed = compressed;
+	if (compressed)
+	{
+#ifdef FT_ENABLE_ZLIB
+		std::memset(&m_zstream, 0, sizeof(z_stream));
+		if (inflateInit2(&m_zstream, 15 + 16) != Z_OK)
+		{
+			return false;
+		}
+		m_zstream_open = true;
+		m_inflated.resize(1024 * 1024);
+#else
+		return false;
+#endif // FT_ENABLE_ZLIB
+	}
+	return true;
+}
+
+bool ft_tar_reader::feed(const char* ptr, std::size_t n)
+{
+	if (m_failed)
+	{
+		return false;
+	}
+
+#ifdef FT_ENABLE_ZLIB
+	if (m_compressed)
+	{
+		m_zstream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(ptr));
+		m_zstream.avail_in = static_cast<uInt>(n);
+		while ((m_zstream.avail_in != 0) && !m_failed)
+		{
+			m_zstream.next_out = reinterpret_cast<Bytef*>(m_inflated.data());
+			m_zstream.avail_out = static_cast<uInt>(m_inflated.size());
+			int result = inflate(&m_zstream, Z_NO_FLUSH);
+			if ((result != Z_OK) && (result != Z_STREAM_END) && (result != Z_BUF_ERROR))
+			{
+				m_failed = true;
+				break;
+			}
+			m_failed = !parse(m_inflated.data(), m_inflated.size() - m_zstream.avail_out);
+			if (result == Z_STREAM_END)
+			{
+				break;
+			}
+		}
+		return !m_failed;
+	}
+#endif // FT_ENABLE_ZLIB
+
+	m_failed = !parse(ptr, n);
+	return !m_failed;
+}
+
+bool ft_tar_reader::finish()
+{
+	if (m_file.is_open())
+	{
+		m_file.close();
+	}
+	return !m_failed && m_finished;
+}
+
+
+bool ft_tar_reader::parse(const char* ptr, std::size_t n)
+{
+	while ((n != 0) && !m_finished)
+	{
+		if (m_remaining != 0)
+		{
+			std::size_t take = static_cast<std::size_t>(std::min<std::uint64_t>(m_remaining, n));
+			if (m_type == 'L')
+			{
+				m_pending_long_name.append(ptr, take);
+			}
+			else if (m_file.is_open())
+			{
+				m_file.write(ptr, static_cast<std::streamsize>(take));
+			}
+			ptr += take;
+			n -= take;
+			m_remaining -= take;
+
+			if (m_remaining == 0)
+			{
+				if (m_file.is_open())
+				{
+					m_file.close();
+					if (m_file.fail())
+					{
+						return false;
+					}
+				}
+				if (m_type == 'L')
+				{
+					m_long_name = m_pending_long_name.c_str();
+					m_pending_long_name.clear();
+				}
+			}
+			continue;
+		}
+
+		if (m_padding != 0)
+		{
+			std::size_t take = static_cast<std::size_t>(std::min<std::uint64_t>(m_padding, n));
+			ptr += take;
+			n -= take;
+			m_padding -= take;
+			continue;
+		}
+
+		std::size_t take = std::min(ft_tar_writer::block_size - m_header_size, n);
+		std::memcpy(m_header + m_header_size, ptr, take);
+		ptr += take;
+		n -= take;
+		m_header_size += take;
+		if (m_header_size == ft_tar_writer::block_size)
+		{
+			m_header_size = 0;
+			if (!begin_entry())
+			{
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool ft_tar_reader::begin_entry()
+{
+	// an empty block ends the archive
+	if (std::all_of(m_header, m_header + ft_tar_writer::block_size, [](char c) { return c == 0; }))
+	{
+		m_finished = true;
+		return true;
+	}
+	if (get_number(m_header + 148, 8) != header_checksum(m_header))
+	{
+		return false;
+	}
+
+	m_type = m_header[156];
+	std::uint64_t size = get_number(m_header + 124, 12);
+	m_remaining = size;
+	m_padding = (ft_tar_writer::block_size - size % ft_tar_writer::block_size) % ft_tar_writer::block_size;
+	if (m_type == 'L')
+	{
+		return size <= 64 * 1024;
+	}
+
+	std::string name;
+	if (!m_long_name.empty())
+	{
+		name = std::move(m_long_name);
+		m_long_name.clear();
+	}
+	else
+	{
+		std::string prefix(m_header + 345, strnlen(m_header + 345, 155));
+		name.assign(m_header, strnlen(m_header, 100));
+		if (!prefix.empty())
+		{
+			name = prefix + '/' + name;
+		}
+	}
+	if (!safe_name(name))
+	{
+		return false;
+	}
+
+	std::error_code ec;
+	std::filesystem::path target = m_destination / std::filesystem::path(name);
+	if (m_type == '5')
+	{
+		std::filesystem::create_directories(target, ec);
+		return !ec;
+	}
+	if ((m_type == '0') || (m_type == '\0'))
+	{
+		if (target.has_parent_path())
+		{
+			std::filesystem::create_directories(target.parent_path(), ec);
+		}
+		m_file.open(target, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!m_file.is_open())
+		{
+			return false;
+		}
+		if (size == 0)
+		{
+			m_file.close();
+		}
+	}
+
+	// anything else is skipped
+	return true;
+}
+
+bool ft_tar_reader::safe_name(const std::string& name)
+{
+	std::filesystem::path path(name);
+	if (name.empty() || path.is_absolute() || path.has_root_name() || path.has_root_directory())
+	{
+		return false;
+	}
+	for (const std::filesystem::path& part : path)
+	{
+		if (part == "..")
+		{
+			return false;
+		}
+	}
+	return true;
+}
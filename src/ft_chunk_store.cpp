@@ -0,0 +1,237 @@
+#include "ft_chunk_store.hpp"
+
+
+bool ft_chunk_store::open(const std::string& root, ft_group_commit& group_commit, bool sync)
+{
+	std::error_code ec;
+	std::filesystem::create_directories(root, ec);
+	if (ec)
+	{
+		return false;
+	}
+
+	m_root = root;
+	m_group_commit = &group_commit;
+	m_sync = sync;
+	return true;
+}
+
+bool ft_chunk_store::has_chunk(const ft_sha256::digest& hash) const
+{
+	return find_chunk(hash) != nullptr;
+}
+
+bool ft_chunk_store::put_chunk(const char* ptr, std::size_t n)
+{
+	ft_sha256::digest hash = ft_sha256::hash(ptr, n);
+	if (has_chunk(hash))
+	{
+		return true;
+	}
+	return write_chunk(hash, ptr, n) != nullptr;
+}
+
+bool ft_chunk_store::store(const std::string& file_name, const char* ptr, std::size_t n, std::function<void(bool)> on_done)
+{
+	std::vector<ft_chunker::chunk> chunks = m_chunker.split(ptr, n);
+
+	std::vector<chunk_state> states;
+	states.reserve(chunks.size());
+	for (const ft_chunker::chunk& item : chunks)
+	{
+		chunk_state state = find_chunk(item.hash);
+		if (state == nullptr)
+		{
+			state = write_chunk(item.hash, ptr + item.offset, item.size);
+		}
+		if (state == nullptr)
+		{
+			if (on_done)
+			{
+				on_done(false);
+			}
+			return false;
+		}
+		states.push_back(std::move(state));
+	}
+
+	// the chunks were submitted first, the group commit publishes the manifest after them, directories included
+	std::vector<char> manifest = ft_chunker::make_manifest(chunks, n);
+	return m_group_commit->write_file(file_name, manifest.data(), manifest.size(), m_sync, std::move(on_done), chunks_committed(std::move(states)));
+}
+
+bool ft_chunk_store::store_manifest(const std::string& file_name, const char* manifest_ptr, std::size_t n, std::function<void(bool)> on_done)
+{
+	std::vector<ft_chunker::chunk> chunks;
+	std::uint64_t file_size;
+	std::vector<chunk_state> states;
+	bool complete = ft_chunker::read_manifest(manifest_ptr, n, chunks, file_size);
+	for (std::size_t k = 0; complete && (k < chunks.size()); k++)
+	{
+		states.push_back(find_chunk(chunks[k].hash));
+		complete = (states.back() != nullptr);
+	}
+	if (!complete)
+	{
+		if (on_done)
+		{
+			on_done(false);
+		}
+		return false;
+	}
+	return m_group_commit->write_file(file_name, manifest_ptr, n, m_sync, std::move(on_done), chunks_committed(std::move(states)));
+}
+
+bool ft_chunk_store::append(const std::string& file_name, const char* manifest_ptr, std::size_t manifest_size, const char* ptr, std::size_t n,
+	std::function<void(bool)> on_done)
+{
+	content_reader reader;
+	std::vector<char> tail;
+	bool readable = open_content(manifest_ptr, manifest_size, reader);
+	if (readable && !reader.chunks.empty())
+	{
+		// the last chunk was cut by the end of the file, not by its content
+		reader.next = reader.chunks.size() - 1;
+		readable = read_content(reader, tail);
+		reader.chunks.pop_back();
+	}
+	if (!readable)
+	{
+		if (on_done)
+		{
+			on_done(false);
+		}
+		return false;
+	}
+	tail.insert(tail.end(), ptr, ptr + n);
+
+	std::vector<chunk_state> states;
+	states.reserve(reader.chunks.size());
+	std::uint64_t offset = 0;
+	for (const ft_chunker::chunk& item : reader.chunks)
+	{
+		states.push_back(find_chunk(item.hash));
+		offset += item.size;
+	}
+	std::vector<ft_chunker::chunk> chunks = std::move(reader.chunks);
+	for (ft_chunker::chunk item : m_chunker.split(tail.data(), tail.size()))
+	{
+		chunk_state state = find_chunk(item.hash);
+		if (state == nullptr)
+		{
+			state = write_chunk(item.hash, tail.data() + item.offset, item.size);
+		}
+		states.push_back(std::move(state));
+		item.offset += static_cast<std::size_t>(offset);
+		chunks.push_back(item);
+	}
+
+	if (std::find(states.begin(), states.end(), nullptr) != states.end())
+	{
+		if (on_done)
+		{
+			on_done(false);
+		}
+		return false;
+	}
+	std::vector<char> manifest = ft_chunker::make_manifest(chunks, offset + tail.size());
+	return m_group_commit->write_file(file_name, manifest.data(), manifest.size(), m_sync, std::move(on_done), chunks_committed(std::move(states)));
+}
+
+bool ft_chunk_store::open_content(const char* manifest_ptr, std::size_t n, content_reader& reader) const
+{
+	reader.next = 0;
+	if (!ft_chunker::read_manifest(manifest_ptr, n, reader.chunks, reader.size))
+	{
+		return false;
+	}
+	for (const ft_chunker::chunk& item : reader.chunks)
+	{
+		std::error_code ec;
+		if (std::filesystem::file_size(chunk_path(item.hash), ec) != item.size)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ft_chunk_store::read_content(content_reader& reader, std::vector<char>& chunk) const
+{
+	if (reader.next == reader.chunks.size())
+	{
+		chunk.clear();
+		return true;
+	}
+
+	const ft_chunker::chunk& item = reader.chunks[reader.next++];
+	chunk.resize(item.size);
+	std::ifstream file(chunk_path(item.hash), std::ios::binary);
+	return static_cast<bool>(file.read(chunk.data(), static_cast<std::streamsize>(item.size)));
+}
+
+
+std::string ft_chunk_store::chunk_path(const ft_sha256::digest& hash) const
+{
+	std::string hex = ft_sha256::to_hex(hash);
+	std::string path = m_root;
+	path += '/';
+	path.append(hex, 0, 2);
+	path += '/';
+	path += hex;
+	return path;
+}
+
+ft_chunk_store::chunk_state ft_chunk_store::find_chunk(const ft_sha256::digest& hash) const
+{
+	std::string path = chunk_path(hash);
+	{
+		std::lock_guard<std::mutex> lock(m_pending_chunks_mutex);
+		auto iter = m_pending_chunks.find(path);
+		if (iter != m_pending_chunks.end())
+		{
+			return iter->second;
+		}
+	}
+	std::error_code ec;
+	return std::filesystem::exists(path, ec) ? std::make_shared<std::atomic<int>>(1) : nullptr;
+}
+
+ft_chunk_store::chunk_state ft_chunk_store::write_chunk(const ft_sha256::digest& hash, const char* ptr, std::size_t n)
+{
+	std::string path = chunk_path(hash);
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+	chunk_state state = std::make_shared<std::atomic<int>>(0);
+	bool submitted = m_group_commit->write_file(path, ptr, n, m_sync,
+		[this, path, state](bool committed)
+		{
+			std::lock_guard<std::mutex> lock(m_pending_chunks_mutex);
+			*state = committed ? 1 : 2;
+			auto iter = m_pending_chunks.find(path);
+			if ((iter != m_pending_chunks.end()) && (iter->second == state))
+			{
+				m_pending_chunks.erase(iter);
+			}
+		}
+	);
+
+	// only listed once submitted, manifests that find it pending are submitted after it, a concurrent store
+	// missing it in the meantime writes the same bytes again, which is harmless
+	std::lock_guard<std::mutex> lock(m_pending_chunks_mutex);
+	if (submitted && (*state == 0))
+	{
+		m_pending_chunks[path] = state;
+	}
+	return (submitted || (*state == 1)) ? state : nullptr;
+}
+
+std::function<bool()> ft_chunk_store::chunks_committed(std::vector<chunk_state> states)
+{
+	// evaluated by the group commit once the chunks submitted before the manifest are done
+	return [states = std::move(states)]()
+	{
+		return std::all_of(states.begin(), states.end(), [](const chunk_state& state) { return *state == 1; });
+	};
+}
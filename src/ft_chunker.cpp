@@ -0,0 +1,172 @@
+#include "ft_chunker.hpp"
+
+
+namespace
+{
+	// gear table, 256 pseudo random 64-bit values fixed at compile time so every build cuts identically
+	struct gear_table
+	{
+		std::uint64_t values[256];
+
+		constexpr gear_table() : values()
+		{
+			std::uint64_t state = 0x9e3779b97f4a7c15ull;
+			for (int n = 0; n < 256; n++)
+			{
+				state += 0x9e3779b97f4a7c15ull;
+				std::uint64_t z = state;
+				z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+				z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+				values[n] = z ^ (z >> 31);
+			}
+		}
+	};
+
+	constexpr gear_table gear{};
+
+	// the gear hash shifts left, its high bits depend on the most bytes
+	constexpr std::uint64_t high_bits_mask(std::size_t bits) noexcept
+	{
+		return (bits == 0) ? 0 : (~std::uint64_t(0) << (64 - bits));
+	}
+}
+
+
+void ft_chunker::set_sizes(std::size_t min_size, std::size_t average_size, std::size_t max_size)
+{
+	std::size_t bits = 0;
+	while ((std::size_t(2) << bits) <= average_size)
+	{
+		bits++;
+	}
+	m_average_size = std::size_t(1) << bits;
+	m_min_size = std::min(min_size, m_average_size);
+	m_max_size = std::max(max_size, m_average_size);
+
+	// normalized chunking : harder to cut before the average size, easier after
+	m_small_mask = high_bits_mask(bits + 2);
+	m_large_mask = high_bits_mask((bits > 2) ? bits - 2 : 1);
+}
+
+std::vector<ft_chunker::chunk> ft_chunker::split(const char* ptr, std::size_t n) const
+{
+	std::vector<chunk> chunks;
+	chunks.reserve(n / m_average_size + 1);
+
+	std::size_t offset = 0;
+	while (offset < n)
+	{
+		std::size_t size = next_boundary(ptr + offset, n - offset);
+		chunks.push_back(chunk{ offset, size, ft_sha256::hash(ptr + offset, size) });
+		offset += size;
+	}
+	return chunks;
+}
+
+std::vector<char> ft_chunker::make_manifest(const std::vector<chunk>& chunks, std::uint64_t file_size)
+{
+	std::vector<char> manifest(manifest_header_size + chunks.size() * manifest_entry_size);
+	std::uint32_t number_of_chunks = static_cast<std::uint32_t>(chunks.size());
+
+	char* ptr = manifest.data();
+	std::memcpy(ptr, manifest_magic, 8); ptr += 8;
+	std::memcpy(ptr, &file_size, sizeof(std::uint64_t)); ptr += sizeof(std::uint64_t);
+	std::memcpy(ptr, &number_of_chunks, sizeof(std::uint32_t)); ptr += sizeof(std::uint32_t);
+
+	for (const chunk& item : chunks)
+	{
+		std::uint32_t size = static_cast<std::uint32_t>(item.size);
+		std::memcpy(ptr, item.hash.data(), 32); ptr += 32;
+		std::memcpy(ptr, &size, sizeof(std::uint32_t)); ptr += sizeof(std::uint32_t);
+	}
+	return manifest;
+}
+
+bool ft_chunker::read_manifest(const char* ptr, std::size_t n, std::vector<chunk>& chunks, std::uint64_t& file_size)
+{
+	if (!is_manifest(ptr, n))
+	{
+		return false;
+	}
+
+	std::uint32_t number_of_chunks;
+	std::memcpy(&file_size, ptr + 8, sizeof(std::uint64_t));
+	std::memcpy(&number_of_chunks, ptr + 8 + sizeof(std::uint64_t), sizeof(std::uint32_t));
+
+	chunks.resize(number_of_chunks);
+	ptr += manifest_header_size;
+	std::uint64_t offset = 0;
+	for (chunk& item : chunks)
+	{
+		std::uint32_t size;
+		std::memcpy(item.hash.data(), ptr, 32); ptr += 32;
+		std::memcpy(&size, ptr, sizeof(std::uint32_t)); ptr += sizeof(std::uint32_t);
+		item.offset = static_cast<std::size_t>(offset);
+		item.size = size;
+		offset += size;
+	}
+	return true;
+}
+
+bool ft_chunker::is_manifest(const char* ptr, std::size_t n) noexcept
+{
+	if ((n < manifest_header_size) || (std::memcmp(ptr, manifest_magic, 8) != 0))
+	{
+		return false;
+	}
+
+	std::uint64_t file_size;
+	std::uint32_t number_of_chunks;
+	std::memcpy(&file_size, ptr + 8, sizeof(std::uint64_t));
+	std::memcpy(&number_of_chunks, ptr + 8 + sizeof(std::uint64_t), sizeof(std::uint32_t));
+	if (n != manifest_header_size + static_cast<std::size_t>(number_of_chunks) * manifest_entry_size)
+	{
+		return false;
+	}
+
+	std::uint64_t total_size = 0;
+	for (const char* entry = ptr + manifest_header_size + 32; entry < ptr + n; entry += manifest_entry_size)
+	{
+		std::uint32_t size;
+		std::memcpy(&size, entry, sizeof(std::uint32_t));
+		if (size == 0)
+		{
+			return false;
+		}
+		total_size += size;
+	}
+	return total_size == file_size;
+}
+
+
+std::size_t ft_chunker::next_boundary(const char* ptr, std::size_t n) const noexcept
+{
+	if (n <= m_min_size)
+	{
+		return n;
+	}
+
+	const std::uint8_t* bytes = reinterpret_cast<const std::uint8_t*>(ptr);
+	std::size_t normal_size = std::min(n, m_average_size);
+	std::size_t max_size = std::min(n, m_max_size);
+	std::uint64_t fingerprint = 0;
+
+	std::size_t i = m_min_size;
+	for (; i < normal_size; i++)
+	{
+		fingerprint = (fingerprint << 1) + gear.values[bytes[i]];
+		if ((fingerprint & m_small_mask) == 0)
+		{
+			return i + 1;
+		}
+	}
+	for (; i < max_size; i++)
+	{
+		fingerprint = (fingerprint << 1) + gear.values[bytes[i]];
+		if ((fingerprint & m_large_mask) == 0)
+		{
+			return i + 1;
+		}
+	}
+	return max_size;
+}
@@ -1,4 +1,6 @@
 #include "ft_client.hpp"
+#include "ft_mapped_file.hpp"
+#include "ft_socket_options.hpp"
 
 
 ft_client::~ft_client()
@@ -19,39 +21,62 @@ void ft_client::set_buffer_size(std::size_t new_buffer_size)
 	m_end_ptr = buff.data() + new_buffer_size;
 }
 
-float ft_client::connect(const char* ip, std::uint16_t port)
+void ft_client::set_send_chunk_size(std::size_t new_chunk_size) noexcept
+{
+	m_send_chunk_size = (new_chunk_size != 0) ? new_chunk_size : 1;
+}
+
+void ft_client::set_have_batch_size(std::size_t new_batch_size) noexcept
 {
-	float ret;
-	m_thread = std::thread([&]() { m_asio_context.run(); });
+	m_have_batch_size = (new_batch_size != 0) ? new_batch_size : 1;
+}
 
-	try
+float ft_client::connect(const char* ip, std::uint16_t port)
+{
+	if (!m_thread.joinable())
 	{
-		m_endpoint = asio::ip::tcp::endpoint(asio::ip::make_address(ip, m_error_code), port);
-		m_socket.connect(m_endpoint, m_error_code);
+		m_thread = std::thread([&]() { m_asio_context.run(); });
+	}
 
-		if (m_client_validation_enabled)
-		{
-			std::int32_t random_number;
-			std::int32_t answer_number;
-			m_socket.read_some(asio::buffer(&random_number, sizeof(std::int32_t)), m_error_code);
-			answer_number = m_validation_function(random_number);
-			m_socket.write_some(asio::buffer(&answer_number, sizeof(std::int32_t)), m_error_code);
+	m_endpoint = asio::ip::tcp::endpoint(asio::ip::make_address(ip, m_error_code), port);
+	m_session_token = 0;
 
-			ret = ping();
-		}
+	if (!m_error_code && open_connection())
+	{
+		m_synced_connections = m_connections;
+		return ping();
 	}
-	catch (...)
+	else
 	{
-		m_socket.close();
-		ret = 1.0f / 0.0f;
+		return 1.0f / 0.0f;
 	}
+}
+
+bool ft_client::reconnect()
+{
+	std::chrono::milliseconds backoff = m_initial_backoff;
 
-	return ret;
+	for (std::size_t attempt = 0; attempt < m_max_reconnect_attempts; attempt++)
+	{
+		if (attempt != 0)
+		{
+			std::this_thread::sleep_for(backoff);
+			backoff = std::min(2 * backoff, m_max_backoff);
+		}
+
+		if (open_connection())
+		{
+			return true;
+		}
+	}
+	return false;
 }
 
 void ft_client::disconnect()
 {
-	m_socket.close();
+	asio::error_code ec;
+	m_tls.reset();
+	m_socket.close(ec);
 	m_asio_context.stop();
 	if (m_thread.joinable())
 	{
@@ -64,6 +89,38 @@ void ft_client::set_validation_function(std::function<std::int32_t(std::int32_t)
 	m_validation_function = std::move(fn);
 }
 
+void ft_client::enable_client_validation(bool enable) noexcept
+{
+	m_client_validation_enabled = enable;
+}
+
+#ifdef FT_ENABLE_TLS
+bool ft_client::enable_tls(const std::string& ca_file, const std::string& server_name, bool verify)
+{
+	m_tls_server_name = server_name;
+	return m_tls_context.init_client(ca_file, verify);
+}
+#endif // FT_ENABLE_TLS
+
+void ft_client::enable_low_latency(bool enable, int busy_poll_us)
+{
+	m_low_latency = enable;
+	m_busy_poll_us = busy_poll_us;
+	if (m_socket.is_open())
+	{
+		ft_set_socket_options(m_socket, m_low_latency, m_busy_poll_us);
+	}
+}
+
+void ft_client::set_reconnect_policy(bool auto_reconnect, std::size_t max_attempts,
+	std::chrono::milliseconds initial_backoff, std::chrono::milliseconds max_backoff) noexcept
+{
+	m_auto_reconnect = auto_reconnect;
+	m_max_reconnect_attempts = max_attempts;
+	m_initial_backoff = initial_backoff;
+	m_max_backoff = max_backoff;
+}
+
 bool ft_client::no_error() const
 {
 	if (!m_error_code)
@@ -88,21 +145,18 @@ float ft_client::ping()
 	// send file to sever
 	if (m_socket.is_open())
 	{
-		const char* ptr = "ping    ";
-
 		std::chrono::time_point<std::chrono::steady_clock> ping_start = std::chrono::steady_clock::now();
 
-		m_socket.write_some(asio::buffer(ptr, 8), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		write_request(ft_protocol::ping, std::string());
 
-		char answer[4];
-		m_socket.read_some(asio::buffer(&answer, 1));
+		char answer;
+		ft_stream_read(m_socket, m_tls.get(), asio::buffer(&answer, 1), m_error_code);
 		std::chrono::time_point<std::chrono::steady_clock> ping_stop = std::chrono::steady_clock::now();
 		
 		constexpr double factor_s_per_tick = static_cast<double>(std::chrono::steady_clock::duration::period::num)
 			/ static_cast<double>(std::chrono::steady_clock::duration::period::den);
 
-		return static_cast<float>(factor_s_per_tick * static_cast<double>((ping_stop - ping_start).count()));
+		return m_error_code ? 1.0f / 0.0f : static_cast<float>(factor_s_per_tick * static_cast<double>((ping_stop - ping_start).count()));
 	}
 	else
 	{
@@ -110,66 +164,257 @@ float ft_client::ping()
 	}
 }
 
+ft_client::ping_statistics ft_client::ping(std::size_t number_of_samples)
+{
+	ping_statistics statistics{ 1.0f / 0.0f, 1.0f / 0.0f, 1.0f / 0.0f };
+	std::vector<float> samples;
+	samples.reserve(number_of_samples);
+
+	for (std::size_t n = 0; n < number_of_samples; n++)
+	{
+		float sample = ping();
+		if (!(sample < 1.0f / 0.0f))
+		{
+			return statistics;
+		}
+		samples.push_back(sample);
+	}
+	if (samples.empty())
+	{
+		return statistics;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	double sum = 0;
+	for (float sample : samples)
+	{
+		sum += static_cast<double>(sample);
+	}
+	statistics.min = samples.front();
+	statistics.average = static_cast<float>(sum / static_cast<double>(samples.size()));
+	// nearest rank, the smallest sample with at least 99 % of the samples at or below it
+	statistics.p99 = samples[(samples.size() * 99 + 99) / 100 - 1];
+	return statistics;
+}
+
 bool ft_client::send_file(const std::string& file_name, const std::string& destination_file_name)
 {
-	std::ifstream file(file_name, std::ios::binary | std::ios::ate);
-	std::streamsize file_size = file.tellg();
-	file.seekg(0, std::ios::beg);
-	std::vector<char> buffer(4 * sizeof(char) + sizeof(std::uint32_t) + destination_file_name.size() + file_size);
+	// the payload is streamed from the page cache, it is never copied into anonymous memory
+	ft_mapped_file file;
+	if (file.open(file_name))
+	{
+		std::size_t chunk_size = std::min(file.size(), m_send_chunk_size);
+		file.will_need(0, 2 * m_send_chunk_size);
+
+		// the first chunk is gathered with the request header
+		if (!write_request_begin(ft_protocol::send, destination_file_name, file.size(), file.data(), chunk_size))
+		{
+			return false;
+		}
+		file.release(0, chunk_size);
 
-	// copy file
-	if (file.read(buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t) + destination_file_name.size(), file_size))
+		for (std::size_t offset = chunk_size; offset < file.size(); offset += chunk_size)
+		{
+			chunk_size = std::min(file.size() - offset, m_send_chunk_size);
+			file.will_need(offset + m_send_chunk_size, m_send_chunk_size);
+
+			if (!write_payload(file.data() + offset, chunk_size))
+			{
+				return false;
+			}
+			file.release(offset, chunk_size);
+		}
+		return true;
+	}
+	else
 	{
-		// first 4 chars are "send"
-		std::memcpy(buffer.data(), "send", 4 * sizeof(char));
-		// 4 bytes as the length of name of the destination file name
-		std::uint32_t destination_file_name_size = destination_file_name.size();
-		std::memcpy(buffer.data() + 4 * sizeof(char), &destination_file_name_size, sizeof(std::uint32_t));
-		// copy destination file name
-		std::memcpy(buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t), destination_file_name.data(), destination_file_name.size() * sizeof(char));
+		return false;
+	}
+}
+
+bool ft_client::send_file_deduplicated(const std::string& file_name, const std::string& destination_file_name)
+{
+	ft_mapped_file file;
+	if (!file.open(file_name) || !m_socket.is_open())
+	{
+		return false;
+	}
+
+	std::vector<ft_chunker::chunk> chunks = m_chunker.split(file.data(), file.size());
+	if (chunks.empty())
+	{
+		// nothing to deduplicate, an empty file has no chunk for a manifest to list
+		return send_file(file_name, destination_file_name);
+	}
 
-		// send file to sever
-		if (m_socket.is_open())
+	// ask which chunks the server already holds, in batches so that no request outgrows the server limit
+	std::vector<char> answer(chunks.size());
+	std::vector<char> hashes;
+	for (std::size_t first = 0; first < chunks.size(); first += m_have_batch_size)
+	{
+		std::size_t count = std::min(chunks.size() - first, m_have_batch_size);
+		hashes.resize(32 * count);
+		for (std::size_t n = 0; n < count; n++)
 		{
-			m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-			std::this_thread::sleep_for(std::chrono::microseconds(1));
-			return true;
+			std::memcpy(hashes.data() + 32 * n, chunks[first + n].hash.data(), 32);
 		}
-		else
+		if (!write_request(ft_protocol::have, std::string(), hashes.data(), hashes.size()) || !read_response()
+			|| (last_incoming_buffer_size() != count))
 		{
 			return false;
 		}
+		std::memcpy(answer.data() + first, buff.data(), count);
+		if (std::find(answer.begin() + first, answer.begin() + first + count, 'u') != answer.begin() + first + count)
+		{
+			// no chunk store on the server
+			return send_file(file_name, destination_file_name);
+		}
 	}
-	else
+
+	// upload only the missing ones, then the manifest tying them together
+	for (std::size_t n = 0; n < chunks.size(); n++)
+	{
+		if ((answer[n] == 'n') && !write_request(ft_protocol::cput, std::string(), file.data() + chunks[n].offset, chunks[n].size))
+		{
+			return false;
+		}
+	}
+
+	std::vector<char> manifest = ft_chunker::make_manifest(chunks, file.size());
+	if (!write_request(ft_protocol::mani, destination_file_name, manifest.data(), manifest.size()))
 	{
 		return false;
 	}
+
+	char c = 'n';
+	ft_stream_read(m_socket, m_tls.get(), asio::buffer(&c, 1), m_error_code);
+	return !m_error_code && (c == 'y');
 }
 
-bool ft_client::get_file(const std::string& file_name, const std::string& destination_file_name)
+bool ft_client::send_file_resumable(const std::string& file_name, const std::string& destination_file_name)
 {
-	std::vector<char> buffer(4 * sizeof(char) + sizeof(std::uint32_t) + file_name.size());
-	// first 4 chars are "get "
-	std::memcpy(buffer.data(), "get ", 4 * sizeof(char));
-	// 4 bytes as the length of name of the destination file name
-	std::uint32_t file_name_size = file_name.size();
-	std::memcpy(buffer.data() + 4 * sizeof(char), &file_name_size, sizeof(std::uint32_t));
-	// copy destination file name
-	std::memcpy(buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t), file_name.data(), file_name.size() * sizeof(char));
+	ft_mapped_file file;
+	if (!file.open(file_name))
+	{
+		return false;
+	}
 
-	// send file to sever
-	if (m_socket.is_open())
+	// the upload id binds the server side part file to this content, and lets fin check what was received
+	char upload_id[ft_protocol::upload_id_size];
 	{
-		m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		std::uint64_t file_size = file.size();
+		ft_sha256 hasher;
+		for (std::size_t offset = 0; offset < file.size(); offset += m_send_chunk_size)
+		{
+			std::size_t chunk_size = std::min(file.size() - offset, m_send_chunk_size);
+			file.will_need(offset + m_send_chunk_size, m_send_chunk_size);
+			hasher.update(file.data() + offset, chunk_size);
+			file.release(offset, chunk_size);
+		}
+		ft_sha256::digest hash = hasher.finish();
+		std::memcpy(upload_id, &file_size, sizeof(std::uint64_t));
+		std::memcpy(upload_id + sizeof(std::uint64_t), hash.data(), hash.size());
+	}
+
+	// after a drop, the transfer restarts at the last offset the server acknowledged,
+	// only drops without any progress in between count towards giving up
+	std::size_t failures = 0;
+	std::uint64_t last_offset = 0;
+	while (failures <= m_max_reconnect_attempts)
+	{
+		if (!m_socket.is_open() && !reconnect())
+		{
+			return false;
+		}
+
+		std::uint64_t offset = 0;
+		if (write_request(ft_protocol::offs, destination_file_name, upload_id, sizeof(upload_id)))
+		{
+			ft_stream_read(m_socket, m_tls.get(), asio::buffer(&offset, sizeof(std::uint64_t)), m_error_code);
+		}
+		if (m_error_code || (offset > file.size()))
+		{
+			asio::error_code ec;
+			m_socket.close(ec);
+			failures++;
+			continue;
+		}
+
+		if (offset > last_offset)
+		{
+			last_offset = offset;
+			failures = 0;
+		}
 
-		std::size_t incoming_buffer_length = m_socket.read_some(asio::buffer(buff.data(), buff.size()));
-		m_end_ptr = buff.data() + incoming_buffer_length;
+		file.will_need(static_cast<std::size_t>(offset), 2 * m_send_chunk_size);
+		while (offset < file.size())
+		{
+			std::size_t chunk_size = std::min(static_cast<std::size_t>(file.size() - offset), m_send_chunk_size);
+			file.will_need(static_cast<std::size_t>(offset) + m_send_chunk_size, m_send_chunk_size);
+
+			// payload : upload id, u64 offset, then the chunk
+			char prefix[ft_protocol::upload_id_size + sizeof(std::uint64_t)];
+			std::memcpy(prefix, upload_id, sizeof(upload_id));
+			std::memcpy(prefix + sizeof(upload_id), &offset, sizeof(std::uint64_t));
+			if (!write_request_begin(ft_protocol::part, destination_file_name, sizeof(prefix) + chunk_size, prefix, sizeof(prefix))
+				|| !write_payload(file.data() + offset, chunk_size))
+			{
+				break;
+			}
+			file.release(static_cast<std::size_t>(offset), chunk_size);
+			offset += chunk_size;
+		}
+
+		char c = 'n';
+		if ((offset == file.size()) && write_request(ft_protocol::fin, destination_file_name, upload_id, sizeof(upload_id)))
+		{
+			ft_stream_read(m_socket, m_tls.get(), asio::buffer(&c, 1), m_error_code);
+			if (!m_error_code)
+			{
+				return c == 'y';
+			}
+		}
+
+		asio::error_code ec;
+		m_socket.close(ec);
+		failures++;
+	}
+	return false;
+}
+
+bool ft_client::get_file(const std::string& file_name, const std::string& destination_file_name)
+{
+	// send file to sever
+	if (write_request(ft_protocol::get, file_name))
+	{
+		std::uint64_t incoming_size = read_response_size();
+		if (incoming_size == ft_protocol::no_content)
+		{
+			return false;
+		}
 
 		std::fstream file(destination_file_name, std::ios::out | std::ios::binary);
-		if (file.is_open())
+
+		// streamed to the file through buff, whatever the file size, and never in pieces smaller than a send chunk
+		if (buff.size() < m_send_chunk_size)
 		{
+			set_buffer_size(m_send_chunk_size);
+		}
+		while (incoming_size != 0)
+		{
+			std::size_t incoming_buffer_length = static_cast<std::size_t>(std::min<std::uint64_t>(incoming_size, buff.size()));
+			ft_stream_read(m_socket, m_tls.get(), asio::buffer(buff.data(), incoming_buffer_length), m_error_code);
+			if (m_error_code)
+			{
+				return false;
+			}
+			m_end_ptr = buff.data() + incoming_buffer_length;
 			file.write(buff.data(), incoming_buffer_length);
+			incoming_size -= incoming_buffer_length;
+		}
+
+		if (file.is_open())
+		{
 			file.close();
 			return true;
 		}
@@ -184,26 +429,92 @@ bool ft_client::get_file(const std::string& file_name, const std::string& destin
 	}
 }
 
-bool ft_client::load_file(const std::string& file_name)
+bool ft_client::get_directory(const std::string& path, const std::string& destination, bool unpack, bool compress)
 {
-	std::vector<char> buffer(4 * sizeof(char) + sizeof(std::uint32_t) + file_name.size());
-	// first 4 chars are "get "
-	std::memcpy(buffer.data(), "get ", 4 * sizeof(char));
-	// 4 bytes as the length of name of the destination file name
-	std::uint32_t file_name_size = file_name.size();
-	std::memcpy(buffer.data() + 4 * sizeof(char), &file_name_size, sizeof(std::uint32_t));
-	// copy destination file name
-	std::memcpy(buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t), file_name.data(), file_name.size() * sizeof(char));
+#ifndef FT_ENABLE_ZLIB
+	// nothing here could inflate it
+	compress = compress && !unpack;
+#endif // FT_ENABLE_ZLIB
 
-	// send file to sever
-	if (m_socket.is_open())
+	std::uint8_t flags = compress ? ft_protocol::archive_gzip : 0;
+	if (!write_request(ft_protocol::gdir, path, &flags, 1))
+	{
+		return false;
+	}
+
+	std::uint64_t incoming_size = read_response_size();
+	if (incoming_size != 1)
+	{
+		return false;
+	}
+	char format = 0;
+	ft_stream_read(m_socket, m_tls.get(), asio::buffer(&format, 1), m_error_code);
+	if (m_error_code)
+	{
+		return false;
+	}
+
+	ft_tar_reader reader;
+	std::ofstream file;
+	bool success;
+	if (unpack)
+	{
+		success = reader.open(destination, format == 'g');
+	}
+	else
+	{
+		file.open(destination, std::ios::out | std::ios::binary | std::ios::trunc);
+		success = file.is_open();
+	}
+
+	if (buff.size() < m_send_chunk_size)
+	{
+		set_buffer_size(m_send_chunk_size);
+	}
+
+	// read to the end even after a local failure, the connection stays usable
+	while (true)
+	{
+		incoming_size = read_response_size();
+		if (m_error_code || (incoming_size == ft_protocol::no_content))
+		{
+			return false;
+		}
+		if (incoming_size == 0)
+		{
+			break;
+		}
+		while (incoming_size != 0)
+		{
+			std::size_t incoming_buffer_length = static_cast<std::size_t>(std::min<std::uint64_t>(incoming_size, buff.size()));
+			ft_stream_read(m_socket, m_tls.get(), asio::buffer(buff.data(), incoming_buffer_length), m_error_code);
+			if (m_error_code)
+			{
+				return false;
+			}
+			if (success)
+			{
+				success = unpack ? reader.feed(buff.data(), incoming_buffer_length)
+					: static_cast<bool>(file.write(buff.data(), static_cast<std::streamsize>(incoming_buffer_length)));
+			}
+			incoming_size -= incoming_buffer_length;
+		}
+	}
+
+	if (unpack)
 	{
-		m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		return reader.finish() && success;
+	}
+	file.close();
+	return success && !file.fail();
+}
 
-		std::size_t incoming_buffer_length = m_socket.read_some(asio::buffer(buff.data(), buff.size()));
-		m_end_ptr = buff.data() + incoming_buffer_length;
-		return incoming_buffer_length;
+bool ft_client::load_file(const std::string& file_name)
+{
+	// send file to sever
+	if (write_request(ft_protocol::get, file_name))
+	{
+		return read_response();
 	}
 	else
 	{
@@ -213,43 +524,22 @@ bool ft_client::load_file(const std::string& file_name)
 
 void ft_client::remove_file(const std::string& file_name)
 {
-	std::vector<char> buffer(4 * sizeof(char) + sizeof(std::uint32_t) + file_name.size());
-	// first 6 chars are "rem "
-	std::memcpy(buffer.data(), "rem ", 4 * sizeof(char));
-	// 4 bytes as the length of name of the destination file name
-	std::uint32_t file_name_size = file_name.size();
-	std::memcpy(buffer.data() + 4 * sizeof(char), &file_name_size, sizeof(std::uint32_t));
-	// copy destination file name
-	std::memcpy(buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t), file_name.data(), file_name.size() * sizeof(char));
-
 	// send request to remove to server
-	if (m_socket.is_open())
-	{
-		m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
-	}
+	write_request(ft_protocol::rem, file_name);
 }
 
 char ft_client::check_file(const std::string& file_name)
 {
-	std::vector<char> buffer(4 * sizeof(char) + sizeof(std::uint32_t) + file_name.size());
-	// first 6 chars are "rem "
-	std::memcpy(buffer.data(), "chck", 4 * sizeof(char));
-	// 4 bytes as the length of name of the destination file name
-	std::uint32_t file_name_size = file_name.size();
-	std::memcpy(buffer.data() + 4 * sizeof(char), &file_name_size, sizeof(std::uint32_t));
-	// copy destination file name
-	std::memcpy(buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t), file_name.data(), file_name.size() * sizeof(char));
-
 	// send file to sever
-	if (m_socket.is_open())
+	if (write_request(ft_protocol::chck, file_name))
 	{
-		m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
-
-		m_socket.read_some(asio::buffer(buff.data(), buff.size()));
+		if (buff.empty())
+		{
+			set_buffer_size(1);
+		}
+		ft_stream_read(m_socket, m_tls.get(), asio::buffer(buff.data(), 1), m_error_code);
 		m_end_ptr = buff.data() + 1;
-		return buff[0];
+		return m_error_code ? 'u' : buff[0];
 	}
 	else
 	{
@@ -257,95 +547,210 @@ char ft_client::check_file(const std::string& file_name)
 	}
 }
 
+ft_file_status ft_client::check_file_status(const std::string& file_name)
+{
+	ft_file_status status;
+	if (!write_request(ft_protocol::stat, file_name))
+	{
+		return status;
+	}
+
+	if (read_response())
+	{
+		if (!ft_decode_file_status(buff.data(), last_incoming_buffer_size(), status))
+		{
+			status.state = 'u';
+		}
+	}
+	else
+	{
+		status.state = m_error_code ? 'u' : 'n';
+	}
+	return status;
+}
+
 std::string ft_client::get_list()
 {
-	std::string buffer = "list    ";
+	std::string buffer;
 
 	// send file to sever
-	if (m_socket.is_open())
+	if (write_request(ft_protocol::list, std::string()) && read_response())
 	{
-		m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		buffer.assign(buff.data(), last_incoming_buffer_size());
+	}
+	return buffer;
+}
 
-		std::size_t incoming_buffer_length = m_socket.read_some(asio::buffer(buff.data(), buff.size()));
-		m_end_ptr = buff.data() + incoming_buffer_length;
-		buffer.resize(incoming_buffer_length);
-		std::memcpy(&buffer[0], buff.data(), incoming_buffer_length);
+bool ft_client::load_list()
+{
+	// send file to sever
+	return write_request(ft_protocol::list, std::string()) && read_response();
+}
+
+std::string ft_client::get_list_from_path(const std::string& path)
+{
+	std::string buffer;
 
-		return buffer;
+	// send file to sever
+	if (write_request(ft_protocol::lsfp, path) && read_response())
+	{
+		buffer.assign(buff.data(), last_incoming_buffer_size());
 	}
-	else
+	return buffer;
+}
+
+bool ft_client::load_list_from_path(const std::string& path)
+{
+	// send file to sever
+	return write_request(ft_protocol::lsfp, path) && read_response();
+}
+
+bool ft_client::append_text(const std::string& str, const std::string& destination_file_name)
+{
+	// send text to sever
+	return write_request(ft_protocol::app, destination_file_name, str.data(), str.size());
+}
+
+bool ft_client::sync()
+{
+	std::uint64_t connections = m_connections;
+	char c = 'n';
+	if (write_request(ft_protocol::sync, std::string()))
 	{
-		return buffer;
+		ft_stream_read(m_socket, m_tls.get(), asio::buffer(&c, 1), m_error_code);
 	}
+
+	// whatever was sent on a connection that dropped may never have reached the server
+	bool reopened = (connections != m_synced_connections) || (m_connections != connections);
+	m_synced_connections = m_connections;
+	return !m_error_code && (c == 'y') && !reopened;
 }
 
-bool ft_client::load_list()
+bool ft_client::exchange(std::uint32_t opcode, const std::string& name, const void* const payload_ptr, std::size_t payload_size)
 {
-	std::string buffer = "list    ";
+	return write_request(opcode, name, payload_ptr, payload_size) && read_response();
+}
 
-	// send file to sever
-	if (m_socket.is_open())
+bool ft_client::watch(const std::string& path)
+{
+	if (!write_request(ft_protocol::watch, path))
 	{
-		m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		return false;
+	}
 
-		std::size_t incoming_buffer_length = m_socket.read_some(asio::buffer(buff.data(), buff.size()));
-		m_end_ptr = buff.data() + incoming_buffer_length;
-		return true;
+	// with other paths already watched, pushes may come ahead of the answer, they are kept for read_watch_events
+	bool push = true;
+	std::vector<ft_watch_event> events;
+	while (push)
+	{
+		if (!read_watch_frame(push, events))
+		{
+			return false;
+		}
 	}
-	else
+	m_pending_watch_events.insert(m_pending_watch_events.end(), events.begin(), events.end());
+	if ((last_incoming_buffer_size() != 1) || (buff[0] != 'y'))
 	{
 		return false;
 	}
+	if (std::find(m_watched_paths.begin(), m_watched_paths.end(), path) == m_watched_paths.end())
+	{
+		m_watched_paths.push_back(path);
+	}
+	return true;
 }
 
-std::string ft_client::get_list_from_path(const std::string& path)
+bool ft_client::read_watch_events(std::vector<ft_watch_event>& events)
 {
-	std::string buffer = "lsfp    ";
-	buffer += path;
-	std::uint32_t path_size = static_cast<std::uint32_t>(path.size());
-	std::memcpy(&buffer[4], &path_size, sizeof(std::uint32_t));
-	std::cout << buffer;
-
-	// send file to sever
-	if (m_socket.is_open())
+	events.clear();
+	if (!m_pending_watch_events.empty())
 	{
-		m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		events.swap(m_pending_watch_events);
+		return true;
+	}
 
-		std::size_t incoming_buffer_length = m_socket.read_some(asio::buffer(buff.data(), buff.size()));
-		m_end_ptr = buff.data() + incoming_buffer_length;
-		buffer.resize(incoming_buffer_length);
-		std::memcpy(&buffer[0], buff.data(), incoming_buffer_length);
+	for (std::size_t attempt = 0; attempt <= m_max_reconnect_attempts; attempt++)
+	{
+		bool push = false;
+		if (read_watch_frame(push, events))
+		{
+			if (push)
+			{
+				return true;
+			}
+			continue;
+		}
 
-		return buffer;
+		// the subscriptions died with the connection, whatever changed meanwhile is not replayed
+		if (!m_auto_reconnect || (m_endpoint.port() == 0) || !reconnect())
+		{
+			return false;
+		}
+		std::vector<std::string> paths = std::move(m_watched_paths);
+		m_watched_paths.clear();
+		for (const std::string& path : paths)
+		{
+			if (!watch(path))
+			{
+				return false;
+			}
+		}
+		if (!m_pending_watch_events.empty())
+		{
+			events.swap(m_pending_watch_events);
+			return true;
+		}
 	}
-	else
+	return false;
+}
+
+bool ft_client::read_watch_frame(bool& push, std::vector<ft_watch_event>& events)
+{
+	if (!read_response() || (last_incoming_buffer_size() == 0))
 	{
-		return buffer;
+		return false;
 	}
+	push = (buff[0] == ft_protocol::watch_push);
+	return !push || ft_decode_watch_events(buff.data() + 1, last_incoming_buffer_size() - 1, events);
 }
 
-bool ft_client::load_list_from_path(const std::string& path)
-{
-	std::string buffer = "lsfp    ";
-	buffer += path;
-	std::uint32_t path_size = static_cast<std::uint32_t>(path.size());
-	std::memcpy(&buffer[4], &path_size, sizeof(std::uint32_t));
-	std::cout << buffer;
 
-	// send file to sever
-	if (m_socket.is_open())
+bool ft_client::write_request(std::uint32_t opcode, const std::string& name, const void* const payload_ptr, std::size_t payload_size)
+{
+	if (write_request_begin(opcode, name, payload_size, payload_ptr, payload_size))
 	{
-		m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		return true;
+	}
 
-		std::size_t incoming_buffer_length = m_socket.read_some(asio::buffer(buff.data(), buff.size()));
-		m_end_ptr = buff.data() + incoming_buffer_length;
-		buffer.resize(incoming_buffer_length);
-		std::memcpy(&buffer[0], buff.data(), incoming_buffer_length);
+	// nothing reached the server in one piece, the whole request can be sent again on a new connection
+	if (m_auto_reconnect && (m_endpoint.port() != 0) && reconnect())
+	{
+		return write_request_begin(opcode, name, payload_size, payload_ptr, payload_size);
+	}
+	return false;
+}
 
+bool ft_client::write_request_begin(std::uint32_t opcode, const std::string& name, std::uint64_t payload_size,
+	const void* const first_payload_ptr, std::size_t first_payload_size)
+{
+	if (m_socket.is_open())
+	{
+		char header[ft_protocol::request_header_size];
+		ft_protocol::encode_request_header(header, opcode, static_cast<std::uint32_t>(name.size()), payload_size);
+
+		// header, name and payload go out as one gather list, nothing is copied in front of the payload
+		std::array<asio::const_buffer, 3> buffers = {
+			asio::buffer(header, sizeof(header)),
+			asio::buffer(name.data(), name.size() * sizeof(char)),
+			asio::buffer(first_payload_ptr, first_payload_size)
+		};
+		ft_stream_write(m_socket, m_tls.get(), buffers, m_error_code);
+		if (m_error_code)
+		{
+			asio::error_code ec;
+			m_socket.close(ec);
+			return false;
+		}
 		return true;
 	}
 	else
@@ -354,24 +759,17 @@ bool ft_client::load_list_from_path(const std::string& path)
 	}
 }
 
-bool ft_client::append_text(const std::string& str, const std::string& destination_file_name)
+bool ft_client::write_payload(const void* const payload_ptr, std::size_t payload_size)
 {
-	std::vector<char> buffer(4 * sizeof(char) + sizeof(std::uint32_t) + destination_file_name.size() + str.size());
-
-	// copy text
-	std::memcpy(buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t) + destination_file_name.size(), str.data(), str.size());
-	// first 4 chars are "app "
-	std::memcpy(buffer.data(), "app ", 4 * sizeof(char));
-	// 4 bytes as the length of name of the destination file name
-	std::uint32_t destination_file_name_size = destination_file_name.size();
-	std::memcpy(buffer.data() + 4 * sizeof(char), &destination_file_name_size, sizeof(std::uint32_t));
-	// copy destination file name
-	std::memcpy(buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t), destination_file_name.data(), destination_file_name.size() * sizeof(char));
-	// send file to sever
 	if (m_socket.is_open())
 	{
-		m_socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		ft_stream_write(m_socket, m_tls.get(), asio::buffer(payload_ptr, payload_size), m_error_code);
+		if (m_error_code)
+		{
+			asio::error_code ec;
+			m_socket.close(ec);
+			return false;
+		}
 		return true;
 	}
 	else
@@ -379,3 +777,158 @@ bool ft_client::append_text(const std::string& str, const std::string& destinati
 		return false;
 	}
 }
+
+bool ft_client::open_connection()
+{
+	asio::error_code ec;
+	m_tls.reset();
+	m_socket.close(ec);
+	m_socket.connect(m_endpoint, m_error_code);
+	if (m_error_code)
+	{
+		m_socket.close(ec);
+		return false;
+	}
+	ft_set_socket_options(m_socket, m_low_latency, m_busy_poll_us);
+	m_connections++;
+	if (!start_tls())
+	{
+		m_socket.close(ec);
+		return false;
+	}
+	if (m_session_token == 0)
+	{
+		// a resumed session reads the greeting after sending its token
+		if (!read_hello())
+		{
+			m_socket.close(ec);
+			return false;
+		}
+	}
+
+	if (m_client_validation_enabled)
+	{
+		std::int32_t random_number;
+
+		if (m_session_token != 0)
+		{
+			// the token goes out before the challenge arrives, resuming costs a single round trip
+			char request[4 * sizeof(char) + sizeof(std::uint64_t)];
+			std::memcpy(request, "resm", 4 * sizeof(char));
+			std::memcpy(request + 4 * sizeof(char), &m_session_token, sizeof(std::uint64_t));
+			ft_stream_write(m_socket, m_tls.get(), asio::buffer(request, sizeof(request)), m_error_code);
+			if (m_error_code || !read_hello())
+			{
+				m_session_token = 0;
+				m_socket.close(ec);
+				return false;
+			}
+
+			char answer = 'n';
+			std::array<asio::mutable_buffer, 2> buffers = {
+				asio::buffer(&random_number, sizeof(std::int32_t)),
+				asio::buffer(&answer, 1)
+			};
+			ft_stream_read(m_socket, m_tls.get(), buffers, m_error_code);
+			if (!m_error_code && (answer == 'r'))
+			{
+				return true;
+			}
+
+			// expired or unknown, the server closed the connection : full handshake on a new one
+			m_session_token = 0;
+			m_tls.reset();
+			m_socket.close(ec);
+			m_socket.connect(m_endpoint, m_error_code);
+			if (m_error_code)
+			{
+				m_socket.close(ec);
+				return false;
+			}
+			ft_set_socket_options(m_socket, m_low_latency, m_busy_poll_us);
+			if (!start_tls() || !read_hello())
+			{
+				m_socket.close(ec);
+				return false;
+			}
+		}
+
+		ft_stream_read(m_socket, m_tls.get(), asio::buffer(&random_number, sizeof(std::int32_t)), m_error_code);
+		if (m_error_code)
+		{
+			m_socket.close(ec);
+			return false;
+		}
+
+		char request[4 * sizeof(char) + sizeof(std::int32_t)];
+		std::int32_t answer_number = m_validation_function(random_number);
+		std::memcpy(request, "vali", 4 * sizeof(char));
+		std::memcpy(request + 4 * sizeof(char), &answer_number, sizeof(std::int32_t));
+		ft_stream_write(m_socket, m_tls.get(), asio::buffer(request, sizeof(request)), m_error_code);
+		ft_stream_read(m_socket, m_tls.get(), asio::buffer(&m_session_token, sizeof(std::uint64_t)), m_error_code);
+		if (m_error_code)
+		{
+			m_session_token = 0;
+			m_socket.close(ec);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ft_client::start_tls()
+{
+#ifdef FT_ENABLE_TLS
+	if (m_tls_context.is_open())
+	{
+		// without a name the certificate is checked against the address connected to, never against nothing
+		std::string server_name = m_tls_server_name.empty() ? m_endpoint.address().to_string() : m_tls_server_name;
+		m_tls = std::make_unique<ft_tls_session>(m_tls_context.native_handle(), m_socket.native_handle(), false, server_name);
+		if (!ft_tls_handshake(m_socket, *m_tls, m_error_code))
+		{
+			m_tls.reset();
+			return false;
+		}
+	}
+#endif // FT_ENABLE_TLS
+	return true;
+}
+
+bool ft_client::read_hello()
+{
+	char hello[ft_protocol::hello_size];
+	ft_stream_read(m_socket, m_tls.get(), asio::buffer(hello, sizeof(hello)), m_error_code);
+	if (!m_error_code && !ft_protocol::check_hello(hello))
+	{
+		// another protocol version, nothing it answers could be read correctly
+		m_error_code = asio::error::make_error_code(asio::error::no_protocol_option);
+	}
+	return !m_error_code;
+}
+
+std::uint64_t ft_client::read_response_size()
+{
+	std::uint64_t incoming_size = ft_protocol::no_content;
+	ft_stream_read(m_socket, m_tls.get(), asio::buffer(&incoming_size, sizeof(std::uint64_t)), m_error_code);
+	return m_error_code ? ft_protocol::no_content : incoming_size;
+}
+
+bool ft_client::read_response()
+{
+	std::uint64_t incoming_size = read_response_size();
+	if (incoming_size == ft_protocol::no_content)
+	{
+		m_end_ptr = buff.data();
+		return false;
+	}
+
+	// buff grows to fit the whole response
+	std::size_t incoming_buffer_length = static_cast<std::size_t>(incoming_size);
+	if (buff.size() < incoming_buffer_length)
+	{
+		buff.resize(incoming_buffer_length);
+	}
+	ft_stream_read(m_socket, m_tls.get(), asio::buffer(buff.data(), incoming_buffer_length), m_error_code);
+	m_end_ptr = buff.data() + incoming_buffer_length;
+	return !m_error_code;
+}
@@ -0,0 +1,347 @@
+#include "ft_group_commit.hpp"
+#include "ft_posix_io.hpp"
+
+
+ft_group_commit::~ft_group_commit()
+{
+	stop();
+}
+
+void ft_group_commit::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_running)
+	{
+		m_running = true;
+		m_thread = std::thread([&]() { run(); });
+	}
+}
+
+void ft_group_commit::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_condition.notify_all();
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	// whatever was submitted after the thread left
+	std::vector<pending_sync> batch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		batch.swap(m_pending);
+	}
+	sync_batch(batch);
+}
+
+void ft_group_commit::submit(int fd, std::function<bool(bool)> on_synced, std::string directory, std::function<void(bool)> on_committed,
+	bool dependent)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_pending.empty())
+		{
+			m_first_pending_time = std::chrono::steady_clock::now();
+		}
+		m_pending.push_back(pending_sync{ fd, std::move(on_synced), std::move(directory), std::move(on_committed), dependent });
+
+		if (m_running)
+		{
+			if ((m_pending.size() == 1) || (m_pending.size() >= m_max_batch_size))
+			{
+				m_condition.notify_one();
+			}
+			return;
+		}
+	}
+
+	// not running : sync in the caller
+	std::vector<pending_sync> batch;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		batch.swap(m_pending);
+	}
+	sync_batch(batch);
+}
+
+bool ft_group_commit::write_file(const std::string& file_name, const char* ptr, std::size_t n, bool sync,
+	std::function<void(bool)> on_done, std::function<bool()> ready)
+{
+	// write next to the destination then rename, readers never see a half written file
+	std::string temp_file_name = file_name + ".ft_tmp" + std::to_string(m_temp_file_counter++);
+
+#ifdef __linux__
+	int fd = ::open(temp_file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		if (on_done)
+		{
+			on_done(false);
+		}
+		return false;
+	}
+	if (!ft_write_all(fd, ptr, n))
+	{
+		::close(fd);
+		::unlink(temp_file_name.c_str());
+		if (on_done)
+		{
+			on_done(false);
+		}
+		return false;
+	}
+
+	if (sync)
+	{
+		std::string directory = std::filesystem::path(file_name).parent_path().string();
+		if (directory.empty())
+		{
+			directory = ".";
+		}
+
+		// the rename happens once the data is synced, the directory is synced after the rename
+		bool dependent = static_cast<bool>(ready);
+		std::uint64_t ticket = begin_publish(file_name);
+		submit(fd,
+			[this, temp_file_name, file_name, ready, ticket](bool synced)
+			{
+				bool published = publish(temp_file_name, file_name, synced && (!ready || ready()));
+				end_publish(file_name, ticket);
+				return published;
+			},
+			std::move(directory), std::move(on_done), dependent);
+		return true;
+	}
+	else
+	{
+		::close(fd);
+		bool ok = publish(temp_file_name, file_name, !ready || ready());
+		if (on_done)
+		{
+			on_done(ok);
+		}
+		return ok;
+	}
+#else
+	std::fstream file(temp_file_name, std::ios::out | std::ios::binary);
+	file.write(ptr, n);
+	file.close();
+	bool ok = publish(temp_file_name, file_name, !file.fail() && (!ready || ready()));
+	if (on_done)
+	{
+		on_done(ok);
+	}
+	return ok;
+#endif // __linux__
+}
+
+bool ft_group_commit::commit_file(const std::string& source_file_name, const std::string& file_name, bool sync,
+	std::function<void(bool)> on_done)
+{
+	std::string temp_file_name = file_name + ".ft_tmp" + std::to_string(m_temp_file_counter++);
+	std::error_code ec;
+	std::filesystem::rename(source_file_name, temp_file_name, ec);
+	if (ec)
+	{
+		if (on_done)
+		{
+			on_done(false);
+		}
+		return false;
+	}
+
+#ifdef __linux__
+	if (sync)
+	{
+		int fd = ::open(temp_file_name.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd >= 0)
+		{
+			std::string directory = std::filesystem::path(file_name).parent_path().string();
+			if (directory.empty())
+			{
+				directory = ".";
+			}
+
+			std::uint64_t ticket = begin_publish(file_name);
+			submit(fd,
+				[this, temp_file_name, file_name, ticket](bool synced)
+				{
+					bool published = publish(temp_file_name, file_name, synced);
+					end_publish(file_name, ticket);
+					return published;
+				},
+				std::move(directory), std::move(on_done));
+			return true;
+		}
+	}
+#endif // __linux__
+
+	bool ok = publish(temp_file_name, file_name, true);
+	if (on_done)
+	{
+		on_done(ok);
+	}
+	return ok;
+}
+
+void ft_group_commit::wait_published(const std::string& file_name)
+{
+	// only the renames submitted so far, later ones do not hold the caller back
+	std::unique_lock<std::mutex> lock(m_publishing_mutex);
+	std::uint64_t ticket = m_next_ticket;
+	m_published.wait(lock,
+		[&]()
+		{
+			auto iter = m_publishing.find(file_name);
+			return (iter == m_publishing.end()) || (*iter->second.begin() >= ticket);
+		}
+	);
+}
+
+void ft_group_commit::set_latency_bound(std::chrono::microseconds latency_bound)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_latency_bound = latency_bound;
+}
+
+void ft_group_commit::set_max_batch_size(std::size_t max_batch_size)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_max_batch_size = (max_batch_size != 0) ? max_batch_size : 1;
+}
+
+
+void ft_group_commit::run()
+{
+	std::vector<pending_sync> batch;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [&]() { return !m_running || !m_pending.empty(); });
+			if (!m_running)
+			{
+				return;
+			}
+
+			// let more writers join the cycle, but never hold the oldest one past the latency bound
+			m_condition.wait_until(lock, m_first_pending_time + m_latency_bound,
+				[&]() { return !m_running || (m_pending.size() >= m_max_batch_size); });
+			batch.swap(m_pending);
+		}
+
+		sync_batch(batch);
+		batch.clear();
+	}
+}
+
+void ft_group_commit::sync_batch(std::vector<pending_sync>& batch)
+{
+	// dependent items go last, what they depend on is committed by then, directory included
+	sync_items(batch, false);
+	sync_items(batch, true);
+}
+
+void ft_group_commit::sync_items(std::vector<pending_sync>& batch, bool dependent)
+{
+	std::vector<std::string> directories;
+	std::vector<char> done(batch.size(), 0);
+
+	for (std::size_t n = 0; n < batch.size(); n++)
+	{
+		pending_sync& item = batch[n];
+		if (item.dependent != dependent)
+		{
+			continue;
+		}
+#ifdef __linux__
+		bool synced = (::fdatasync(item.fd) == 0);
+#else
+		bool synced = true;
+#endif // __linux__
+		// a failed sync is handed to the callback, which must not publish the data
+		done[n] = (item.on_synced ? item.on_synced(synced) : synced) ? 1 : 0;
+#ifdef __linux__
+		::close(item.fd);
+#endif // __linux__
+		if ((done[n] != 0) && !item.directory.empty())
+		{
+			directories.push_back(item.directory);
+		}
+	}
+
+	// renames done by the callbacks become durable with their directory
+	std::sort(directories.begin(), directories.end());
+	directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+	std::vector<std::string> failed_directories;
+	for (const std::string& directory : directories)
+	{
+#ifdef __linux__
+		int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+		if ((fd < 0) || (::fsync(fd) != 0))
+		{
+			failed_directories.push_back(directory);
+		}
+		if (fd >= 0)
+		{
+			::close(fd);
+		}
+#endif // __linux__
+	}
+
+	for (std::size_t n = 0; n < batch.size(); n++)
+	{
+		if ((batch[n].dependent == dependent) && batch[n].on_committed)
+		{
+			bool committed = (done[n] != 0) && (batch[n].directory.empty()
+				|| !std::binary_search(failed_directories.begin(), failed_directories.end(), batch[n].directory));
+			batch[n].on_committed(committed);
+		}
+	}
+}
+
+bool ft_group_commit::publish(const std::string& temp_file_name, const std::string& file_name, bool synced)
+{
+	// a file that could not be written or synced never replaces the previous content
+	std::error_code ec;
+	if (synced)
+	{
+		std::filesystem::rename(temp_file_name, file_name, ec);
+		if (!ec)
+		{
+			return true;
+		}
+	}
+	std::filesystem::remove(temp_file_name, ec);
+	return false;
+}
+
+std::uint64_t ft_group_commit::begin_publish(const std::string& file_name)
+{
+	std::lock_guard<std::mutex> lock(m_publishing_mutex);
+	std::uint64_t ticket = m_next_ticket++;
+	m_publishing[file_name].insert(ticket);
+	return ticket;
+}
+
+void ft_group_commit::end_publish(const std::string& file_name, std::uint64_t ticket)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_publishing_mutex);
+		auto iter = m_publishing.find(file_name);
+		if (iter != m_publishing.end())
+		{
+			iter->second.erase(ticket);
+			if (iter->second.empty())
+			{
+				m_publishing.erase(iter);
+			}
+		}
+	}
+	m_published.notify_all();
+}
@@ -0,0 +1,564 @@
+#include "ft_hash_index.hpp"
+#include "ft_mapped_file.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // __linux__
+
+
+namespace
+{
+	constexpr std::size_t initial_capacity = 4096;
+	constexpr std::size_t hash_piece_size = 4 * 1024 * 1024;
+}
+
+ft_hash_index::~ft_hash_index()
+{
+	stop();
+	close();
+}
+
+bool ft_hash_index::open(const std::string& index_file_name, const std::string& root, std::vector<std::string> excluded)
+{
+	close();
+	m_file_name = index_file_name;
+	m_root = root;
+	m_excluded.clear();
+	for (const std::string& path : excluded)
+	{
+		m_excluded.push_back(normalize(path));
+	}
+	m_scan_done = false;
+
+	// whatever is there is reused only if it looks exactly like an index
+	std::size_t existing_size = 0;
+#ifdef __linux__
+	m_fd = ::open(index_file_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (m_fd < 0)
+	{
+		return false;
+	}
+	struct stat index_stat;
+	if (::fstat(m_fd, &index_stat) == 0)
+	{
+		existing_size = static_cast<std::size_t>(index_stat.st_size);
+	}
+#else
+	std::ifstream file(index_file_name, std::ios::binary | std::ios::ate);
+	if (file.is_open())
+	{
+		existing_size = static_cast<std::size_t>(file.tellg());
+		file.seekg(0, std::ios::beg);
+		m_fallback_buffer.resize(existing_size);
+		file.read(m_fallback_buffer.data(), static_cast<std::streamsize>(existing_size));
+	}
+#endif // __linux__
+
+	if (existing_size > sizeof(header))
+	{
+		std::size_t capacity = (existing_size - sizeof(header)) / sizeof(slot);
+		if (map(capacity, false) && (m_header->magic == index_magic) && (m_header->version == index_version)
+			&& (m_header->capacity == capacity) && ((capacity & (capacity - 1)) == 0)
+			&& (existing_size == sizeof(header) + capacity * sizeof(slot)))
+		{
+			return true;
+		}
+		unmap();
+	}
+	return map(initial_capacity, true);
+}
+
+void ft_hash_index::close()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+#ifndef __linux__
+	if (m_header != nullptr)
+	{
+		std::ofstream file(m_file_name, std::ios::binary | std::ios::trunc);
+		file.write(m_fallback_buffer.data(), static_cast<std::streamsize>(m_mapped_size));
+	}
+#endif // __linux__
+	unmap();
+#ifdef __linux__
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+#endif // __linux__
+}
+
+void ft_hash_index::set_content_function(std::string prefix, content_function fn)
+{
+	m_content_prefix = std::move(prefix);
+	m_content_function = std::move(fn);
+}
+
+void ft_hash_index::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_running && (m_header != nullptr))
+	{
+		m_running = true;
+		m_thread = std::thread([&]() { run(); });
+	}
+}
+
+void ft_hash_index::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_condition.notify_all();
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+}
+
+bool ft_hash_index::lookup(const std::string& path, record& result)
+{
+	std::uint64_t disk_size = 0;
+	std::int64_t mtime = 0;
+	if (!file_status(path, disk_size, mtime))
+	{
+		return false;
+	}
+	result.size = disk_size;
+	result.mtime = mtime;
+	result.hashed = false;
+
+	std::string key_path = normalize(path);
+	if (excluded(key_path))
+	{
+		return true;
+	}
+
+	ft_sha256::digest key = ft_sha256::hash(key_path.data(), key_path.size());
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		slot* target = (m_header != nullptr) ? find_slot(key, false) : nullptr;
+		if ((target != nullptr) && (target->disk_size == disk_size) && (target->mtime == mtime) && (target->racy == 0))
+		{
+			result.size = target->size;
+			result.hash = target->hash;
+			result.hashed = true;
+			return true;
+		}
+	}
+
+	// someone is waiting for it, ahead of the initial walk
+	enqueue(key_path, true);
+	return true;
+}
+
+void ft_hash_index::invalidate(const std::string& path)
+{
+	std::string key_path = normalize(path);
+	if (excluded(key_path))
+	{
+		return;
+	}
+
+	// stale at once, a write that kept the size and the mtime tick is not trusted until hashed again
+	ft_sha256::digest key = ft_sha256::hash(key_path.data(), key_path.size());
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		slot* target = (m_header != nullptr) ? find_slot(key, false) : nullptr;
+		if (target != nullptr)
+		{
+			target->mtime = no_mtime;
+		}
+	}
+	enqueue(key_path, false);
+}
+
+void ft_hash_index::remove(const std::string& path)
+{
+	std::string key_path = normalize(path);
+	ft_sha256::digest key = ft_sha256::hash(key_path.data(), key_path.size());
+	std::lock_guard<std::mutex> lock(m_mutex);
+	slot* target = (m_header != nullptr) ? find_slot(key, false) : nullptr;
+	if (target != nullptr)
+	{
+		target->state = slot_state::removed;
+	}
+}
+
+bool ft_hash_index::file_status(const std::string& path, std::uint64_t& size, std::int64_t& mtime)
+{
+#ifdef __linux__
+	struct stat file_stat;
+	if ((::stat(path.c_str(), &file_stat) != 0) || !S_ISREG(file_stat.st_mode))
+	{
+		return false;
+	}
+	size = static_cast<std::uint64_t>(file_stat.st_size);
+	mtime = static_cast<std::int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 + static_cast<std::int64_t>(file_stat.st_mtim.tv_nsec);
+	return true;
+#else
+	std::error_code ec;
+	if (!std::filesystem::is_regular_file(path, ec))
+	{
+		return false;
+	}
+	size = static_cast<std::uint64_t>(std::filesystem::file_size(path, ec));
+	std::filesystem::file_time_type write_time = std::filesystem::last_write_time(path, ec);
+	mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(write_time.time_since_epoch()).count();
+	return !ec;
+#endif // __linux__
+}
+
+std::int64_t ft_hash_index::current_time()
+{
+#ifdef __linux__
+	struct timespec now;
+	::clock_gettime(CLOCK_REALTIME, &now);
+	return static_cast<std::int64_t>(now.tv_sec) * 1000000000 + static_cast<std::int64_t>(now.tv_nsec);
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::filesystem::file_time_type::clock::now().time_since_epoch()).count();
+#endif // __linux__
+}
+
+
+std::string ft_hash_index::normalize(const std::string& path)
+{
+	return std::filesystem::path(path).lexically_normal().generic_string();
+}
+
+bool ft_hash_index::map(std::size_t capacity, bool reset)
+{
+	std::size_t mapped_size = sizeof(header) + capacity * sizeof(slot);
+
+#ifdef __linux__
+	if (reset && (::ftruncate(m_fd, static_cast<off_t>(mapped_size)) != 0))
+	{
+		return false;
+	}
+	void* ptr = ::mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (ptr == MAP_FAILED)
+	{
+		return false;
+	}
+	char* base = static_cast<char*>(ptr);
+#else
+	m_fallback_buffer.resize(mapped_size);
+	char* base = m_fallback_buffer.data();
+#endif // __linux__
+
+	m_mapped_size = mapped_size;
+	m_header = reinterpret_cast<header*>(base);
+	m_slots = reinterpret_cast<slot*>(base + sizeof(header));
+
+	if (reset)
+	{
+		std::memset(base, 0, mapped_size);
+		m_header->magic = index_magic;
+		m_header->version = index_version;
+		m_header->capacity = capacity;
+		m_header->used = 0;
+	}
+	return true;
+}
+
+void ft_hash_index::unmap()
+{
+#ifdef __linux__
+	if (m_header != nullptr)
+	{
+		::munmap(m_header, m_mapped_size);
+	}
+#else
+	m_fallback_buffer.clear();
+#endif // __linux__
+	m_header = nullptr;
+	m_slots = nullptr;
+	m_mapped_size = 0;
+}
+
+ft_hash_index::slot* ft_hash_index::find_slot(const ft_sha256::digest& key, bool insert)
+{
+	for (int attempt = 0; (attempt < 2) && (m_header != nullptr); attempt++)
+	{
+		// linear probing from the first 8 bytes of the key, removed slots are reused by inserts
+		std::uint64_t mask = m_header->capacity - 1;
+		std::uint64_t index;
+		std::memcpy(&index, key.data(), sizeof(std::uint64_t));
+		index &= mask;
+
+		slot* reusable = nullptr;
+		for (std::uint64_t probe = 0; probe <= mask; probe++, index = (index + 1) & mask)
+		{
+			slot& current = m_slots[index];
+			if (current.state == slot_state::empty)
+			{
+				if (reusable == nullptr)
+				{
+					reusable = &current;
+				}
+				break;
+			}
+			if (current.state == slot_state::removed)
+			{
+				reusable = (reusable == nullptr) ? &current : reusable;
+			}
+			else if (current.key == key)
+			{
+				return &current;
+			}
+		}
+
+		if (!insert)
+		{
+			return nullptr;
+		}
+
+		// no more than 70 % of the slots ever used before the table doubles
+		if ((reusable == nullptr) || ((reusable->state == slot_state::empty) && (10 * (m_header->used + 1) > 7 * m_header->capacity)))
+		{
+			if (attempt == 0)
+			{
+				// the old mapping is gone either way
+				grow();
+				continue;
+			}
+			if (reusable == nullptr)
+			{
+				return nullptr;
+			}
+		}
+
+		if (reusable->state == slot_state::empty)
+		{
+			m_header->used++;
+		}
+		reusable->mtime = no_mtime;
+		reusable->key = key;
+		reusable->disk_size = 0;
+		reusable->size = 0;
+		reusable->racy = 0;
+		reusable->state = slot_state::valid;
+		return reusable;
+	}
+	return nullptr;
+}
+
+bool ft_hash_index::grow()
+{
+	std::vector<slot> live;
+	for (std::uint64_t n = 0; n < m_header->capacity; n++)
+	{
+		if (m_slots[n].state == slot_state::valid)
+		{
+			live.push_back(m_slots[n]);
+		}
+	}
+
+	// removed slots are dropped on the way
+	std::size_t capacity = static_cast<std::size_t>(m_header->capacity) * 2;
+	unmap();
+	if (!map(capacity, true))
+	{
+		return false;
+	}
+	for (const slot& item : live)
+	{
+		slot* target = find_slot(item.key, true);
+		if (target != nullptr)
+		{
+			*target = item;
+		}
+	}
+	return true;
+}
+
+void ft_hash_index::enqueue(const std::string& path, bool urgent)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_queued.insert(path).second)
+		{
+			return;
+		}
+		if (urgent)
+		{
+			m_queue.push_front(path);
+		}
+		else
+		{
+			m_queue.push_back(path);
+		}
+	}
+	m_condition.notify_one();
+}
+
+bool ft_hash_index::excluded(const std::string& path) const
+{
+	if ((path.find(".ft_tmp") != std::string::npos) || (path.find(".ft_part") != std::string::npos) || (path == normalize(m_file_name)))
+	{
+		return true;
+	}
+	for (const std::string& prefix : m_excluded)
+	{
+		if ((path.compare(0, prefix.size(), prefix) == 0) && ((path.size() == prefix.size()) || (path[prefix.size()] == '/')))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void ft_hash_index::hash_file(const std::string& path)
+{
+	std::uint64_t disk_size = 0;
+	std::int64_t mtime = 0;
+	ft_sha256::digest key = ft_sha256::hash(path.data(), path.size());
+	if (!file_status(path, disk_size, mtime))
+	{
+		remove(path);
+		return;
+	}
+
+	{
+		// written since the last walk or never seen
+		std::lock_guard<std::mutex> lock(m_mutex);
+		slot* target = find_slot(key, false);
+		if ((target != nullptr) && (target->disk_size == disk_size) && (target->mtime == mtime)
+			&& ((target->racy == 0) || (current_time() - mtime < racy_window)))
+		{
+			// a racy entry still in its tick would come out racy again, the next lookup queues it once the tick is over
+			return;
+		}
+	}
+
+	// a write landing after this point but within the mtime tick leaves the mtime as it is
+	std::int64_t hash_time = current_time();
+	// read, not mapped : another process truncating the file fails a read instead of faulting on a mapped page
+	ft_mapped_file file;
+	if (!file.open(path, false))
+	{
+		return;
+	}
+
+	ft_sha256 hasher;
+	std::uint64_t content_size = file.size();
+	bool read = true;
+	bool content = false;
+	std::vector<char> buffer;
+	if (m_content_function && (file.size() >= m_content_prefix.size()))
+	{
+		buffer.resize(m_content_prefix.size());
+		read = file.read_at(0, buffer.data(), buffer.size());
+		if (read && (std::memcmp(buffer.data(), m_content_prefix.data(), buffer.size()) == 0))
+		{
+			buffer.resize(file.size());
+			read = file.read_at(0, buffer.data(), buffer.size());
+			content = read && m_content_function(buffer.data(), buffer.size(), hasher, content_size);
+		}
+	}
+	if (read && !content)
+	{
+		hasher.reset();
+		content_size = file.size();
+		buffer.resize(std::min(hash_piece_size, file.size()));
+		for (std::size_t offset = 0; read && (offset < file.size()); offset += hash_piece_size)
+		{
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				if (!m_running)
+				{
+					return;
+				}
+			}
+			std::size_t n = std::min(hash_piece_size, file.size() - offset);
+			read = file.read_at(offset, buffer.data(), n);
+			hasher.update(buffer.data(), n);
+		}
+	}
+	ft_sha256::digest hash = hasher.finish();
+	file.close();
+
+	// a file that changed while it was read is hashed again later
+	std::uint64_t disk_size_after = 0;
+	std::int64_t mtime_after = 0;
+	if (!read || !file_status(path, disk_size_after, mtime_after) || (disk_size_after != disk_size) || (mtime_after != mtime))
+	{
+		enqueue(path, false);
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	slot* target = find_slot(key, true);
+	if (target == nullptr)
+	{
+		return;
+	}
+	// size and mtime go last, a torn write never looks current
+	target->mtime = no_mtime;
+	target->hash = hash;
+	target->size = content_size;
+	target->disk_size = disk_size;
+	target->racy = (hash_time - mtime < racy_window) ? 1 : 0;
+	target->mtime = mtime;
+	m_files_hashed++;
+}
+
+void ft_hash_index::run()
+{
+	auto next_queued = [&](std::string& path, bool wait) -> bool
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		if (wait)
+		{
+			m_condition.wait(lock, [&]() { return !m_running || !m_queue.empty(); });
+		}
+		if (!m_running || m_queue.empty())
+		{
+			return false;
+		}
+		path = std::move(m_queue.front());
+		m_queue.pop_front();
+		m_queued.erase(path);
+		return true;
+	};
+
+	// whatever changed while the server was down, queued files go first
+	std::error_code ec;
+	std::string path;
+	for (std::filesystem::recursive_directory_iterator iter(m_root, std::filesystem::directory_options::skip_permission_denied, ec);
+		!ec && (iter != std::filesystem::recursive_directory_iterator()); iter.increment(ec))
+	{
+		while (next_queued(path, false))
+		{
+			hash_file(path);
+		}
+
+		std::error_code type_ec;
+		std::string key_path = normalize(iter->path().generic_string());
+		if (iter->is_directory(type_ec) && excluded(key_path))
+		{
+			iter.disable_recursion_pending();
+			continue;
+		}
+		if (iter->is_regular_file(type_ec) && !excluded(key_path))
+		{
+			hash_file(key_path);
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_running)
+		{
+			return;
+		}
+	}
+	m_scan_done = true;
+
+	while (next_queued(path, true))
+	{
+		hash_file(path);
+	}
+}
@@ -0,0 +1,344 @@
+#include "ft_log_ingest.hpp"
+#include "ft_posix_io.hpp"
+
+#ifdef __linux__
+
+
+ft_log_ingest::~ft_log_ingest()
+{
+	stop();
+}
+
+void ft_log_ingest::start()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_running)
+	{
+		m_running = true;
+		m_thread = std::thread([&]() { run(); });
+	}
+}
+
+void ft_log_ingest::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_condition.notify_all();
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	std::unordered_map<std::string, std::shared_ptr<log_file>> files;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		files.swap(m_files);
+		for (auto& item : files)
+		{
+			std::lock_guard<std::mutex> file_lock(item.second->mutex);
+			item.second->forgotten = true;
+		}
+	}
+	for (auto& item : files)
+	{
+		flush(item.first, *item.second);
+		std::lock_guard<std::mutex> write_lock(item.second->write_mutex);
+		close_file(*item.second);
+	}
+}
+
+bool ft_log_ingest::append(const std::string& file_name, const char* ptr, std::size_t n)
+{
+	while (true)
+	{
+		std::shared_ptr<log_file> file;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			std::shared_ptr<log_file>& item = m_files[file_name];
+			if (!item)
+			{
+				item = std::make_shared<log_file>();
+				item->buffer.reserve(m_flush_size);
+				item->last_flush_time = std::chrono::steady_clock::now();
+			}
+			file = item;
+		}
+
+		bool full = false;
+		{
+			std::lock_guard<std::mutex> file_lock(file->mutex);
+			if (file->forgotten)
+			{
+				// dropped as idle in the meantime, a fresh entry is made
+				continue;
+			}
+			file->buffer.insert(file->buffer.end(), ptr, ptr + n);
+			file->last_append_time = std::chrono::steady_clock::now();
+			full = (file->buffer.size() >= m_flush_size);
+		}
+		return full ? flush(file_name, *file) : true;
+	}
+}
+
+void ft_log_ingest::flush_all()
+{
+	std::vector<std::pair<std::string, std::shared_ptr<log_file>>> files;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		files.assign(m_files.begin(), m_files.end());
+	}
+	for (auto& item : files)
+	{
+		flush(item.first, *item.second);
+	}
+}
+
+void ft_log_ingest::set_flush_size(std::size_t flush_size) noexcept
+{
+	m_flush_size = (flush_size != 0) ? flush_size : 1;
+}
+
+void ft_log_ingest::set_flush_interval(std::chrono::milliseconds flush_interval) noexcept
+{
+	m_flush_interval = flush_interval;
+}
+
+void ft_log_ingest::set_rotation_size(std::size_t rotation_size) noexcept
+{
+	m_rotation_size = rotation_size;
+}
+
+void ft_log_ingest::set_max_open_files(std::size_t max_open_files) noexcept
+{
+	m_max_open_files = (max_open_files != 0) ? max_open_files : 1;
+}
+
+void ft_log_ingest::set_group_commit(ft_group_commit* group_commit) noexcept
+{
+	m_group_commit = group_commit;
+}
+
+
+void ft_log_ingest::run()
+{
+	std::vector<std::pair<std::string, std::shared_ptr<log_file>>> files;
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (m_running)
+	{
+		m_condition.wait_for(lock, std::max(m_flush_interval / 2, std::chrono::milliseconds(1)), [&]() { return !m_running; });
+		if (!m_running)
+		{
+			return;
+		}
+
+		// written with m_mutex released, appends to other files never wait for a write
+		files.assign(m_files.begin(), m_files.end());
+		lock.unlock();
+
+		// time based flush
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		for (auto& item : files)
+		{
+			bool due = false;
+			{
+				std::lock_guard<std::mutex> file_lock(item.second->mutex);
+				due = !item.second->buffer.empty() && (now - item.second->last_flush_time >= m_flush_interval);
+			}
+			if (due)
+			{
+				flush(item.first, *item.second);
+			}
+		}
+
+		if (m_number_of_open_files > m_max_open_files)
+		{
+			close_least_recently_used_files(files);
+		}
+
+		// files idle for a while are forgotten, only those are kept in files
+		lock.lock();
+		auto last = std::remove_if(files.begin(), files.end(), [&](const std::pair<std::string, std::shared_ptr<log_file>>& item)
+			{
+				std::lock_guard<std::mutex> file_lock(item.second->mutex);
+				if (item.second->buffer.empty() && (now - item.second->last_append_time >= 100 * m_flush_interval))
+				{
+					item.second->forgotten = true;
+					m_files.erase(item.first);
+					return false;
+				}
+				return true;
+			});
+		files.erase(last, files.end());
+		lock.unlock();
+
+		for (auto& item : files)
+		{
+			std::lock_guard<std::mutex> write_lock(item.second->write_mutex);
+			close_file(*item.second);
+		}
+		files.clear();
+		lock.lock();
+	}
+}
+
+bool ft_log_ingest::flush(const std::string& file_name, log_file& file)
+{
+	// the buffers are swapped so that appends go on while the previous content is written
+	std::lock_guard<std::mutex> write_lock(file.write_mutex);
+	{
+		std::lock_guard<std::mutex> file_lock(file.mutex);
+		file.last_flush_time = std::chrono::steady_clock::now();
+		file.write_buffer.swap(file.buffer);
+	}
+	if (file.write_buffer.empty())
+	{
+		return true;
+	}
+
+	if (file.fd < 0)
+	{
+		file.fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+		if (file.fd < 0)
+		{
+			file.write_buffer.clear();
+			return false;
+		}
+		m_number_of_open_files++;
+
+		struct stat file_stat;
+		file.file_size = (::fstat(file.fd, &file_stat) == 0) ? static_cast<std::size_t>(file_stat.st_size) : 0;
+	}
+
+	// size based rotation, the current file is moved aside and a fresh one is started
+	if ((m_rotation_size != 0) && (file.file_size != 0) && (file.file_size + file.write_buffer.size() > m_rotation_size))
+	{
+		if (!rotate(file_name, file))
+		{
+			file.write_buffer.clear();
+			return false;
+		}
+	}
+
+	bool ok = ft_write_all(file.fd, file.write_buffer.data(), file.write_buffer.size());
+	file.file_size += file.write_buffer.size();
+	file.write_buffer.clear();
+
+	if (ok && (m_group_commit != nullptr))
+	{
+		// the commit thread owns the duplicate, the cached handle stays usable
+		int fd = ::dup(file.fd);
+		if (fd >= 0)
+		{
+			m_group_commit->submit(fd);
+		}
+	}
+	return ok;
+}
+
+bool ft_log_ingest::rotate(const std::string& file_name, log_file& file)
+{
+	// called with write_mutex held, link(2) never replaces an existing file, so rotated files
+	// left by an earlier run are skipped rather than overwritten
+	close_file(file);
+	while (true)
+	{
+		std::string rotated_file_name = file_name + '.' + std::to_string(file.next_rotation++);
+		if (::link(file_name.c_str(), rotated_file_name.c_str()) == 0)
+		{
+			::unlink(file_name.c_str());
+			break;
+		}
+		if (errno == EEXIST)
+		{
+			continue;
+		}
+
+		// no hard links on this file system, probed instead
+		if (::access(rotated_file_name.c_str(), F_OK) != 0)
+		{
+			::rename(file_name.c_str(), rotated_file_name.c_str());
+			break;
+		}
+	}
+
+	file.fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (file.fd < 0)
+	{
+		return false;
+	}
+	m_number_of_open_files++;
+
+	struct stat file_stat;
+	file.file_size = (::fstat(file.fd, &file_stat) == 0) ? static_cast<std::size_t>(file_stat.st_size) : 0;
+	return true;
+}
+
+void ft_log_ingest::close_file(log_file& file)
+{
+	// called with write_mutex held
+	if (file.fd >= 0)
+	{
+		::close(file.fd);
+		file.fd = -1;
+		m_number_of_open_files--;
+	}
+}
+
+void ft_log_ingest::close_least_recently_used_files(const std::vector<std::pair<std::string, std::shared_ptr<log_file>>>& files)
+{
+	std::vector<std::pair<std::chrono::steady_clock::time_point, log_file*>> open_files;
+	for (auto& item : files)
+	{
+		std::lock_guard<std::mutex> write_lock(item.second->write_mutex);
+		if (item.second->fd >= 0)
+		{
+			std::lock_guard<std::mutex> file_lock(item.second->mutex);
+			open_files.emplace_back(item.second->last_append_time, item.second.get());
+		}
+	}
+	std::sort(open_files.begin(), open_files.end(),
+		[](const auto& lhs, const auto& rhs) { return lhs.first < rhs.first; });
+
+	std::size_t number_to_close = (open_files.size() > m_max_open_files) ? open_files.size() - m_max_open_files : 0;
+	for (std::size_t n = 0; n < number_to_close; n++)
+	{
+		// buffered bytes stay in memory, the handle is reopened on the next flush
+		std::lock_guard<std::mutex> write_lock(open_files[n].second->write_mutex);
+		close_file(*open_files[n].second);
+	}
+}
+
+#else
+
+// no cached handles, every append is written through at once
+
+ft_log_ingest::~ft_log_ingest() {}
+
+void ft_log_ingest::start() {}
+
+void ft_log_ingest::stop() {}
+
+bool ft_log_ingest::append(const std::string& file_name, const char* ptr, std::size_t n)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::ofstream file(file_name, std::ios::binary | std::ios::app);
+	file.write(ptr, static_cast<std::streamsize>(n));
+	return static_cast<bool>(file);
+}
+
+void ft_log_ingest::flush_all() {}
+
+void ft_log_ingest::set_flush_size(std::size_t flush_size) noexcept { m_flush_size = (flush_size != 0) ? flush_size : 1; }
+
+void ft_log_ingest::set_flush_interval(std::chrono::milliseconds flush_interval) noexcept { m_flush_interval = flush_interval; }
+
+void ft_log_ingest::set_rotation_size(std::size_t rotation_size) noexcept { m_rotation_size = rotation_size; }
+
+void ft_log_ingest::set_max_open_files(std::size_t max_open_files) noexcept { m_max_open_files = (max_open_files != 0) ? max_open_files : 1; }
+
+void ft_log_ingest::set_group_commit(ft_group_commit* group_commit) noexcept { m_group_commit = group_commit; }
+
+#endif // __linux__
@@ -0,0 +1,153 @@
+#include "ft_mapped_file.hpp"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // __linux__
+
+
+ft_mapped_file::~ft_mapped_file()
+{
+	close();
+}
+
+bool ft_mapped_file::open(const std::string& file_name, bool map)
+{
+	close();
+
+#ifdef __linux__
+	m_fd = ::open(file_name.c_str(), O_RDONLY | O_CLOEXEC);
+	if (m_fd < 0)
+	{
+		return false;
+	}
+
+	struct stat file_stat;
+	if (::fstat(m_fd, &file_stat) != 0)
+	{
+		close();
+		return false;
+	}
+	m_size = static_cast<std::size_t>(file_stat.st_size);
+
+	if (map && (m_size != 0))
+	{
+		void* ptr = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+		if (ptr == MAP_FAILED)
+		{
+			close();
+			return false;
+		}
+		m_data = static_cast<const char*>(ptr);
+
+		// read once front to back, let the kernel read ahead aggressively
+		::madvise(ptr, m_size, MADV_SEQUENTIAL);
+		::posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	}
+#else
+	std::ifstream file(file_name, std::ios::binary | std::ios::ate);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	std::streamsize file_size = file.tellg();
+	file.seekg(0, std::ios::beg);
+	m_fallback_buffer.resize(static_cast<std::size_t>(file_size));
+	if (!file.read(m_fallback_buffer.data(), file_size))
+	{
+		close();
+		return false;
+	}
+	m_data = m_fallback_buffer.data();
+	m_size = m_fallback_buffer.size();
+#endif // __linux__
+
+	m_open = true;
+	return true;
+}
+
+void ft_mapped_file::close() noexcept
+{
+#ifdef __linux__
+	if (m_data != nullptr)
+	{
+		::munmap(const_cast<char*>(m_data), m_size);
+	}
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+		m_fd = -1;
+	}
+#else
+	m_fallback_buffer.clear();
+	m_fallback_buffer.shrink_to_fit();
+#endif // __linux__
+
+	m_data = nullptr;
+	m_size = 0;
+	m_open = false;
+}
+
+bool ft_mapped_file::read_at(std::uint64_t offset, char* ptr, std::size_t n) const noexcept
+{
+#ifdef __linux__
+	while (n != 0)
+	{
+		ssize_t result = ::pread(m_fd, ptr, n, static_cast<off_t>(offset));
+		if (result <= 0)
+		{
+			if ((result < 0) && (errno == EINTR)) { continue; }
+			return false;
+		}
+		ptr += result;
+		offset += static_cast<std::uint64_t>(result);
+		n -= static_cast<std::size_t>(result);
+	}
+	return true;
+#else
+	if ((offset > m_size) || (n > m_size - offset))
+	{
+		return false;
+	}
+	std::memcpy(ptr, m_data + offset, n);
+	return true;
+#endif // __linux__
+}
+
+void ft_mapped_file::will_need(std::size_t offset, std::size_t n) const noexcept
+{
+#ifdef __linux__
+	if ((m_fd >= 0) && (offset < m_size))
+	{
+		n = std::min(n, m_size - offset);
+		::posix_fadvise(m_fd, static_cast<off_t>(offset), static_cast<off_t>(n), POSIX_FADV_WILLNEED);
+	}
+#endif // __linux__
+}
+
+void ft_mapped_file::release(std::size_t offset, std::size_t n) const noexcept
+{
+#ifdef __linux__
+	if ((m_data != nullptr) && (offset < m_size))
+	{
+		// madvise wants a page aligned start, only whole pages inside the range are dropped
+		const std::size_t page_size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+		std::size_t begin = ((offset + page_size - 1) / page_size) * page_size;
+		std::size_t end = std::min(offset + n, m_size);
+		if (end == m_size)
+		{
+			end = ((end + page_size - 1) / page_size) * page_size;
+		}
+		else
+		{
+			end = (end / page_size) * page_size;
+		}
+		if (begin < end)
+		{
+			::madvise(const_cast<char*>(m_data) + begin, end - begin, MADV_DONTNEED);
+		}
+	}
+#endif // __linux__
+}
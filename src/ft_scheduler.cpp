@@ -0,0 +1,176 @@
+#include "ft_scheduler.hpp"
+
+
+ft_scheduler::~ft_scheduler()
+{
+	stop();
+}
+
+void ft_scheduler::start(std::size_t number_of_threads)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_running)
+	{
+		m_running = true;
+		for (std::size_t n = 0; n < std::max<std::size_t>(number_of_threads, 1); n++)
+		{
+			m_threads.emplace_back([&]() { run(); });
+		}
+	}
+}
+
+void ft_scheduler::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_running = false;
+	}
+	m_condition.notify_all();
+	for (std::thread& thread : m_threads)
+	{
+		if (thread.joinable())
+		{
+			thread.join();
+		}
+	}
+	m_threads.clear();
+
+	std::unordered_map<flow_id, flow> dropped;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		dropped.swap(m_flows);
+		m_ready.clear();
+	}
+}
+
+void ft_scheduler::set_quantum(std::size_t bytes) noexcept
+{
+	m_quantum = (bytes != 0) ? bytes : 1;
+}
+
+std::size_t ft_scheduler::quantum() const noexcept
+{
+	return m_quantum;
+}
+
+void ft_scheduler::submit(flow_id id, std::uint32_t weight, step_function step, std::function<void()> on_done)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::pair<std::unordered_map<flow_id, flow>::iterator, bool> inserted = m_flows.try_emplace(id);
+		flow& target = inserted.first->second;
+		target.weight = (weight != 0) ? weight : 1;
+		target.jobs.push_back(job{ std::move(step), std::move(on_done) });
+		if (!inserted.second)
+		{
+			// already queued, running or parked, the job waits its turn in the flow
+			return;
+		}
+		m_ready.push_back(id);
+	}
+	m_condition.notify_one();
+}
+
+void ft_scheduler::resume(flow_id id)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unordered_map<flow_id, flow>::iterator iter = m_flows.find(id);
+		if (iter == m_flows.end())
+		{
+			return;
+		}
+		if (iter->second.state == flow_state::running)
+		{
+			iter->second.woken = true;
+			return;
+		}
+		if (iter->second.state != flow_state::parked)
+		{
+			return;
+		}
+		iter->second.state = flow_state::queued;
+		m_ready.push_back(id);
+	}
+	m_condition.notify_one();
+}
+
+std::uint64_t ft_scheduler::number_of_steps() const noexcept
+{
+	return m_steps.load();
+}
+
+
+void ft_scheduler::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true)
+	{
+		m_condition.wait(lock, [&]() { return !m_running || !m_ready.empty(); });
+		if (!m_running)
+		{
+			return;
+		}
+
+		flow_id id = m_ready.front();
+		m_ready.pop_front();
+		flow& current = m_flows[id];
+
+		// a new turn : the flow spent its credit the last time it ran
+		if (current.deficit <= 0)
+		{
+			current.deficit += static_cast<std::int64_t>(m_quantum) * current.weight;
+		}
+		current.state = flow_state::running;
+		current.woken = false;
+		job& front = current.jobs.front();
+
+		lock.unlock();
+		std::size_t cost = 0;
+		step_result result = front.step(cost);
+		m_steps++;
+		lock.lock();
+
+		current.deficit -= static_cast<std::int64_t>(cost);
+		std::list<job> finished; // destroyed without the lock, a job may hold resources whose release needs resume
+		if (result == step_result::done)
+		{
+			finished.splice(finished.begin(), current.jobs, current.jobs.begin());
+		}
+
+		if ((result == step_result::wait) && !current.woken)
+		{
+			current.state = flow_state::parked;
+		}
+		else if (current.jobs.empty())
+		{
+			// an idle flow keeps no credit
+			m_flows.erase(id);
+		}
+		else
+		{
+			// the flow keeps the thread while it has credit left, otherwise the next flow gets a turn
+			current.state = flow_state::queued;
+			if (current.deficit > 0)
+			{
+				m_ready.push_front(id);
+			}
+			else
+			{
+				m_ready.push_back(id);
+			}
+			m_condition.notify_one();
+		}
+
+		if (!finished.empty())
+		{
+			lock.unlock();
+			if (finished.front().on_done)
+			{
+				finished.front().on_done();
+			}
+			finished.clear();
+			lock.lock();
+		}
+	}
+}
@@ -1,4 +1,11 @@
 #include "ft_server.hpp"
+#include "ft_posix_io.hpp"
+#include "ft_mapped_file.hpp"
+#include "ft_socket_options.hpp"
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif // __linux__
 
 
 ft_server::~ft_server()
@@ -41,6 +48,56 @@ bool ft_server::start(std::uint16_t port, std::size_t number_of_threads)
 				);
 			}
 			m_running = true;
+			m_group_commit.start();
+#ifdef __linux__
+			if (m_log_ingest_enabled)
+			{
+				m_log_ingest.set_group_commit(m_durable_writes ? &m_group_commit : nullptr);
+				m_log_ingest.start();
+			}
+#endif // __linux__
+			if (m_chunk_store_enabled && !m_chunk_store.open(m_chunk_store_path, m_group_commit, m_durable_writes))
+			{
+				m_chunk_store_enabled = false;
+			}
+			if (m_hash_index_enabled)
+			{
+				// stored files are hashed as the content their manifest stands for, the chunks themselves are left out
+				std::vector<std::string> excluded;
+				if (m_chunk_store_enabled)
+				{
+					excluded.push_back(m_chunk_store_path);
+				}
+				m_hash_index.set_content_function(std::string(ft_chunker::manifest_magic, 8),
+					[this](const char* ptr, std::size_t n, ft_sha256& hasher, std::uint64_t& content_size)
+					{
+						ft_chunk_store::content_reader reader;
+						if (!m_chunk_store_enabled || !m_chunk_store.open_content(ptr, n, reader))
+						{
+							return false;
+						}
+						std::vector<char> chunk;
+						content_size = reader.size;
+						do
+						{
+							if (!m_chunk_store.read_content(reader, chunk))
+							{
+								return false;
+							}
+							hasher.update(chunk.data(), chunk.size());
+						} while (!chunk.empty());
+						return true;
+					}
+				);
+				m_hash_index_enabled = m_hash_index.open(m_hash_index_path, m_hash_index_root, std::move(excluded));
+				m_hash_index.start();
+			}
+			m_scheduler.start(m_scheduler_threads);
+			m_archive_producers_running = true;
+			for (std::size_t n = 0; n < m_archive_producers; n++)
+			{
+				m_archive_producer_threads.emplace_back([this]() { run_archive_producer(); });
+			}
 			listen();
 			return true;
 		}
@@ -61,6 +118,24 @@ bool ft_server::start(std::uint16_t port, std::size_t number_of_threads)
 
 void ft_server::stop()
 {
+	m_watcher.stop();
+	m_scheduler.stop();
+	{
+		// the transfers dropped with the scheduler flows cancel the archives still being made
+		std::lock_guard<std::mutex> lock(m_archive_jobs_mutex);
+		m_archive_producers_running = false;
+		m_archive_jobs.clear();
+	}
+	m_archive_jobs_condition.notify_all();
+	for (std::thread& producer : m_archive_producer_threads)
+	{
+		if (producer.joinable())
+		{
+			producer.join();
+		}
+	}
+	m_archive_producer_threads.clear();
+	m_hash_index.stop();
 	m_asio_context.stop();
 	for (std::size_t n = 0; n < m_threads.size(); n++)
 	{
@@ -74,6 +149,10 @@ void ft_server::stop()
 	{
 		delete m_asio_acceptor;
 	}
+#ifdef __linux__
+	m_log_ingest.stop();
+#endif // __linux__
+	m_group_commit.stop();
 	m_running = false;
 }
 
@@ -111,12 +190,13 @@ void ft_server::broadcast(const void* const ptr, std::size_t n)
 
 void ft_server::disconnect_all_clients()
 {
+	// pending reads fail and each connection removes itself
 	std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
 	for (std::list<client_connection>::iterator iter = m_clients.begin(); iter != m_clients.end(); ++iter)
 	{
-		iter->socket.close();
+		asio::error_code ec;
+		iter->socket.close(ec);
 	}
-	m_clients.clear();
 }
 
 void ft_server::set_validation_function(std::function<std::int32_t(std::int32_t)> fn)
@@ -134,265 +214,2107 @@ void ft_server::set_buffer_size(std::size_t new_size) noexcept
 	m_buffer_size = new_size;
 }
 
+void ft_server::set_session_lifetime(std::chrono::seconds lifetime) noexcept
+{
+	m_session_lifetime = lifetime;
+}
 
-void ft_server::listen()
+void ft_server::set_max_request_size(std::uint64_t new_size) noexcept
 {
-	m_asio_acceptor->async_accept(
-		[&](std::error_code ec, asio::ip::tcp::socket new_client_connection)
-		{
-			if (!ec)
-			{
-				new_client_connection.set_option(asio::socket_base::keep_alive(true));
+	m_max_request_size = new_size;
+}
 
-				client_connection* client_connection_ptr;
+void ft_server::set_upload_piece_size(std::size_t piece_size) noexcept
+{
+	m_upload_piece_size = (piece_size != 0) ? piece_size : 1;
+}
 
-				{
-					std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
-					m_clients.push_back(client_connection(new_client_connection));
-					std::list<client_connection>::iterator temp = --m_clients.end();
-					client_connection_ptr = &(*temp);
-					temp->iterator = std::move(temp);
-				}
+void ft_server::enable_durable_writes(bool enable) noexcept
+{
+	m_durable_writes = enable;
+}
 
-				if (m_client_validation_enabled)
-				{
-					m_asio_context.post([&]() { handle_client_validation(*client_connection_ptr); });
-				}
-				else
-				{
-					client_connection_ptr->buffer.resize(m_buffer_size);
-					handle_client_request(*client_connection_ptr);
-				}
-			}
+void ft_server::set_sync_latency(std::chrono::microseconds latency)
+{
+	m_group_commit.set_latency_bound(latency);
+}
 
-			listen();
-		}
-	);
+void ft_server::enable_log_ingest(bool enable) noexcept
+{
+	m_log_ingest_enabled = enable;
 }
 
-void ft_server::handle_client_validation(client_connection& client_socket)
+void ft_server::enable_chunk_store(const std::string& store_path)
 {
-	std::int32_t random_number = rng(mt);
-	std::int32_t answer_number;
+	m_chunk_store_path = store_path;
+	m_chunk_store_enabled = !store_path.empty();
+}
 
-	client_socket.socket.write_some(asio::buffer(&random_number, sizeof(std::int32_t)), m_error_code);
+void ft_server::enable_hash_index(const std::string& index_path, const std::string& root)
+{
+	m_hash_index_path = index_path;
+	m_hash_index_root = root;
+	m_hash_index_enabled = !index_path.empty();
+}
 
-	client_socket.socket.async_read_some(asio::buffer(&answer_number, sizeof(std::int32_t)),
-		[&](std::error_code ec, std::size_t incoming_buffer_length)
-		{
-			if ((!ec) && (answer_number == m_validation_function(random_number)))
-			{
-				client_socket.buffer.resize(m_buffer_size);
-				handle_client_request(client_socket);
-			}
-			else
-			{
-				client_socket.socket.close();
+void ft_server::enable_low_latency(bool enable, int busy_poll_us) noexcept
+{
+	m_low_latency = enable;
+	m_busy_poll_us = busy_poll_us;
+}
 
-				{
-					std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
-					m_clients.erase(client_socket.iterator);
-				}
-			}
-		}
-	);
+#ifdef FT_ENABLE_TLS
+bool ft_server::enable_tls(const std::string& certificate_file, const std::string& private_key_file)
+{
+	m_tls_enabled = m_tls_context.init_server(certificate_file, private_key_file);
+	return m_tls_enabled;
 }
+#endif // FT_ENABLE_TLS
 
-void ft_server::handle_client_request(client_connection& client_socket)
+void ft_server::set_watch_interval(std::chrono::milliseconds interval) noexcept
 {
-	client_socket.socket.async_read_some(asio::buffer(client_socket.buffer.data(), client_socket.buffer.size()),
-		[&](std::error_code ec, std::size_t incoming_buffer_length)
-		{
-			if (!ec)
-			{
-				if (incoming_buffer_length >= 8)
-				{
-					std::string_view str_view(client_socket.buffer.data(), 8);
-
-					if (str_view.compare(0, 4, "ping") == 0) { ping_subroutine(client_socket); }
-					else if (str_view.compare(0, 4, "send") == 0) { send_subroutine(client_socket, incoming_buffer_length); }
-					else if (str_view.compare(0, 4, "app ") == 0) { app_subroutine(client_socket, incoming_buffer_length); }
-					else if (str_view.compare(0, 4, "get ") == 0) { get_subroutine(client_socket, incoming_buffer_length); }
-					else if (str_view.compare(0, 4, "list") == 0) { list_subroutine(client_socket, incoming_buffer_length); }
-					else if (str_view.compare(0, 4, "lsfp") == 0) { lsfp_subroutine(client_socket, incoming_buffer_length); }
-					else if (str_view.compare(0, 4, "rem ") == 0) { rem_subroutine(client_socket, incoming_buffer_length); }
-					else if (str_view.compare(0, 4, "chck") == 0) { chck_subroutine(client_socket, incoming_buffer_length); }
-				}
+	m_watcher.set_interval(interval);
+}
 
-				handle_client_request(client_socket);
-			}
-			else
-			{
-				client_socket.socket.close();
+void ft_server::set_watch_send_timeout(std::chrono::milliseconds timeout) noexcept
+{
+	m_watch_send_timeout = timeout;
+}
 
-				{
-					std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
-					m_clients.erase(client_socket.iterator);
-				}
-			}
-		}
-	);
+void ft_server::set_swarm_piece_size(std::uint32_t piece_size) noexcept
+{
+	m_swarm_piece_size = (piece_size != 0) ? piece_size : 1;
 }
 
-void ft_server::ping_subroutine(client_connection& client_socket)
+void ft_server::set_archive_readahead(std::size_t files, std::size_t bytes, std::size_t number_of_threads) noexcept
 {
-	char c = 'p';
+	m_archive_readahead_files = files;
+	m_archive_readahead_bytes = bytes;
+	m_archive_threads = number_of_threads;
+}
+
+void ft_server::set_archive_compression_level(int level) noexcept
+{
+	m_archive_compression_level = std::clamp(level, 0, 9);
+}
+
+void ft_server::set_archive_producers(std::size_t number_of_producers) noexcept
+{
+	m_archive_producers = (number_of_producers != 0) ? number_of_producers : 1;
+}
+
+void ft_server::set_scheduler_threads(std::size_t number_of_threads) noexcept
+{
+	m_scheduler_threads = (number_of_threads != 0) ? number_of_threads : 1;
+}
+
+void ft_server::set_scheduler_quantum(std::size_t bytes) noexcept
+{
+	m_scheduler.set_quantum(bytes);
+}
+
+void ft_server::set_weight_function(std::function<std::uint32_t(const asio::ip::tcp::endpoint&)> fn)
+{
+	m_weight_function = std::move(fn);
+}
 
-	if (client_socket.socket.is_open())
+void ft_server::set_request_class(std::uint32_t opcode, request_class new_class)
+{
+	if (new_class == request_class::bulk)
 	{
-		client_socket.socket.write_some(asio::buffer(&c, 1), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		m_bulk_opcodes.insert(opcode);
 	}
 	else
 	{
-		std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
-		m_clients.erase(client_socket.iterator);
+		m_bulk_opcodes.erase(opcode);
 	}
 }
 
-void ft_server::send_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length)
+void ft_server::register_command(std::uint32_t opcode, command_handler handler)
 {
-	std::size_t file_name_size = static_cast<std::size_t>(*reinterpret_cast<std::uint32_t*>(&client_socket.buffer[4]));
-	std::string file_name(file_name_size, 0);
-	std::memcpy(&file_name[0], &client_socket.buffer[4 * sizeof(char) + sizeof(std::uint32_t)], file_name_size * sizeof(char));
-
-	std::fstream file(file_name, std::ios::out | std::ios::binary);
-	file.write(client_socket.buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t) + file_name_size, incoming_buffer_length
-		- (4 * sizeof(char) + sizeof(std::uint32_t) + file_name_size));
-	file.close();
+	m_custom_commands[opcode] = std::move(handler);
 }
 
-void ft_server::app_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length)
+void ft_server::write_response(client_connection& client_socket, const void* const ptr, std::size_t n)
 {
-	std::size_t file_name_size = static_cast<std::size_t>(*reinterpret_cast<std::uint32_t*>(&client_socket.buffer[4]));
-	std::string file_name(file_name_size, 0);
-	std::memcpy(&file_name[0], &client_socket.buffer[4 * sizeof(char) + sizeof(std::uint32_t)], file_name_size * sizeof(char));
+	// watch pushes come from another thread
+	std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+	if (client_socket.coalesce && (client_socket.output.size() + n <= m_coalesce_limit))
+	{
+		const char* char_ptr = static_cast<const char*>(ptr);
+		client_socket.output.insert(client_socket.output.end(), char_ptr, char_ptr + n);
+		return;
+	}
+	write_buffers(client_socket, std::array<asio::const_buffer, 1>{ asio::buffer(ptr, n) });
+}
 
-	std::fstream file(file_name, std::ios::app);
-	file.write(client_socket.buffer.data() + 4 * sizeof(char) + sizeof(std::uint32_t) + file_name_size, incoming_buffer_length
-		- (4 * sizeof(char) + sizeof(std::uint32_t) + file_name_size));
-	file.close();
+void ft_server::write_sized_response(client_connection& client_socket, const void* const ptr, std::uint64_t n)
+{
+	std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+	std::size_t data_size = (n != ft_protocol::no_content) ? static_cast<std::size_t>(n) : 0;
+	if (client_socket.coalesce && (client_socket.output.size() + sizeof(std::uint64_t) + data_size <= m_coalesce_limit))
+	{
+		const char* size_ptr = reinterpret_cast<const char*>(&n);
+		const char* char_ptr = static_cast<const char*>(ptr);
+		client_socket.output.insert(client_socket.output.end(), size_ptr, size_ptr + sizeof(std::uint64_t));
+		client_socket.output.insert(client_socket.output.end(), char_ptr, char_ptr + data_size);
+		return;
+	}
+	write_buffers(client_socket, std::array<asio::const_buffer, 2>{ asio::buffer(&n, sizeof(std::uint64_t)), asio::buffer(ptr, data_size) });
 }
 
-void ft_server::get_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length)
+void ft_server::flush_output(client_connection& client_socket)
 {
-	std::size_t file_name_size = static_cast<std::size_t>(*reinterpret_cast<std::uint32_t*>(&client_socket.buffer[4]));
-	std::string file_name(file_name_size, 0);
-	std::memcpy(&file_name[0], &client_socket.buffer[4 * sizeof(char) + sizeof(std::uint32_t)], file_name_size * sizeof(char));
+	std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+	write_buffers(client_socket, std::array<asio::const_buffer, 0>{});
+}
 
-	std::ifstream file(file_name, std::ios::binary | std::ios::ate);
-	std::streamsize file_size = file.tellg();
-	file.seekg(0, std::ios::beg);
-	std::vector<char> buffer(file_size);
+template <std::size_t N>
+void ft_server::write_buffers(client_connection& client_socket, const std::array<asio::const_buffer, N>& buffers)
+{
+	// held back answers go first, in the same gather write
+	std::array<asio::const_buffer, N + 1> all_buffers;
+	all_buffers[0] = asio::buffer(client_socket.output);
+	std::copy(buffers.begin(), buffers.end(), all_buffers.begin() + 1);
 
-	// copy file
-	if (file.read(buffer.data(), file_size))
+	if (client_socket.socket.is_open() && (asio::buffer_size(all_buffers) != 0))
 	{
-		if (client_socket.socket.is_open())
-		{
-			client_socket.socket.write_some(asio::buffer(buffer.data(), buffer.size()), m_error_code);
-			std::this_thread::sleep_for(std::chrono::microseconds(1));
-		}
-		else
+		asio::error_code ec;
+		ft_stream_write(client_socket.socket, client_socket.tls.get(), all_buffers, ec);
+		if (ec)
 		{
-			std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
-			m_clients.erase(client_socket.iterator);
+			// the pending read fails and removes the client
+			client_socket.socket.close(ec);
 		}
 	}
+	client_socket.output.clear();
 }
 
-void ft_server::list_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length)
+void ft_server::write_file_response(client_connection& client_socket, const std::shared_ptr<ft_mapped_file>& file, std::uint64_t offset, std::uint64_t n)
 {
-	std::string files("");
+	if (client_socket.scheduled)
 	{
-		std::filesystem::directory_iterator file_list(std::filesystem::current_path());
-		for (const std::filesystem::directory_entry& item : file_list)
+		std::shared_ptr<transfer> new_transfer = std::make_shared<transfer>();
+		new_transfer->head.resize(sizeof(std::uint64_t));
+		std::memcpy(new_transfer->head.data(), &n, sizeof(std::uint64_t));
+		new_transfer->file = file;
+		new_transfer->start = offset;
+		new_transfer->size = n;
+		start_transfer(client_socket, std::move(new_transfer));
+		return;
+	}
+
+#ifdef __linux__
+	// the size goes out with any held back answers, then the kernel copies the file to the socket by itself,
+	// encrypting it on the way when TLS is offloaded
+	std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+	write_buffers(client_socket, std::array<asio::const_buffer, 1>{ asio::buffer(&n, sizeof(std::uint64_t)) });
+
+#ifdef FT_ENABLE_TLS
+	ft_tls_session* tls = client_socket.tls.get();
+	if ((tls != nullptr) && !tls->ktls_send)
+	{
+		// encrypted in user space, read block by block : a file truncated meanwhile ends the connection
+		std::vector<char> block(static_cast<std::size_t>(std::min<std::uint64_t>(n, m_scheduler.quantum())));
+		for (std::uint64_t end = offset + n; client_socket.socket.is_open() && (offset < end);)
 		{
-			std::string temp = item.path().generic_string();
-			files += temp;
-			if (std::filesystem::is_directory(temp))
+			std::size_t block_size = static_cast<std::size_t>(std::min<std::uint64_t>(end - offset, block.size()));
+			asio::error_code ec;
+			if (!file->read_at(offset, block.data(), block_size))
 			{
-				files += '/';
+				client_socket.socket.close(ec);
+				break;
 			}
-			files += ';';
+			ft_stream_write(client_socket.socket, tls, asio::buffer(block.data(), block_size), ec);
+			if (ec)
+			{
+				client_socket.socket.close(ec);
+			}
+			offset += block_size;
 		}
+		return;
 	}
-	if (files.size() != 0)
+#endif // FT_ENABLE_TLS
+
+	std::uint64_t end = offset + n;
+	while (client_socket.socket.is_open() && (offset < end))
 	{
-		files.pop_back();
+		std::size_t sent = 0;
+		bool again = false;
+#ifdef FT_ENABLE_TLS
+		if (tls != nullptr)
+		{
+			ft_tls_session::status status = tls->sendfile(file->native_handle(), offset, static_cast<std::size_t>(end - offset), sent);
+			again = (status == ft_tls_session::status::want_write);
+			if ((status == ft_tls_session::status::failed) || (status == ft_tls_session::status::want_read))
+			{
+				sent = 0;
+			}
+		}
+		else
+#endif // FT_ENABLE_TLS
+		{
+			off_t file_offset = static_cast<off_t>(offset);
+			ssize_t result = ::sendfile(client_socket.socket.native_handle(), file->native_handle(), &file_offset, static_cast<std::size_t>(end - offset));
+			again = (result < 0) && ((errno == EAGAIN) || (errno == EINTR));
+			sent = (result > 0) ? static_cast<std::size_t>(result) : 0;
+		}
+
+		asio::error_code ec;
+		if (sent != 0)
+		{
+			offset += sent;
+		}
+		else if (!again || (client_socket.socket.wait(asio::socket_base::wait_write, ec), ec))
+		{
+			client_socket.socket.close(ec);
+		}
 	}
+#else
+	write_sized_response(client_socket, file->data() + offset, n);
+#endif // __linux__
+}
 
-	if (client_socket.socket.is_open())
+void ft_server::write_stream_response(client_connection& client_socket, std::uint64_t n, std::function<bool(std::vector<char>&)> source)
+{
+	if (client_socket.scheduled)
 	{
-		client_socket.socket.write_some(asio::buffer(files.data(), files.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		std::shared_ptr<transfer> new_transfer = std::make_shared<transfer>();
+		new_transfer->head.resize(sizeof(std::uint64_t));
+		std::memcpy(new_transfer->head.data(), &n, sizeof(std::uint64_t));
+		new_transfer->source = std::move(source);
+		start_transfer(client_socket, std::move(new_transfer));
+		return;
 	}
-	else
+
+	std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+	write_buffers(client_socket, std::array<asio::const_buffer, 1>{ asio::buffer(&n, sizeof(std::uint64_t)) });
+	std::vector<char> chunk;
+	std::uint64_t sent = 0;
+	while (client_socket.socket.is_open())
 	{
-		std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
-		m_clients.erase(client_socket.iterator);
+		if (!source(chunk))
+		{
+			break;
+		}
+		if (chunk.empty())
+		{
+			return;
+		}
+		sent += chunk.size();
+		write_buffers(client_socket, std::array<asio::const_buffer, 1>{ asio::buffer(chunk) });
 	}
+
+	// a truncated answer cannot be told apart from a complete one, the connection goes instead
+	asio::error_code ec;
+	client_socket.socket.close(ec);
 }
 
-void ft_server::lsfp_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length)
+std::function<void(bool)> ft_server::track_commit(client_connection& client_socket, std::function<void()> on_committed)
 {
-	std::size_t path_name_size = static_cast<std::size_t>(*reinterpret_cast<std::uint32_t*>(&client_socket.buffer[4]));
-	std::string path_name(path_name_size, 0);
-	std::memcpy(&path_name[0], &client_socket.buffer[4 * sizeof(char) + sizeof(std::uint32_t)], path_name_size * sizeof(char));
-	
-	std::string files("");
+	std::shared_ptr<commit_tracker> commits = client_socket.commits;
 	{
-		std::filesystem::directory_iterator file_list(path_name);
-		for (const std::filesystem::directory_entry& item : file_list)
+		std::lock_guard<std::mutex> lock(commits->mutex);
+		commits->pending++;
+	}
+
+	// called from the group commit thread, possibly after the connection is gone
+	return [commits, on_committed = std::move(on_committed)](bool committed)
+	{
+		if (committed && on_committed)
 		{
-			files += item.path().generic_string();
-			files += ';';
+			on_committed();
+		}
+
+		std::vector<std::function<void(bool)>> waiters;
+		bool success;
+		{
+			std::lock_guard<std::mutex> lock(commits->mutex);
+			commits->failed = commits->failed || !committed;
+			if (--commits->pending != 0)
+			{
+				return;
+			}
+			success = !commits->failed;
+			waiters.swap(commits->waiters);
+			if (!waiters.empty())
+			{
+				commits->failed = false;
+			}
 		}
+		commits->condition.notify_all();
+		for (std::function<void(bool)>& waiter : waiters)
+		{
+			waiter(success);
+		}
+	};
+}
+
+bool ft_server::write_archive(const std::string& path, bool gzip, const std::function<bool(const void*, std::uint64_t)>& output)
+{
+	ft_tar_writer writer;
+	writer.set_readahead(m_archive_readahead_files, m_archive_readahead_bytes, m_archive_threads);
+	if (m_chunk_store_enabled)
+	{
+		// stored files go into the archive as the content their manifest stands for, the chunks themselves are left out
+		writer.set_excluded({ m_chunk_store_path });
+		writer.set_content_function(std::string(ft_chunker::manifest_magic, 8),
+			[this](const std::vector<char>& stored, std::uint64_t& size, ft_tar_writer::content_source& source)
+			{
+				std::shared_ptr<ft_chunk_store::content_reader> reader = std::make_shared<ft_chunk_store::content_reader>();
+				if (!m_chunk_store.open_content(stored.data(), stored.size(), *reader))
+				{
+					return false;
+				}
+				size = reader->size;
+				source = [this, reader](std::vector<char>& chunk) { return m_chunk_store.read_content(*reader, chunk); };
+				return true;
+			}
+		);
 	}
-	if (files.size() != 0)
+	if (!writer.open([&](const char* ptr, std::size_t n) { return output(ptr, n); }, gzip ? m_archive_compression_level : 0))
 	{
-		files.pop_back();
+		return output(nullptr, ft_protocol::no_content);
 	}
 
-	if (client_socket.socket.is_open())
+	// the client learns the format before the first byte of archive
+	char format = writer.compressed() ? 'g' : 't';
+	return output(&format, 1) && writer.write_directory(path) && output(nullptr, 0);
+}
+
+bool ft_server::request_pending(client_connection& client_socket)
+{
+	// only a request that is already whole in the socket buffer is worth holding answers back for,
+	// the socket cannot tell that when OpenSSL decrypts
+#ifdef FT_ENABLE_TLS
+	if ((client_socket.tls != nullptr) && !client_socket.tls->ktls_recv)
 	{
-		client_socket.socket.write_some(asio::buffer(files.data(), files.size()), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		return false;
 	}
-	else
+#endif // FT_ENABLE_TLS
+	asio::error_code ec;
+	std::size_t available = client_socket.socket.available(ec);
+	if (ec || (available < ft_protocol::request_header_size))
 	{
-		std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
-		m_clients.erase(client_socket.iterator);
+		return false;
 	}
+	char header[ft_protocol::request_header_size];
+	client_socket.socket.receive(asio::buffer(header, sizeof(header)), asio::socket_base::message_peek, ec);
+	if (ec)
+	{
+		return false;
+	}
+	ft_protocol::request_header next = ft_protocol::decode_request_header(header);
+	return (next.payload_size <= m_coalesce_limit) && (available >= ft_protocol::request_header_size + next.name_size + next.payload_size);
 }
 
-void ft_server::rem_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length)
+
+void ft_server::listen()
 {
-	std::size_t file_name_size = static_cast<std::size_t>(*reinterpret_cast<std::uint32_t*>(&client_socket.buffer[4]));
-	std::string file_name(file_name_size, 0);
-	std::memcpy(&file_name[0], &client_socket.buffer[4 * sizeof(char) + sizeof(std::uint32_t)], file_name_size * sizeof(char));
+	m_asio_acceptor->async_accept(
+		[&](std::error_code ec, asio::ip::tcp::socket new_client_connection)
+		{
+			if (!ec)
+			{
+				ft_set_socket_options(new_client_connection, m_low_latency, m_busy_poll_us);
+				asio::error_code endpoint_ec;
+				asio::ip::tcp::endpoint remote = new_client_connection.remote_endpoint(endpoint_ec);
+				std::uint32_t weight = endpoint_ec ? 1 : m_weight_function(remote);
 
-	std::filesystem::remove(file_name);
-}
+				client_connection* client_connection_ptr;
 
-void ft_server::chck_subroutine(client_connection& client_socket, std::size_t incoming_buffer_length)
-{
-	std::size_t file_name_size = static_cast<std::size_t>(*reinterpret_cast<std::uint32_t*>(&client_socket.buffer[4]));
-	std::string file_name(file_name_size, 0);
-	std::memcpy(&file_name[0], &client_socket.buffer[4 * sizeof(char) + sizeof(std::uint32_t)], file_name_size * sizeof(char));
+				{
+					std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
+					m_clients.push_back(client_connection(new_client_connection));
+					std::list<client_connection>::iterator temp = --m_clients.end();
+					client_connection_ptr = &(*temp);
+					client_connection_ptr->weight = (weight != 0) ? weight : 1;
+					temp->iterator = std::move(temp);
+				}
 
-	char c;
-	if (std::filesystem::exists(file_name)) { c = 'y'; }
-	else { c = 'n'; }
+#ifdef FT_ENABLE_TLS
+				if (m_tls_enabled)
+				{
+					// the handshake must not block an io thread, it is driven by readiness waits
+					asio::error_code ec;
+					client_connection_ptr->socket.native_non_blocking(true, ec);
+					client_connection_ptr->tls = std::make_shared<ft_tls_session>(m_tls_context.native_handle(),
+						client_connection_ptr->socket.native_handle(), true, std::string());
+					m_asio_context.post([this, client_connection_ptr]() { handle_tls_handshake(*client_connection_ptr); });
+				}
+				else
+#endif // FT_ENABLE_TLS
+				{
+					accept_client(*client_connection_ptr);
+				}
+			}
+
+			listen();
+		}
+	);
+}
 
-	if (client_socket.socket.is_open())
+void ft_server::accept_client(client_connection& client_socket)
+{
+	// the challenge goes out in the same write
+	if (m_client_validation_enabled)
 	{
-		client_socket.socket.write_some(asio::buffer(&c, 1), m_error_code);
-		std::this_thread::sleep_for(std::chrono::microseconds(1));
+		client_connection* client_connection_ptr = &client_socket;
+		m_asio_context.post([this, client_connection_ptr]() { handle_client_validation(*client_connection_ptr); });
 	}
 	else
 	{
-		std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
-		m_clients.erase(client_socket.iterator);
+		char hello[ft_protocol::hello_size];
+		ft_protocol::encode_hello(hello);
+		write_response(client_socket, hello, sizeof(hello));
+		client_socket.buffer.resize(m_buffer_size);
+		handle_client_request(client_socket);
+	}
+}
+
+#ifdef FT_ENABLE_TLS
+void ft_server::handle_tls_handshake(client_connection& client_socket)
+{
+	ft_tls_session::status status = client_socket.tls->handshake_step();
+	if (status == ft_tls_session::status::done)
+	{
+		client_socket.tls->check_offload();
+		accept_client(client_socket);
+		return;
 	}
+	if (status == ft_tls_session::status::failed)
+	{
+		remove_client(client_socket);
+		return;
+	}
+
+	client_socket.socket.async_wait((status == ft_tls_session::status::want_write) ? asio::socket_base::wait_write : asio::socket_base::wait_read,
+		[&](const std::error_code& ec)
+		{
+			if (ec)
+			{
+				remove_client(client_socket);
+			}
+			else
+			{
+				handle_tls_handshake(client_socket);
+			}
+		}
+	);
+}
+#endif // FT_ENABLE_TLS
+
+void ft_server::handle_client_validation(client_connection& client_socket)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		client_socket.challenge = rng(mt);
+	}
+	char greeting[ft_protocol::hello_size + sizeof(std::int32_t)];
+	ft_protocol::encode_hello(greeting);
+	std::memcpy(greeting + ft_protocol::hello_size, &client_socket.challenge, sizeof(std::int32_t));
+	write_response(client_socket, greeting, sizeof(greeting));
+
+	// "vali" + answer, or "resm" + 4 first bytes of the session token
+	ft_stream_async_read(client_socket.socket, client_socket.tls.get(), asio::buffer(client_socket.header, 4 * sizeof(char) + sizeof(std::int32_t)),
+		[&](std::error_code ec, std::size_t incoming_buffer_length)
+		{
+			if (ec)
+			{
+				remove_client(client_socket);
+				return;
+			}
+
+			std::uint32_t opcode = ft_protocol::decode_request_header(client_socket.header).opcode;
+
+			if (opcode == ft_protocol::resm)
+			{
+				ft_stream_async_read(client_socket.socket, client_socket.tls.get(), asio::buffer(client_socket.header + 8, sizeof(std::uint64_t) - 4),
+					[&](std::error_code ec, std::size_t incoming_buffer_length)
+					{
+						std::uint64_t token = 0;
+						std::memcpy(&token, client_socket.header + 4, sizeof(std::uint64_t));
+
+						char c = ((!ec) && resume_session(token)) ? 'r' : 'n';
+						write_response(client_socket, &c, 1);
+
+						if (c == 'r')
+						{
+							client_socket.buffer.resize(m_buffer_size);
+							handle_client_request(client_socket);
+						}
+						else
+						{
+							remove_client(client_socket);
+						}
+					}
+				);
+				return;
+			}
+
+			std::int32_t answer_number;
+			std::memcpy(&answer_number, client_socket.header + 4, sizeof(std::int32_t));
+
+			if ((opcode == ft_protocol::vali) && (answer_number == m_validation_function(client_socket.challenge)))
+			{
+				std::uint64_t token = open_session();
+				write_response(client_socket, &token, sizeof(std::uint64_t));
+
+				client_socket.buffer.resize(m_buffer_size);
+				handle_client_request(client_socket);
+			}
+			else
+			{
+				remove_client(client_socket);
+			}
+		}
+	);
+}
+
+void ft_server::handle_client_request(client_connection& client_socket)
+{
+	// fixed size header first, it says exactly how much follows
+	ft_stream_async_read(client_socket.socket, client_socket.tls.get(), asio::buffer(client_socket.header, ft_protocol::request_header_size),
+		[&](std::error_code ec, std::size_t incoming_buffer_length)
+		{
+			if (ec)
+			{
+				remove_client(client_socket);
+				return;
+			}
+
+			ft_protocol::request_header header = ft_protocol::decode_request_header(client_socket.header);
+			bool streamed = ((header.opcode == ft_protocol::send) || (header.opcode == ft_protocol::part))
+				&& (header.payload_size > m_upload_piece_size);
+			std::uint64_t buffered_size = header.name_size + (streamed ? 0 : header.payload_size);
+			if ((header.payload_size > ft_protocol::no_content - header.name_size) || (buffered_size > m_max_request_size))
+			{
+				remove_client(client_socket);
+				return;
+			}
+
+			std::size_t body_size = static_cast<std::size_t>(buffered_size);
+			std::size_t buffer_size = body_size + (streamed ? m_upload_piece_size : 0);
+			if (client_socket.buffer.size() < buffer_size)
+			{
+				client_socket.buffer.resize(buffer_size);
+			}
+
+			ft_stream_async_read(client_socket.socket, client_socket.tls.get(), asio::buffer(client_socket.buffer.data(), body_size),
+				[&, header, streamed](std::error_code ec, std::size_t incoming_buffer_length)
+				{
+					if (ec)
+					{
+						remove_client(client_socket);
+						return;
+					}
+
+					if (streamed)
+					{
+						receive_upload(client_socket, header);
+						return;
+					}
+
+					ft_request request;
+					request.opcode = header.opcode;
+					request.name = std::string_view(client_socket.buffer.data(), header.name_size);
+					request.payload = std::string_view(client_socket.buffer.data() + header.name_size, static_cast<std::size_t>(header.payload_size));
+					process_request(client_socket, request);
+				}
+			);
+		}
+	);
+}
+
+void ft_server::process_request(client_connection& client_socket, const ft_request& request)
+{
+	if (m_bulk_opcodes.count(request.opcode) != 0)
+	{
+		// nothing more is read from this client until the scheduler is done with the request
+		schedule_request(client_socket, request);
+		return;
+	}
+
+	// with low latency on, the answers to requests that arrived together leave in one write
+	client_socket.coalesce = m_low_latency;
+	dispatch(client_socket, request);
+	client_socket.coalesce = false;
+	if (!client_socket.output.empty() && !request_pending(client_socket))
+	{
+		flush_output(client_socket);
+	}
+	finish_request(client_socket);
+}
+
+void ft_server::receive_upload(client_connection& client_socket, const ft_protocol::request_header& header)
+{
+	// next to the destination, so that send can rename it into place
+	std::string file_name(client_socket.buffer.data(), header.name_size);
+	std::string counter = std::to_string(m_spool_counter++);
+	client_socket.spool_file_name = file_name + ".ft_up" + counter;
+	std::shared_ptr<std::ofstream> spool = std::make_shared<std::ofstream>(client_socket.spool_file_name, std::ios::binary | std::ios::trunc);
+	if (!spool->is_open())
+	{
+		// no such directory : received all the same, the upload fails once it is
+		client_socket.spool_file_name = ".ft_up" + counter;
+		spool->open(client_socket.spool_file_name, std::ios::binary | std::ios::trunc);
+	}
+	receive_upload_piece(client_socket, header, std::move(spool), header.payload_size);
+}
+
+void ft_server::receive_upload_piece(client_connection& client_socket, const ft_protocol::request_header& header,
+	std::shared_ptr<std::ofstream> spool, std::uint64_t remaining)
+{
+	if (remaining == 0)
+	{
+		spool->close();
+		std::shared_ptr<ft_mapped_file> file = std::make_shared<ft_mapped_file>();
+		if (spool->fail() || !file->open(client_socket.spool_file_name) || (file->size() != header.payload_size))
+		{
+			// counted as a failed upload by the next "sync"
+			track_commit(client_socket)(false);
+			finish_request(client_socket);
+			return;
+		}
+
+		client_socket.spool = file;
+		ft_request request;
+		request.opcode = header.opcode;
+		request.name = std::string_view(client_socket.buffer.data(), header.name_size);
+		request.payload = std::string_view(file->data(), static_cast<std::size_t>(file->size()));
+		process_request(client_socket, request);
+		return;
+	}
+
+	char* piece_ptr = client_socket.buffer.data() + header.name_size;
+	std::size_t piece_size = static_cast<std::size_t>(std::min<std::uint64_t>(remaining, m_upload_piece_size));
+	ft_stream_async_read(client_socket.socket, client_socket.tls.get(), asio::buffer(piece_ptr, piece_size),
+		[&, header, spool, remaining, piece_ptr](std::error_code ec, std::size_t incoming_buffer_length)
+		{
+			if (ec)
+			{
+				spool->close();
+				std::error_code remove_ec;
+				std::filesystem::remove(client_socket.spool_file_name, remove_ec);
+				remove_client(client_socket);
+				return;
+			}
+
+			// after a failed write the rest is still read, the request framing must hold
+			if (spool->good())
+			{
+				spool->write(piece_ptr, static_cast<std::streamsize>(incoming_buffer_length));
+			}
+			receive_upload_piece(client_socket, header, spool, remaining - incoming_buffer_length);
+		}
+	);
+}
+
+void ft_server::finish_request(client_connection& client_socket)
+{
+	// whatever the subroutine did not move away
+	if (!client_socket.spool_file_name.empty())
+	{
+		client_socket.spool.reset();
+		std::error_code ec;
+		std::filesystem::remove(client_socket.spool_file_name, ec);
+		client_socket.spool_file_name.clear();
+	}
+
+	// give back what a large upload made the buffer grow to
+	if (client_socket.buffer.size() > m_buffer_size)
+	{
+		client_socket.buffer.resize(m_buffer_size);
+		client_socket.buffer.shrink_to_fit();
+	}
+
+	handle_client_request(client_socket);
+}
+
+void ft_server::schedule_request(client_connection& client_socket, const ft_request& request)
+{
+	// the request views the connection buffer, which stays untouched until the next read
+	client_connection* client_connection_ptr = &client_socket;
+	m_scheduler.submit(client_connection_ptr, client_socket.weight,
+		[this, client_connection_ptr, request, current = std::shared_ptr<transfer>()](std::size_t& cost) mutable
+		{
+			if (current != nullptr)
+			{
+				return transfer_step(*client_connection_ptr, *current, cost);
+			}
+
+			// the first step runs the subroutine, a large answer is left as a transfer for the next ones
+			client_connection_ptr->scheduled = true;
+			dispatch(*client_connection_ptr, request);
+			client_connection_ptr->scheduled = false;
+			current = std::move(client_connection_ptr->pending_transfer);
+			cost = request.name.size() + request.payload.size();
+			return (current != nullptr) ? ft_scheduler::step_result::more : ft_scheduler::step_result::done;
+		},
+		[this, client_connection_ptr]()
+		{
+			if (!client_connection_ptr->output.empty())
+			{
+				flush_output(*client_connection_ptr);
+			}
+			{
+				// pushes queued during the transfer go out now
+				std::lock_guard<std::mutex> lock(*client_connection_ptr->write_mutex);
+				client_connection_ptr->transferring = false;
+				post_watch_drain(*client_connection_ptr);
+			}
+			finish_request(*client_connection_ptr);
+		}
+	);
+}
+
+void ft_server::start_transfer(client_connection& client_socket, std::shared_ptr<transfer> new_transfer)
+{
+	std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+	new_transfer->head.insert(new_transfer->head.begin(), client_socket.output.begin(), client_socket.output.end());
+	client_socket.output.clear();
+
+	// steps must not block on a slow reader, they park until the socket is writable instead
+	asio::error_code ec;
+	client_socket.socket.native_non_blocking(true, ec);
+	client_socket.pending_transfer = std::move(new_transfer);
+	client_socket.transferring = true;
+}
+
+ft_scheduler::step_result ft_server::transfer_step(client_connection& client_socket, transfer& current, std::size_t& cost)
+{
+	std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+	std::size_t budget = m_scheduler.quantum();
+	while (budget != 0)
+	{
+		if (!client_socket.socket.is_open())
+		{
+			return ft_scheduler::step_result::done;
+		}
+
+		const char* ptr = nullptr;
+		std::size_t n = 0;
+		bool from_file = false;
+		if (current.head_offset < current.head.size())
+		{
+			ptr = current.head.data() + current.head_offset;
+			n = current.head.size() - current.head_offset;
+		}
+		else if (current.offset < current.size)
+		{
+			n = static_cast<std::size_t>(std::min<std::uint64_t>(current.size - current.offset, budget));
+#ifdef __linux__
+			from_file = true;
+#ifdef FT_ENABLE_TLS
+			from_file = (client_socket.tls == nullptr) || client_socket.tls->ktls_send;
+#endif // FT_ENABLE_TLS
+#endif // __linux__
+			if (!from_file)
+			{
+				// no sendfile, the next block goes through the head, read and not mapped so that a truncated file fails
+				current.head.resize(n);
+				current.head_offset = 0;
+				if (!current.file->read_at(current.start + current.offset, current.head.data(), n))
+				{
+					asio::error_code ec;
+					client_socket.socket.close(ec);
+					return ft_scheduler::step_result::done;
+				}
+				current.offset += n;
+				continue;
+			}
+		}
+		else if (current.source)
+		{
+			current.head.clear();
+			current.head_offset = 0;
+			if (!current.source(current.head))
+			{
+				current.failed = true;
+				current.source = nullptr;
+			}
+			else if (current.head.empty())
+			{
+				current.source = nullptr;
+			}
+			continue;
+		}
+		else
+		{
+			bool failed = current.failed;
+			if (current.queue != nullptr)
+			{
+				chunk_queue& queue = *current.queue;
+				std::unique_lock<std::mutex> chunk_lock(queue.mutex);
+				if (!queue.chunks.empty())
+				{
+					current.head = std::move(queue.chunks.front());
+					current.head_offset = 0;
+					queue.chunks.pop_front();
+					chunk_lock.unlock();
+					queue.condition.notify_one();
+					continue;
+				}
+				if (!queue.produced)
+				{
+					// the producer resumes the flow with its next chunk
+					return ft_scheduler::step_result::wait;
+				}
+				failed = failed || queue.failed;
+			}
+			if (failed)
+			{
+				// a truncated archive cannot be told apart from a complete one, the connection goes instead
+				asio::error_code ec;
+				client_socket.socket.close(ec);
+			}
+			return ft_scheduler::step_result::done;
+		}
+		n = std::min(n, budget);
+
+		std::size_t sent = 0;
+		bool blocked = false;
+		asio::socket_base::wait_type wait_for = asio::socket_base::wait_write;
+		bool failed = false;
+#ifdef FT_ENABLE_TLS
+		ft_tls_session* tls = client_socket.tls.get();
+		if (tls != nullptr)
+		{
+#ifdef __linux__
+			ft_tls_session::status status = from_file ? tls->sendfile(current.file->native_handle(), current.start + current.offset, n, sent)
+				: tls->write_some(ptr, n, sent);
+#else
+			ft_tls_session::status status = tls->write_some(ptr, n, sent);
+#endif // __linux__
+			blocked = (status == ft_tls_session::status::want_write) || (status == ft_tls_session::status::want_read);
+			wait_for = (status == ft_tls_session::status::want_read) ? asio::socket_base::wait_read : asio::socket_base::wait_write;
+			failed = (status == ft_tls_session::status::failed);
+		}
+		else
+#endif // FT_ENABLE_TLS
+		{
+#ifdef __linux__
+			ssize_t result;
+			if (from_file)
+			{
+				off_t file_offset = static_cast<off_t>(current.start + current.offset);
+				result = ::sendfile(client_socket.socket.native_handle(), current.file->native_handle(), &file_offset, n);
+			}
+			else
+			{
+				result = ::send(client_socket.socket.native_handle(), ptr, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+			}
+			sent = (result > 0) ? static_cast<std::size_t>(result) : 0;
+			blocked = (result < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+			failed = (result == 0) || ((result < 0) && !blocked && (errno != EINTR));
+#else
+			asio::error_code ec;
+			ft_stream_write(client_socket.socket, nullptr, asio::buffer(ptr, n), ec);
+			sent = ec ? 0 : n;
+			failed = static_cast<bool>(ec);
+#endif // __linux__
+		}
+
+		if (failed)
+		{
+			// the read armed at the end of the request fails and removes the client
+			asio::error_code ec;
+			client_socket.socket.close(ec);
+			return ft_scheduler::step_result::done;
+		}
+
+		if (current.head_offset < current.head.size())
+		{
+			current.head_offset += sent;
+		}
+		else
+		{
+			current.offset += sent;
+		}
+		budget -= std::min(budget, sent);
+		cost += sent;
+
+		if (blocked)
+		{
+			ft_scheduler::flow_id id = &client_socket;
+			client_socket.socket.async_wait(wait_for, [this, id](const asio::error_code&) { m_scheduler.resume(id); });
+			return ft_scheduler::step_result::wait;
+		}
+	}
+	return ft_scheduler::step_result::more;
+}
+
+constexpr ft_server::dispatch_table ft_server::make_dispatch_table() noexcept
+{
+	// built-in commands, a new command only needs a line here
+	constexpr dispatch_entry subroutines[] = {
+		{ ft_protocol::ping, &ft_server::ping_subroutine },
+		{ ft_protocol::send, &ft_server::send_subroutine },
+		{ ft_protocol::app, &ft_server::app_subroutine },
+		{ ft_protocol::get, &ft_server::get_subroutine },
+		{ ft_protocol::list, &ft_server::list_subroutine },
+		{ ft_protocol::lsfp, &ft_server::lsfp_subroutine },
+		{ ft_protocol::rem, &ft_server::rem_subroutine },
+		{ ft_protocol::chck, &ft_server::chck_subroutine },
+		{ ft_protocol::have, &ft_server::have_subroutine },
+		{ ft_protocol::cput, &ft_server::cput_subroutine },
+		{ ft_protocol::mani, &ft_server::mani_subroutine },
+		{ ft_protocol::part, &ft_server::part_subroutine },
+		{ ft_protocol::offs, &ft_server::offs_subroutine },
+		{ ft_protocol::fin, &ft_server::fin_subroutine },
+		{ ft_protocol::watch, &ft_server::watch_subroutine },
+		{ ft_protocol::swarm_join, &ft_server::swarm_join_subroutine },
+		{ ft_protocol::swarm_plan, &ft_server::swarm_plan_subroutine },
+		{ ft_protocol::swarm_piece, &ft_server::swarm_piece_subroutine },
+		{ ft_protocol::gdir, &ft_server::gdir_subroutine },
+		{ ft_protocol::stat, &ft_server::stat_subroutine },
+		{ ft_protocol::sync, &ft_server::sync_subroutine }
+	};
+
+	// open addressing on a multiplicative hash of the opcode
+	dispatch_table table{};
+	for (const dispatch_entry& entry : subroutines)
+	{
+		std::size_t slot = dispatch_slot(entry.opcode);
+		while (table[slot].function != nullptr)
+		{
+			slot = (slot + 1) % dispatch_table_size;
+		}
+		table[slot] = entry;
+	}
+	return table;
+}
+
+void ft_server::dispatch(client_connection& client_socket, const ft_request& request)
+{
+	static constexpr dispatch_table table = make_dispatch_table();
+
+	for (std::size_t slot = dispatch_slot(request.opcode); table[slot].function != nullptr; slot = (slot + 1) % dispatch_table_size)
+	{
+		if (table[slot].opcode == request.opcode)
+		{
+			(this->*table[slot].function)(client_socket, request);
+			return;
+		}
+	}
+
+	std::unordered_map<std::uint32_t, command_handler>::iterator iter = m_custom_commands.find(request.opcode);
+	if (iter != m_custom_commands.end())
+	{
+		iter->second(client_socket, request);
+		return;
+	}
+
+	// unknown, answered so that the client does not wait forever
+	write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+}
+
+void ft_server::remove_client(client_connection& client_socket)
+{
+	{
+		// no push may reach the connection once it is gone
+		std::lock_guard<std::mutex> lock(m_watch_mutex);
+		for (std::list<watch_subscription>::iterator iter = m_watch_subscriptions.begin(); iter != m_watch_subscriptions.end();)
+		{
+			if (iter->client == &client_socket)
+			{
+				m_watcher.remove_watch(iter->directory);
+				iter = m_watch_subscriptions.erase(iter);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+	}
+
+	{
+		// the pieces a peer held are no longer available through it
+		std::lock_guard<std::mutex> lock(m_swarm_mutex);
+		for (auto& item : m_swarms)
+		{
+			swarm& target = item.second;
+			for (std::list<swarm_peer>::iterator iter = target.peers.begin(); iter != target.peers.end();)
+			{
+				if (iter->client == &client_socket)
+				{
+					for (std::size_t n = 0; n < iter->have.size(); n++)
+					{
+						target.availability[n] -= (iter->have[n] != 0) ? 1 : 0;
+					}
+					iter = target.peers.erase(iter);
+				}
+				else
+				{
+					++iter;
+				}
+			}
+		}
+
+		// a swarm nobody is in any more is dropped with its mapping, the next join builds it again
+		for (std::unordered_map<std::string, swarm>::iterator iter = m_swarms.begin(); iter != m_swarms.end();)
+		{
+			if (iter->second.peers.empty())
+			{
+				iter = m_swarms.erase(iter);
+			}
+			else
+			{
+				++iter;
+			}
+		}
+	}
+
+	asio::error_code ec;
+	{
+		std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+		client_socket.watch_events->closed = true;
+		client_socket.socket.close(ec);
+	}
+
+	std::lock_guard<std::mutex> lock(m_connect_disconnect_mutex);
+	m_clients.erase(client_socket.iterator);
+}
+
+ft_server::swarm* ft_server::find_swarm(const std::string& file_name, std::filesystem::file_time_type write_time)
+{
+	std::unordered_map<std::string, swarm>::iterator iter = m_swarms.find(file_name);
+	return ((iter != m_swarms.end()) && (iter->second.write_time == write_time)) ? &iter->second : nullptr;
+}
+
+bool ft_server::build_swarm(const std::string& file_name, std::filesystem::file_time_type write_time, swarm& target)
+{
+	std::shared_ptr<ft_mapped_file> file = std::make_shared<ft_mapped_file>();
+	if (!file->open(file_name, false))
+	{
+		return false;
+	}
+
+	// pieces are served at any offset, a stored manifest only reads back chunk by chunk from the start : left to "get"
+	ft_chunk_store::content_reader reader;
+	if (open_stored_content(*file, reader))
+	{
+		return false;
+	}
+
+	target = swarm();
+	target.file = std::move(file);
+	target.write_time = write_time;
+	target.piece_size = m_swarm_piece_size;
+
+	std::size_t number_of_pieces = (target.file->size() + target.piece_size - 1) / target.piece_size;
+	target.hashes.resize(number_of_pieces);
+	target.availability.assign(number_of_pieces, 0);
+	target.seeded.assign(number_of_pieces, std::chrono::steady_clock::time_point());
+	std::vector<char> piece(std::min<std::size_t>(target.piece_size, target.file->size()));
+	for (std::size_t n = 0; n < number_of_pieces; n++)
+	{
+		std::size_t offset = n * target.piece_size;
+		std::size_t piece_size = std::min<std::size_t>(target.piece_size, target.file->size() - offset);
+		if (!target.file->read_at(offset, piece.data(), piece_size))
+		{
+			return false;
+		}
+		target.hashes[n] = ft_sha256::hash(piece.data(), piece_size);
+	}
+	return true;
+}
+
+bool ft_server::open_stored_content(const ft_mapped_file& file, ft_chunk_store::content_reader& reader) const
+{
+	std::vector<char> stored(8);
+	if (!m_chunk_store_enabled || (file.size() < stored.size()) || !file.read_at(0, stored.data(), stored.size())
+		|| (std::memcmp(stored.data(), ft_chunker::manifest_magic, stored.size()) != 0))
+	{
+		return false;
+	}
+	stored.resize(file.size());
+	return file.read_at(0, stored.data(), stored.size()) && m_chunk_store.open_content(stored.data(), stored.size(), reader);
+}
+
+void ft_server::push_watch_events(const std::string& directory, const std::vector<ft_watcher::event>& events)
+{
+#ifdef __linux__
+	struct file_state
+	{
+		std::uint64_t size = 0;
+		std::int64_t mtime = 0;
+	};
+
+	// stat once per file, whatever the number of subscribers
+	std::vector<file_state> states(events.size());
+	for (std::size_t n = 0; n < events.size(); n++)
+	{
+		struct stat file_stat;
+		std::string path = directory + '/' + events[n].name;
+		if ((events[n].kind != 'r') && (::stat(path.c_str(), &file_stat) == 0))
+		{
+			states[n].size = static_cast<std::uint64_t>(file_stat.st_size);
+			states[n].mtime = static_cast<std::int64_t>(file_stat.st_mtim.tv_sec) * 1000000000 + static_cast<std::int64_t>(file_stat.st_mtim.tv_nsec);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_watch_mutex);
+	for (watch_subscription& subscription : m_watch_subscriptions)
+	{
+		if (subscription.directory != directory)
+		{
+			continue;
+		}
+
+		std::string frame(ft_protocol::response_header_size, '\0');
+		frame += ft_protocol::watch_push;
+		for (std::size_t n = 0; n < events.size(); n++)
+		{
+			if (events[n].name.compare(0, subscription.prefix.size(), subscription.prefix) == 0)
+			{
+				ft_append_watch_event(frame, events[n].kind, states[n].size, states[n].mtime, subscription.base + events[n].name);
+			}
+		}
+		if (frame.size() == ft_protocol::response_header_size + 1)
+		{
+			continue;
+		}
+		std::uint64_t frame_size = frame.size() - ft_protocol::response_header_size;
+		std::memcpy(frame.data(), &frame_size, sizeof(std::uint64_t));
+
+		// queued and written by the io threads, a stalled subscriber never holds back the watcher or the others
+		client_connection& client_socket = *subscription.client;
+		std::lock_guard<std::mutex> write_lock(*client_socket.write_mutex);
+		watch_queue& queue = *client_socket.watch_events;
+		if ((queue.stalled_since != std::chrono::steady_clock::time_point{})
+			&& (std::chrono::steady_clock::now() - queue.stalled_since > m_watch_send_timeout))
+		{
+			// the read armed at the end of the request fails and removes the client
+			asio::error_code ec;
+			client_socket.socket.close(ec);
+			continue;
+		}
+		queue.frames.insert(queue.frames.end(), frame.begin(), frame.end());
+		post_watch_drain(client_socket);
+	}
+#endif // __linux__
+}
+
+void ft_server::post_watch_drain(client_connection& client_socket)
+{
+	watch_queue& queue = *client_socket.watch_events;
+	if (queue.draining || queue.frames.empty())
+	{
+		return;
+	}
+	queue.draining = true;
+	client_connection* client_connection_ptr = &client_socket;
+	asio::post(m_asio_context,
+		[this, client_connection_ptr, queue_ptr = client_socket.watch_events, write_mutex = client_socket.write_mutex]()
+		{
+			{
+				std::lock_guard<std::mutex> lock(*write_mutex);
+				if (queue_ptr->closed)
+				{
+					return;
+				}
+			}
+			drain_watch_events(*client_connection_ptr);
+		}
+	);
+}
+
+void ft_server::drain_watch_events(client_connection& client_socket)
+{
+#ifdef __linux__
+	std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+	watch_queue& queue = *client_socket.watch_events;
+	if (queue.closed || !client_socket.socket.is_open() || client_socket.transferring)
+	{
+		// a transfer posts the drain again once it is done
+		queue.draining = false;
+		return;
+	}
+
+	// pushes go behind the held back answers, the unsent rest of a frame stays in front of the next answer
+	client_socket.output.insert(client_socket.output.end(), queue.frames.begin(), queue.frames.end());
+	queue.frames.clear();
+
+	std::size_t offset = 0;
+	bool blocked = false;
+	bool failed = false;
+	asio::socket_base::wait_type wait_for = asio::socket_base::wait_write;
+	while (!blocked && !failed && (offset < client_socket.output.size()))
+	{
+		const char* ptr = client_socket.output.data() + offset;
+		std::size_t n = client_socket.output.size() - offset;
+		std::size_t sent = 0;
+#ifdef FT_ENABLE_TLS
+		ft_tls_session* tls = client_socket.tls.get();
+		if ((tls != nullptr) && !tls->ktls_send)
+		{
+			ft_tls_session::status status = tls->write_some(ptr, n, sent);
+			blocked = (status == ft_tls_session::status::want_write) || (status == ft_tls_session::status::want_read);
+			wait_for = (status == ft_tls_session::status::want_read) ? asio::socket_base::wait_read : asio::socket_base::wait_write;
+			failed = (status == ft_tls_session::status::failed);
+		}
+		else
+#endif // FT_ENABLE_TLS
+		{
+			ssize_t result = ::send(client_socket.socket.native_handle(), ptr, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+			sent = (result > 0) ? static_cast<std::size_t>(result) : 0;
+			blocked = (result < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK));
+			failed = (result == 0) || ((result < 0) && !blocked && (errno != EINTR));
+		}
+		offset += sent;
+	}
+	client_socket.output.erase(client_socket.output.begin(), client_socket.output.begin() + static_cast<std::ptrdiff_t>(offset));
+
+	if (failed)
+	{
+		asio::error_code ec;
+		client_socket.socket.close(ec);
+		client_socket.output.clear();
+		queue.draining = false;
+		return;
+	}
+	if (client_socket.output.empty())
+	{
+		queue.stalled_since = std::chrono::steady_clock::time_point{};
+		queue.draining = false;
+		return;
+	}
+
+	if (queue.stalled_since == std::chrono::steady_clock::time_point{})
+	{
+		queue.stalled_since = std::chrono::steady_clock::now();
+	}
+	client_connection* client_connection_ptr = &client_socket;
+	client_socket.socket.async_wait(wait_for,
+		[this, client_connection_ptr, queue_ptr = client_socket.watch_events, write_mutex = client_socket.write_mutex](const asio::error_code& ec)
+		{
+			{
+				std::lock_guard<std::mutex> lock(*write_mutex);
+				if (ec || queue_ptr->closed)
+				{
+					queue_ptr->draining = false;
+					return;
+				}
+			}
+			drain_watch_events(*client_connection_ptr);
+		}
+	);
+#endif // __linux__
+}
+
+std::uint64_t ft_server::open_session()
+{
+	std::lock_guard<std::mutex> lock(m_session_mutex);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	for (auto iter = m_sessions.begin(); iter != m_sessions.end();)
+	{
+		if (now - iter->second > m_session_lifetime) { iter = m_sessions.erase(iter); }
+		else { ++iter; }
+	}
+
+	std::uint64_t token;
+	do
+	{
+		token = m_session_rng();
+	} while ((token == 0) || (m_sessions.count(token) != 0));
+
+	m_sessions[token] = now;
+	return token;
+}
+
+bool ft_server::resume_session(std::uint64_t token)
+{
+	std::lock_guard<std::mutex> lock(m_session_mutex);
+	std::unordered_map<std::uint64_t, std::chrono::steady_clock::time_point>::iterator iter = m_sessions.find(token);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	if ((iter == m_sessions.end()) || (now - iter->second > m_session_lifetime))
+	{
+		return false;
+	}
+	iter->second = now;
+	return true;
+}
+
+void ft_server::ping_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	char c = 'p';
+	write_response(client_socket, &c, 1);
+}
+
+void ft_server::send_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::string file_name = request.name_string();
+
+	// hashed again once the new content is in place, a "sync" on the connection waits for it
+	std::function<void(bool)> on_done = track_commit(client_socket,
+		m_hash_index_enabled ? std::function<void()>([this, file_name]() { m_hash_index.invalidate(file_name); }) : nullptr);
+
+	if (m_chunk_store_enabled)
+	{
+		m_chunk_store.store(file_name, request.payload.data(), request.payload.size(), std::move(on_done));
+	}
+	else if (client_socket.spool != nullptr)
+	{
+		// already on disk next to the destination, it only needs to be renamed into place
+		client_socket.spool->close();
+		m_group_commit.commit_file(client_socket.spool_file_name, file_name, m_durable_writes, std::move(on_done));
+	}
+	else
+	{
+		m_group_commit.write_file(file_name, request.payload.data(), request.payload.size(), m_durable_writes, std::move(on_done));
+	}
+}
+
+void ft_server::app_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::string file_name = request.name_string();
+
+	// behind an upload of the same name still waiting for its sync cycle, its rename would drop the appended bytes
+	m_group_commit.wait_published(file_name);
+
+	// not queued for the hash index : a growing log would be read whole again for every line,
+	// the next "stat" finds the entry stale and has it hashed once
+	if (m_chunk_store_enabled)
+	{
+		// a stored file is a manifest, bytes appended to it would corrupt it : its content is extended instead
+		std::ifstream stored(file_name, std::ios::binary);
+		std::vector<char> manifest(8);
+		if (stored.read(manifest.data(), 8) && (std::memcmp(manifest.data(), ft_chunker::manifest_magic, 8) == 0))
+		{
+			manifest.insert(manifest.end(), std::istreambuf_iterator<char>(stored), std::istreambuf_iterator<char>());
+			if (ft_chunker::is_manifest(manifest.data(), manifest.size()))
+			{
+				m_chunk_store.append(file_name, manifest.data(), manifest.size(), request.payload.data(), request.payload.size(),
+					track_commit(client_socket));
+				return;
+			}
+		}
+	}
+#ifdef __linux__
+	if (m_log_ingest_enabled)
+	{
+		// buffered, written and synced later in large batches
+		m_log_ingest.append(file_name, request.payload.data(), request.payload.size());
+		return;
+	}
+
+	std::function<void(bool)> on_done = track_commit(client_socket);
+	int fd = ::open(file_name.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		on_done(false);
+		return;
+	}
+	bool written = ft_write_all(fd, request.payload.data(), request.payload.size());
+
+	if (m_durable_writes)
+	{
+		m_group_commit.submit(fd, [written](bool synced) { return written && synced; }, std::string(), std::move(on_done));
+	}
+	else
+	{
+		::close(fd);
+		on_done(written);
+	}
+#else
+	std::fstream file(file_name, std::ios::app);
+	file.write(request.payload.data(), request.payload.size());
+	file.close();
+#endif // __linux__
+}
+
+void ft_server::get_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	// never mapped here, the file can be truncated by anyone while it is sent
+	std::shared_ptr<ft_mapped_file> file = std::make_shared<ft_mapped_file>();
+	if (!file->open(request.name_string(), false))
+	{
+		write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+		return;
+	}
+
+	std::shared_ptr<ft_chunk_store::content_reader> reader = std::make_shared<ft_chunk_store::content_reader>();
+	if (open_stored_content(*file, *reader))
+	{
+		// reassembled one chunk at a time as the socket takes it
+		write_stream_response(client_socket, reader->size,
+			[this, reader](std::vector<char>& chunk) { return m_chunk_store.read_content(*reader, chunk); });
+		return;
+	}
+
+	// straight from the page cache
+	write_file_response(client_socket, file, 0, file->size());
+}
+
+void ft_server::list_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::string files("");
+	{
+		std::error_code ec;
+		std::filesystem::directory_iterator file_list(std::filesystem::current_path(), ec);
+		for (const std::filesystem::directory_entry& item : file_list)
+		{
+			std::string temp = item.path().generic_string();
+			files += temp;
+			if (std::filesystem::is_directory(temp, ec))
+			{
+				files += '/';
+			}
+			files += ';';
+		}
+	}
+	if (files.size() != 0)
+	{
+		files.pop_back();
+	}
+
+	write_sized_response(client_socket, files.data(), files.size());
+}
+
+void ft_server::lsfp_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::string files("");
+	{
+		std::error_code ec;
+		std::filesystem::directory_iterator file_list(request.name_string(), ec);
+		if (ec)
+		{
+			write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+			return;
+		}
+		for (const std::filesystem::directory_entry& item : file_list)
+		{
+			files += item.path().generic_string();
+			files += ';';
+		}
+	}
+	if (files.size() != 0)
+	{
+		files.pop_back();
+	}
+
+	write_sized_response(client_socket, files.data(), files.size());
+}
+
+void ft_server::rem_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	// an upload of the same name still waiting for its sync cycle would bring the file back
+	m_group_commit.wait_published(request.name_string());
+	std::error_code ec;
+	std::filesystem::remove(request.name_string(), ec);
+	if (m_hash_index_enabled)
+	{
+		m_hash_index.remove(request.name_string());
+	}
+}
+
+void ft_server::chck_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::error_code ec;
+	char c;
+	if (std::filesystem::exists(request.name_string(), ec)) { c = 'y'; }
+	else { c = 'n'; }
+
+	write_response(client_socket, &c, 1);
+}
+
+void ft_server::have_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::size_t number_of_hashes = request.payload.size() / 32;
+
+	// one char per hash : 'y' already stored, 'n' missing, 'u' no chunk store on this server
+	std::vector<char> answer(number_of_hashes, 'u');
+	if (m_chunk_store_enabled)
+	{
+		ft_sha256::digest hash;
+		for (std::size_t n = 0; n < number_of_hashes; n++)
+		{
+			std::memcpy(hash.data(), request.payload.data() + 32 * n, 32);
+			answer[n] = m_chunk_store.has_chunk(hash) ? 'y' : 'n';
+		}
+	}
+
+	write_sized_response(client_socket, answer.data(), answer.size());
+}
+
+void ft_server::cput_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	if (m_chunk_store_enabled)
+	{
+		m_chunk_store.put_chunk(request.payload.data(), request.payload.size());
+	}
+}
+
+void ft_server::mani_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::string file_name = request.name_string();
+	char c = 'n';
+	if (m_chunk_store_enabled)
+	{
+		std::function<void(bool)> on_done = track_commit(client_socket,
+			m_hash_index_enabled ? std::function<void()>([this, file_name]() { m_hash_index.invalidate(file_name); }) : nullptr);
+		c = m_chunk_store.store_manifest(file_name, request.payload.data(), request.payload.size(), std::move(on_done)) ? 'y' : 'n';
+	}
+
+	write_response(client_socket, &c, 1);
+}
+
+std::string ft_server::part_file_name(const std::string& file_name, const char* upload_id)
+{
+	ft_sha256::digest hash;
+	std::memcpy(hash.data(), upload_id + sizeof(std::uint64_t), hash.size());
+	return file_name + ".ft_part." + ft_sha256::to_hex(hash).substr(0, 32);
+}
+
+void ft_server::part_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	// payload : upload id, u64 offset, then the bytes to write there, into the part file of that upload until fin
+	if (request.payload.size() < ft_protocol::upload_id_size + sizeof(std::uint64_t))
+	{
+		return;
+	}
+	std::uint64_t file_size;
+	std::uint64_t offset;
+	std::memcpy(&file_size, request.payload.data(), sizeof(std::uint64_t));
+	std::memcpy(&offset, request.payload.data() + ft_protocol::upload_id_size, sizeof(std::uint64_t));
+	const char* data_ptr = request.payload.data() + ft_protocol::upload_id_size + sizeof(std::uint64_t);
+	std::size_t data_size = request.payload.size() - ft_protocol::upload_id_size - sizeof(std::uint64_t);
+	if ((offset > file_size) || (data_size > file_size - offset))
+	{
+		return;
+	}
+
+	std::string part_file = part_file_name(request.name_string(), request.payload.data());
+
+#ifdef __linux__
+	int fd = ::open(part_file.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (fd < 0)
+	{
+		return;
+	}
+	ft_pwrite_all(fd, data_ptr, data_size, offset);
+	::close(fd);
+#else
+	std::fstream file(part_file, std::ios::in | std::ios::out | std::ios::binary);
+	if (!file.is_open())
+	{
+		file.open(part_file, std::ios::out | std::ios::binary);
+	}
+	file.seekp(static_cast<std::streamoff>(offset));
+	file.write(data_ptr, data_size);
+	file.close();
+#endif // __linux__
+}
+
+void ft_server::offs_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	// bytes of this upload's part file already on disk, where an interrupted upload resumes
+	std::uint64_t offset = 0;
+	if (request.payload.size() != ft_protocol::upload_id_size)
+	{
+		write_response(client_socket, &offset, sizeof(std::uint64_t));
+		return;
+	}
+	std::uint64_t file_size;
+	std::memcpy(&file_size, request.payload.data(), sizeof(std::uint64_t));
+	std::string file_name = request.name_string();
+	std::string part_file = part_file_name(file_name, request.payload.data());
+
+	std::error_code ec;
+	offset = static_cast<std::uint64_t>(std::filesystem::file_size(part_file, ec));
+	if (ec || (offset > file_size))
+	{
+		// a new upload : parts of earlier content for the same destination are dropped, one that cannot be
+		// this content's prefix starts over
+		offset = 0;
+		std::filesystem::path parent = std::filesystem::path(file_name).parent_path();
+		std::string prefix = std::filesystem::path(file_name).filename().string() + ".ft_part.";
+		for (const std::filesystem::directory_entry& item : std::filesystem::directory_iterator(parent.empty() ? "." : parent, ec))
+		{
+			std::string item_name = item.path().filename().string();
+			if ((item_name.compare(0, prefix.size(), prefix) == 0) && (item.path() != std::filesystem::path(part_file)))
+			{
+				std::error_code remove_ec;
+				std::filesystem::remove(item.path(), remove_ec);
+			}
+		}
+		std::ofstream truncated(part_file, std::ios::binary | std::ios::trunc);
+	}
+
+	write_response(client_socket, &offset, sizeof(std::uint64_t));
+}
+
+void ft_server::fin_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	// payload : upload id, the part file becomes the destination only if it is complete and its hash matches
+	char c = 'n';
+	if (request.payload.size() != ft_protocol::upload_id_size)
+	{
+		write_response(client_socket, &c, 1);
+		return;
+	}
+	std::uint64_t expected_size;
+	ft_sha256::digest expected_hash;
+	std::memcpy(&expected_size, request.payload.data(), sizeof(std::uint64_t));
+	std::memcpy(expected_hash.data(), request.payload.data() + sizeof(std::uint64_t), expected_hash.size());
+	std::string file_name = request.name_string();
+	std::string part_file = part_file_name(file_name, request.payload.data());
+
+	ft_mapped_file file;
+	if (file.open(part_file) && (file.size() == expected_size) && (ft_sha256::hash(file.data(), file.size()) == expected_hash))
+	{
+		std::function<void(bool)> on_done = track_commit(client_socket,
+			m_hash_index_enabled ? std::function<void()>([this, file_name]() { m_hash_index.invalidate(file_name); }) : nullptr);
+		std::error_code ec;
+		if (m_chunk_store_enabled)
+		{
+			if (m_chunk_store.store(file_name, file.data(), file.size(), std::move(on_done)))
+			{
+				file.close();
+				std::filesystem::remove(part_file, ec);
+				c = 'y';
+			}
+		}
+		else
+		{
+			file.close();
+			c = m_group_commit.commit_file(part_file, file_name, m_durable_writes, std::move(on_done)) ? 'y' : 'n';
+		}
+	}
+	else if (file.is_open() && (file.size() == expected_size))
+	{
+		// complete but corrupt, the next attempt starts over
+		file.close();
+		std::error_code ec;
+		std::filesystem::remove(part_file, ec);
+	}
+
+	write_response(client_socket, &c, 1);
+}
+
+void ft_server::watch_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	// a directory reports all its files, anything else is a file name prefix inside its parent directory
+	std::error_code ec;
+	std::filesystem::path path(request.name);
+	watch_subscription subscription;
+	subscription.client = &client_socket;
+
+	if (std::filesystem::is_directory(path, ec))
+	{
+		subscription.directory = path.generic_string();
+		subscription.base = subscription.directory;
+		if (subscription.base.back() != '/')
+		{
+			subscription.base += '/';
+		}
+	}
+	else
+	{
+		subscription.directory = path.has_parent_path() ? path.parent_path().generic_string() : std::string(".");
+		subscription.base = path.has_parent_path() ? path.parent_path().generic_string() + '/' : std::string();
+		subscription.prefix = path.filename().generic_string();
+	}
+
+	// the answer goes out before the first push can, the watcher thread and its inotify instance only exist
+	// once someone watches
+	std::lock_guard<std::mutex> lock(m_watch_mutex);
+	bool started = m_watcher.start([this](const std::string& directory, const std::vector<ft_watcher::event>& events) { push_watch_events(directory, events); });
+	char c = (started && m_watcher.add_watch(subscription.directory)) ? 'y' : 'n';
+	write_sized_response(client_socket, &c, 1);
+	if (c == 'y')
+	{
+		m_watch_subscriptions.push_back(std::move(subscription));
+	}
+}
+
+void ft_server::swarm_join_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::uint16_t port = 0;
+	asio::error_code ec;
+	asio::ip::tcp::endpoint endpoint = client_socket.socket.remote_endpoint(ec);
+	if (ec || (request.payload.size() < sizeof(std::uint16_t)))
+	{
+		write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+		return;
+	}
+	std::memcpy(&port, request.payload.data(), sizeof(std::uint16_t));
+	std::string address = endpoint.address().to_string() + ':' + std::to_string(port);
+
+	std::string file_name = request.name_string();
+	std::error_code file_ec;
+	std::filesystem::file_time_type write_time = std::filesystem::last_write_time(file_name, file_ec);
+	if (file_ec)
+	{
+		std::lock_guard<std::mutex> lock(m_swarm_mutex);
+		m_swarms.erase(file_name);
+		write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+		return;
+	}
+
+	// a new file or new content is hashed with m_swarm_mutex released and published once done, peers of the
+	// previous content have to join again
+	std::vector<char> table;
+	swarm built;
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_swarm_mutex);
+			swarm* target = find_swarm(file_name, write_time);
+			if ((target == nullptr) && (built.file != nullptr))
+			{
+				target = &(m_swarms[file_name] = std::move(built));
+			}
+			if (target != nullptr)
+			{
+				// joining again starts from an empty piece set
+				for (std::list<swarm_peer>::iterator iter = target->peers.begin(); iter != target->peers.end(); ++iter)
+				{
+					if ((iter->client == &client_socket) && (iter->address == address))
+					{
+						for (std::size_t n = 0; n < iter->have.size(); n++)
+						{
+							target->availability[n] -= (iter->have[n] != 0) ? 1 : 0;
+						}
+						target->peers.erase(iter);
+						break;
+					}
+				}
+				target->peers.push_back(swarm_peer{ &client_socket, address, std::vector<char>(target->hashes.size(), 0), 0 });
+
+				std::uint64_t file_size = target->file->size();
+				std::uint32_t number_of_pieces = static_cast<std::uint32_t>(target->hashes.size());
+				table.resize(ft_protocol::swarm_table_header_size + number_of_pieces * sizeof(ft_sha256::digest));
+				std::memcpy(table.data(), &file_size, sizeof(std::uint64_t));
+				std::memcpy(table.data() + sizeof(std::uint64_t), &target->piece_size, sizeof(std::uint32_t));
+				std::memcpy(table.data() + sizeof(std::uint64_t) + sizeof(std::uint32_t), &number_of_pieces, sizeof(std::uint32_t));
+				for (std::size_t n = 0; n < target->hashes.size(); n++)
+				{
+					std::memcpy(table.data() + ft_protocol::swarm_table_header_size + n * sizeof(ft_sha256::digest), target->hashes[n].data(), sizeof(ft_sha256::digest));
+				}
+				break;
+			}
+		}
+		if (!build_swarm(file_name, write_time, built))
+		{
+			break;
+		}
+	}
+
+	if (table.empty())
+	{
+		write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+		return;
+	}
+	write_sized_response(client_socket, table.data(), table.size());
+}
+
+void ft_server::swarm_plan_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::string plan;
+	{
+		std::lock_guard<std::mutex> lock(m_swarm_mutex);
+		std::unordered_map<std::string, swarm>::iterator swarm_iter = m_swarms.find(request.name_string());
+		if ((swarm_iter == m_swarms.end()) || (request.payload.size() < sizeof(std::uint16_t)))
+		{
+			write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+			return;
+		}
+		swarm& target = swarm_iter->second;
+
+		std::uint16_t port = 0;
+		std::memcpy(&port, request.payload.data(), sizeof(std::uint16_t));
+		std::string port_suffix = ':' + std::to_string(port);
+		std::list<swarm_peer>::iterator self = std::find_if(target.peers.begin(), target.peers.end(),
+			[&](const swarm_peer& peer)
+			{
+				return (peer.client == &client_socket) && (peer.address.size() >= port_suffix.size())
+					&& (peer.address.compare(peer.address.size() - port_suffix.size(), port_suffix.size(), port_suffix) == 0);
+			}
+		);
+		std::string_view have = request.payload.substr(sizeof(std::uint16_t));
+		if ((self == target.peers.end()) || (have.size() != target.hashes.size()))
+		{
+			write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+			return;
+		}
+
+		for (std::size_t n = 0; n < have.size(); n++)
+		{
+			char held = (have[n] != 0) ? 1 : 0;
+			if (held != self->have[n])
+			{
+				target.availability[n] += (held != 0) ? 1 : static_cast<std::uint32_t>(-1);
+				self->have[n] = held;
+			}
+		}
+
+		// rarest pieces first, ties broken at random so that peers asking together spread over different pieces
+		std::vector<std::pair<std::uint64_t, std::uint32_t>> missing;
+		for (std::uint32_t n = 0; n < static_cast<std::uint32_t>(have.size()); n++)
+		{
+			if (self->have[n] == 0)
+			{
+				missing.emplace_back((static_cast<std::uint64_t>(target.availability[n]) << 32) | m_swarm_rng(), n);
+			}
+		}
+		std::sort(missing.begin(), missing.end());
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		std::size_t planned = 0;
+		for (std::size_t k = 0; (k < missing.size()) && (planned < m_swarm_plan_size); k++)
+		{
+			std::uint32_t piece = missing[k].second;
+			std::string source;
+
+			if (target.availability[piece] != 0)
+			{
+				// the least solicited holder
+				swarm_peer* best = nullptr;
+				for (swarm_peer& peer : target.peers)
+				{
+					if ((&peer != &*self) && (peer.have[piece] != 0) && ((best == nullptr) || (peer.uploads < best->uploads)))
+					{
+						best = &peer;
+					}
+				}
+				if (best == nullptr)
+				{
+					continue;
+				}
+				best->uploads++;
+				source = best->address;
+			}
+			else if (now - target.seeded[piece] < m_swarm_seed_timeout)
+			{
+				// another peer is already getting it from the server, it will be fetched from that peer
+				continue;
+			}
+			else
+			{
+				target.seeded[piece] = now;
+			}
+
+			char record[sizeof(std::uint32_t) + sizeof(std::uint16_t)];
+			std::uint16_t source_size = static_cast<std::uint16_t>(source.size());
+			std::memcpy(record, &piece, sizeof(std::uint32_t));
+			std::memcpy(record + sizeof(std::uint32_t), &source_size, sizeof(std::uint16_t));
+			plan.append(record, sizeof(record));
+			plan += source;
+			planned++;
+		}
+	}
+	write_sized_response(client_socket, plan.data(), plan.size());
+}
+
+void ft_server::swarm_piece_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::shared_ptr<ft_mapped_file> file;
+	std::size_t offset = 0;
+	std::size_t piece_size = 0;
+	{
+		std::lock_guard<std::mutex> lock(m_swarm_mutex);
+		std::unordered_map<std::string, swarm>::iterator iter = m_swarms.find(request.name_string());
+		std::uint32_t piece = 0;
+		if (request.payload.size() == sizeof(std::uint32_t))
+		{
+			std::memcpy(&piece, request.payload.data(), sizeof(std::uint32_t));
+		}
+		if ((iter != m_swarms.end()) && (request.payload.size() == sizeof(std::uint32_t)) && (piece < iter->second.hashes.size()))
+		{
+			file = iter->second.file;
+			offset = static_cast<std::size_t>(piece) * iter->second.piece_size;
+			piece_size = std::min<std::size_t>(iter->second.piece_size, file->size() - offset);
+		}
+	}
+
+	if (file == nullptr)
+	{
+		write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+		return;
+	}
+	// the file stays open through the shared pointer even if the swarm is rebuilt meanwhile
+	write_file_response(client_socket, file, offset, piece_size);
+	m_swarm_bytes_sent += piece_size;
+}
+
+void ft_server::gdir_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::string path = request.name_string();
+	std::error_code ec;
+	if (!std::filesystem::is_directory(path, ec))
+	{
+		write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+		return;
+	}
+
+	bool gzip = !request.payload.empty() && ((static_cast<std::uint8_t>(request.payload[0]) & ft_protocol::archive_gzip) != 0);
+
+	if (!client_socket.scheduled)
+	{
+		bool success = write_archive(path, gzip,
+			[&](const void* ptr, std::uint64_t n)
+			{
+				write_sized_response(client_socket, ptr, n);
+				return client_socket.socket.is_open();
+			}
+		);
+		if (!success)
+		{
+			// a truncated archive cannot be told apart from a complete one, the connection goes instead
+			std::lock_guard<std::mutex> lock(*client_socket.write_mutex);
+			asio::error_code close_ec;
+			client_socket.socket.close(close_ec);
+		}
+		return;
+	}
+
+	// made by a free archive producer a few chunks ahead of the scheduler steps sending them
+	std::shared_ptr<transfer> archive = std::make_shared<transfer>();
+	archive->queue = std::make_shared<chunk_queue>();
+	{
+		std::lock_guard<std::mutex> lock(m_archive_jobs_mutex);
+		m_archive_jobs.push_back(archive_job{ archive->queue, path, gzip, &client_socket });
+	}
+	m_archive_jobs_condition.notify_one();
+	start_transfer(client_socket, std::move(archive));
+}
+
+void ft_server::run_archive_producer()
+{
+	while (true)
+	{
+		archive_job job;
+		{
+			std::unique_lock<std::mutex> lock(m_archive_jobs_mutex);
+			m_archive_jobs_condition.wait(lock, [&]() { return !m_archive_producers_running || !m_archive_jobs.empty(); });
+			if (!m_archive_producers_running)
+			{
+				return;
+			}
+			job = std::move(m_archive_jobs.front());
+			m_archive_jobs.pop_front();
+		}
+
+		chunk_queue& queue = *job.queue;
+		{
+			// dropped while it was waiting for a producer
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.cancelled)
+			{
+				continue;
+			}
+		}
+		bool success = write_archive(job.path, job.gzip,
+			[&](const void* ptr, std::uint64_t n)
+			{
+				std::size_t data_size = (n != ft_protocol::no_content) ? static_cast<std::size_t>(n) : 0;
+				std::vector<char> chunk(sizeof(std::uint64_t) + data_size);
+				std::memcpy(chunk.data(), &n, sizeof(std::uint64_t));
+				if (data_size != 0)
+				{
+					std::memcpy(chunk.data() + sizeof(std::uint64_t), ptr, data_size);
+				}
+				{
+					std::unique_lock<std::mutex> lock(queue.mutex);
+					queue.condition.wait(lock, [&]() { return queue.cancelled || (queue.chunks.size() < m_max_pending_chunks); });
+					if (queue.cancelled)
+					{
+						return false;
+					}
+					queue.chunks.push_back(std::move(chunk));
+				}
+				m_scheduler.resume(job.id);
+				return true;
+			}
+		);
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.produced = true;
+			queue.failed = !success;
+		}
+		m_scheduler.resume(job.id);
+	}
+}
+
+ft_server::transfer::~transfer()
+{
+	if (queue != nullptr)
+	{
+		{
+			std::lock_guard<std::mutex> lock(queue->mutex);
+			queue->cancelled = true;
+		}
+		queue->condition.notify_all();
+	}
+}
+
+void ft_server::stat_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	std::string file_name = request.name_string();
+	ft_file_status status;
+	if (m_hash_index_enabled)
+	{
+		ft_hash_index::record record;
+		if (!m_hash_index.lookup(file_name, record))
+		{
+			write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+			return;
+		}
+		status.state = record.hashed ? 'y' : 'p';
+		status.size = record.size;
+		status.mtime = record.mtime;
+		status.hash = record.hash;
+	}
+	else
+	{
+		if (!ft_hash_index::file_status(file_name, status.size, status.mtime))
+		{
+			write_sized_response(client_socket, nullptr, ft_protocol::no_content);
+			return;
+		}
+		status.state = 's';
+	}
+
+	char answer[ft_protocol::file_status_size];
+	ft_encode_file_status(answer, status);
+	write_sized_response(client_socket, answer, sizeof(answer));
+}
+
+void ft_server::sync_subroutine(client_connection& client_socket, const ft_request& request)
+{
+	// answered once every upload read before it is in place, 'n' if one of them failed since the last "sync"
+	std::shared_ptr<commit_tracker> commits = client_socket.commits;
+	std::unique_lock<std::mutex> lock(commits->mutex);
+	if ((commits->pending != 0) && client_socket.scheduled)
+	{
+		// the flow is parked, the last commit hands the answer over as the chunk of a transfer
+		std::shared_ptr<transfer> answer = std::make_shared<transfer>();
+		answer->queue = std::make_shared<chunk_queue>();
+		ft_scheduler::flow_id id = &client_socket;
+		commits->waiters.push_back(
+			[this, queue = answer->queue, id](bool success)
+			{
+				{
+					std::lock_guard<std::mutex> answer_lock(queue->mutex);
+					queue->chunks.push_back(std::vector<char>(1, success ? 'y' : 'n'));
+					queue->produced = true;
+				}
+				m_scheduler.resume(id);
+			}
+		);
+		lock.unlock();
+		start_transfer(client_socket, std::move(answer));
+		return;
+	}
+
+	// on an io thread when sync was made metadata, the wait is bounded by the sync latency
+	commits->condition.wait(lock, [&]() { return commits->pending == 0; });
+	char c = commits->failed ? 'n' : 'y';
+	commits->failed = false;
+	lock.unlock();
+	write_response(client_socket, &c, 1);
 }
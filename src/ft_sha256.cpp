@@ -0,0 +1,150 @@
+#include "ft_sha256.hpp"
+
+
+namespace
+{
+	constexpr std::uint32_t round_constants[64] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+	};
+
+	inline std::uint32_t rotate_right(std::uint32_t x, int n) noexcept
+	{
+		return (x >> n) | (x << (32 - n));
+	}
+}
+
+
+void ft_sha256::reset() noexcept
+{
+	m_state[0] = 0x6a09e667; m_state[1] = 0xbb67ae85; m_state[2] = 0x3c6ef372; m_state[3] = 0xa54ff53a;
+	m_state[4] = 0x510e527f; m_state[5] = 0x9b05688c; m_state[6] = 0x1f83d9ab; m_state[7] = 0x5be0cd19;
+	m_block_size = 0;
+	m_total_size = 0;
+}
+
+void ft_sha256::update(const void* const ptr, std::size_t n) noexcept
+{
+	const std::uint8_t* bytes = static_cast<const std::uint8_t*>(ptr);
+	m_total_size += n;
+
+	// top up a partial block first
+	if (m_block_size != 0)
+	{
+		std::size_t count = std::min(n, 64 - m_block_size);
+		std::memcpy(m_block + m_block_size, bytes, count);
+		m_block_size += count;
+		bytes += count;
+		n -= count;
+		if (m_block_size == 64)
+		{
+			compress(m_block);
+			m_block_size = 0;
+		}
+	}
+
+	// whole blocks straight from the input
+	while (n >= 64)
+	{
+		compress(bytes);
+		bytes += 64;
+		n -= 64;
+	}
+
+	if (n != 0)
+	{
+		std::memcpy(m_block, bytes, n);
+		m_block_size = n;
+	}
+}
+
+ft_sha256::digest ft_sha256::finish() noexcept
+{
+	std::uint64_t total_bits = m_total_size * 8;
+
+	m_block[m_block_size++] = 0x80;
+	if (m_block_size > 56)
+	{
+		std::memset(m_block + m_block_size, 0, 64 - m_block_size);
+		compress(m_block);
+		m_block_size = 0;
+	}
+	std::memset(m_block + m_block_size, 0, 56 - m_block_size);
+	for (int n = 0; n < 8; n++)
+	{
+		m_block[56 + n] = static_cast<std::uint8_t>(total_bits >> (56 - 8 * n));
+	}
+	compress(m_block);
+
+	digest ret;
+	for (int n = 0; n < 8; n++)
+	{
+		ret[4 * n] = static_cast<std::uint8_t>(m_state[n] >> 24);
+		ret[4 * n + 1] = static_cast<std::uint8_t>(m_state[n] >> 16);
+		ret[4 * n + 2] = static_cast<std::uint8_t>(m_state[n] >> 8);
+		ret[4 * n + 3] = static_cast<std::uint8_t>(m_state[n]);
+	}
+	reset();
+	return ret;
+}
+
+ft_sha256::digest ft_sha256::hash(const void* const ptr, std::size_t n) noexcept
+{
+	ft_sha256 hasher;
+	hasher.update(ptr, n);
+	return hasher.finish();
+}
+
+std::string ft_sha256::to_hex(const digest& value)
+{
+	constexpr const char* hex_digits = "0123456789abcdef";
+	std::string ret(2 * value.size(), 0);
+	for (std::size_t n = 0; n < value.size(); n++)
+	{
+		ret[2 * n] = hex_digits[value[n] >> 4];
+		ret[2 * n + 1] = hex_digits[value[n] & 15];
+	}
+	return ret;
+}
+
+
+void ft_sha256::compress(const std::uint8_t* block) noexcept
+{
+	std::uint32_t w[64];
+	for (int n = 0; n < 16; n++)
+	{
+		w[n] = (static_cast<std::uint32_t>(block[4 * n]) << 24) | (static_cast<std::uint32_t>(block[4 * n + 1]) << 16)
+			| (static_cast<std::uint32_t>(block[4 * n + 2]) << 8) | static_cast<std::uint32_t>(block[4 * n + 3]);
+	}
+	for (int n = 16; n < 64; n++)
+	{
+		std::uint32_t s0 = rotate_right(w[n - 15], 7) ^ rotate_right(w[n - 15], 18) ^ (w[n - 15] >> 3);
+		std::uint32_t s1 = rotate_right(w[n - 2], 17) ^ rotate_right(w[n - 2], 19) ^ (w[n - 2] >> 10);
+		w[n] = w[n - 16] + s0 + w[n - 7] + s1;
+	}
+
+	std::uint32_t a = m_state[0], b = m_state[1], c = m_state[2], d = m_state[3];
+	std::uint32_t e = m_state[4], f = m_state[5], g = m_state[6], h = m_state[7];
+
+	for (int n = 0; n < 64; n++)
+	{
+		std::uint32_t s1 = rotate_right(e, 6) ^ rotate_right(e, 11) ^ rotate_right(e, 25);
+		std::uint32_t ch = (e & f) ^ (~e & g);
+		std::uint32_t temp1 = h + s1 + ch + round_constants[n] + w[n];
+		std::uint32_t s0 = rotate_right(a, 2) ^ rotate_right(a, 13) ^ rotate_right(a, 22);
+		std::uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		std::uint32_t temp2 = s0 + maj;
+
+		h = g; g = f; f = e; e = d + temp1;
+		d = c; c = b; b = a; a = temp1 + temp2;
+	}
+
+	m_state[0] += a; m_state[1] += b; m_state[2] += c; m_state[3] += d;
+	m_state[4] += e; m_state[5] += f; m_state[6] += g; m_state[7] += h;
+}
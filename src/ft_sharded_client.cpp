@@ -0,0 +1,275 @@
+#include "ft_sharded_client.hpp"
+
+
+ft_sharded_client::~ft_sharded_client()
+{
+	disconnect();
+}
+
+void ft_sharded_client::add_server(const std::string& ip, std::uint16_t port)
+{
+	// the score only depends on the address, the order servers are added in does not matter
+	server new_server;
+	std::string address = ip + ':' + std::to_string(port);
+	new_server.ip = ip;
+	new_server.port = port;
+	new_server.key = hash(address.data(), address.size(), 0);
+	new_server.client = std::make_unique<ft_client>();
+	m_servers.push_back(std::move(new_server));
+}
+
+void ft_sharded_client::set_replication_factor(std::size_t replication_factor) noexcept
+{
+	m_replication_factor = (replication_factor != 0) ? replication_factor : 1;
+}
+
+void ft_sharded_client::set_validation_function(std::function<std::int32_t(std::int32_t)> fn)
+{
+	m_validation_function = std::move(fn);
+}
+
+void ft_sharded_client::enable_client_validation(bool enable) noexcept
+{
+	m_client_validation_enabled = enable;
+}
+
+std::size_t ft_sharded_client::connect()
+{
+	std::vector<std::size_t> all(m_servers.size());
+	for (std::size_t n = 0; n < all.size(); n++)
+	{
+		all[n] = n;
+	}
+
+	for_each_parallel(all,
+		[&](std::size_t index)
+		{
+			server& target = m_servers[index];
+			target.client->enable_client_validation(m_client_validation_enabled);
+			target.client->set_validation_function(m_validation_function);
+			target.latency = target.client->connect(target.ip.c_str(), target.port);
+			if (target.latency < 1.0f / 0.0f)
+			{
+				target.latency = target.client->ping(m_ping_samples).average;
+			}
+		}
+	);
+
+	std::size_t connected = 0;
+	for (server& target : m_servers)
+	{
+		connected += target.client->connection_running() ? 1 : 0;
+	}
+	return connected;
+}
+
+void ft_sharded_client::disconnect()
+{
+	for (server& target : m_servers)
+	{
+		target.client->disconnect();
+	}
+}
+
+void ft_sharded_client::refresh_latencies()
+{
+	for (server& target : m_servers)
+	{
+		target.latency = target.client->ping(m_ping_samples).average;
+	}
+}
+
+std::size_t ft_sharded_client::number_of_servers() const noexcept
+{
+	return m_servers.size();
+}
+
+std::vector<std::size_t> ft_sharded_client::replicas(const std::string& file_name) const
+{
+	std::vector<std::pair<std::uint64_t, std::size_t>> scores(m_servers.size());
+	for (std::size_t n = 0; n < m_servers.size(); n++)
+	{
+		scores[n] = std::make_pair(hash(file_name.data(), file_name.size(), m_servers[n].key), n);
+	}
+
+	std::size_t count = std::min(m_replication_factor, scores.size());
+	std::partial_sort(scores.begin(), scores.begin() + count, scores.end(),
+		[](const std::pair<std::uint64_t, std::size_t>& a, const std::pair<std::uint64_t, std::size_t>& b) { return a.first > b.first; });
+
+	std::vector<std::size_t> indices(count);
+	for (std::size_t n = 0; n < count; n++)
+	{
+		indices[n] = scores[n].second;
+	}
+	return indices;
+}
+
+ft_client& ft_sharded_client::client(std::size_t index)
+{
+	return *m_servers[index].client;
+}
+
+bool ft_sharded_client::send_file(const std::string& file_name, const std::string& destination_file_name)
+{
+	std::vector<std::size_t> indices = replicas(destination_file_name);
+	std::vector<char> sent(indices.size(), 0);
+
+	for_each_parallel(indices,
+		[&](std::size_t index)
+		{
+			std::size_t slot = static_cast<std::size_t>(std::find(indices.begin(), indices.end(), index) - indices.begin());
+			// only the server's acknowledgement tells the file is in place
+			ft_client& target = *m_servers[index].client;
+			sent[slot] = (target.send_file(file_name, destination_file_name) && target.sync()) ? 1 : 0;
+		}
+	);
+
+	return !indices.empty() && (std::count(sent.begin(), sent.end(), 1) == static_cast<std::ptrdiff_t>(indices.size()));
+}
+
+bool ft_sharded_client::get_file(const std::string& file_name, const std::string& destination_file_name)
+{
+	for (std::size_t index : read_order(file_name))
+	{
+		if (m_servers[index].client->get_file(file_name, destination_file_name))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+char ft_sharded_client::check_file(const std::string& file_name)
+{
+	// a replica that missed the upload does not make the file missing, 'n' only once every replica answered so
+	char answer = 'u';
+	for (std::size_t index : read_order(file_name))
+	{
+		char c = m_servers[index].client->check_file(file_name);
+		if (c == 'y')
+		{
+			return c;
+		}
+		if (c == 'n')
+		{
+			answer = c;
+		}
+	}
+	return answer;
+}
+
+void ft_sharded_client::remove_file(const std::string& file_name)
+{
+	for (std::size_t index : replicas(file_name))
+	{
+		m_servers[index].client->remove_file(file_name);
+	}
+}
+
+std::string ft_sharded_client::get_list()
+{
+	std::vector<std::string> lists(m_servers.size());
+	std::vector<std::size_t> all(m_servers.size());
+	for (std::size_t n = 0; n < all.size(); n++)
+	{
+		all[n] = n;
+	}
+
+	for_each_parallel(all, [&](std::size_t index) { lists[index] = m_servers[index].client->get_list(); });
+	return merge_lists(lists);
+}
+
+std::string ft_sharded_client::get_list_from_path(const std::string& path)
+{
+	std::vector<std::string> lists(m_servers.size());
+	std::vector<std::size_t> all(m_servers.size());
+	for (std::size_t n = 0; n < all.size(); n++)
+	{
+		all[n] = n;
+	}
+
+	for_each_parallel(all, [&](std::size_t index) { lists[index] = m_servers[index].client->get_list_from_path(path); });
+	return merge_lists(lists);
+}
+
+
+std::uint64_t ft_sharded_client::hash(const char* ptr, std::size_t n, std::uint64_t seed) noexcept
+{
+	// FNV-1a then a splitmix64 finalizer so that close seeds still give unrelated scores
+	std::uint64_t h = 14695981039346656037ull ^ seed;
+	for (std::size_t k = 0; k < n; k++)
+	{
+		h ^= static_cast<std::uint8_t>(ptr[k]);
+		h *= 1099511628211ull;
+	}
+	h ^= seed;
+	h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+	h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+	return h ^ (h >> 31);
+}
+
+std::vector<std::size_t> ft_sharded_client::read_order(const std::string& file_name) const
+{
+	std::vector<std::size_t> indices = replicas(file_name);
+	std::stable_sort(indices.begin(), indices.end(),
+		[&](std::size_t a, std::size_t b) { return m_servers[a].latency < m_servers[b].latency; });
+	return indices;
+}
+
+template <class F>
+void ft_sharded_client::for_each_parallel(const std::vector<std::size_t>& indices, F&& function)
+{
+	// one thread per server, each ft_client is only ever used by one of them
+	if (indices.size() == 1)
+	{
+		function(indices[0]);
+		return;
+	}
+
+	std::vector<std::thread> threads;
+	threads.reserve(indices.size());
+	for (std::size_t index : indices)
+	{
+		threads.emplace_back([&function, index]() { function(index); });
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+std::string ft_sharded_client::merge_lists(const std::vector<std::string>& lists)
+{
+	std::vector<std::string> entries;
+	for (const std::string& list : lists)
+	{
+		std::size_t begin = 0;
+		while (begin < list.size())
+		{
+			std::size_t end = list.find(';', begin);
+			if (end == std::string::npos)
+			{
+				end = list.size();
+			}
+			if (end != begin)
+			{
+				entries.emplace_back(list, begin, end - begin);
+			}
+			begin = end + 1;
+		}
+	}
+	std::sort(entries.begin(), entries.end());
+	entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+	std::string merged;
+	for (const std::string& entry : entries)
+	{
+		merged += entry;
+		merged += ';';
+	}
+	if (!merged.empty())
+	{
+		merged.pop_back();
+	}
+	return merged;
+}
@@ -0,0 +1,430 @@
+#include "ft_swarm_peer.hpp"
+
+
+ft_swarm_peer::~ft_swarm_peer()
+{
+	stop();
+}
+
+void ft_swarm_peer::set_validation_function(std::function<std::int32_t(std::int32_t)> fn)
+{
+	m_validation_function = fn;
+	m_tracker.set_validation_function(std::move(fn));
+}
+
+void ft_swarm_peer::enable_client_validation(bool enable) noexcept
+{
+	m_client_validation_enabled = enable;
+	m_tracker.enable_client_validation(enable);
+}
+
+#ifdef FT_ENABLE_TLS
+bool ft_swarm_peer::enable_tls(const std::string& ca_file, const std::string& server_name, bool verify)
+{
+	return m_tracker.enable_tls(ca_file, server_name, verify);
+}
+#endif // FT_ENABLE_TLS
+
+bool ft_swarm_peer::start(std::uint16_t port)
+{
+	if (m_asio_acceptor != nullptr)
+	{
+		return true;
+	}
+
+	asio::error_code ec;
+	m_asio_acceptor = std::make_unique<asio::ip::tcp::acceptor>(m_asio_context);
+	asio::ip::tcp::endpoint endpoint(asio::ip::tcp::v4(), port);
+	m_asio_acceptor->open(endpoint.protocol(), ec);
+	if (!ec) { m_asio_acceptor->set_option(asio::socket_base::reuse_address(true), ec); }
+	if (!ec) { m_asio_acceptor->bind(endpoint, ec); }
+	if (!ec) { m_asio_acceptor->listen(asio::socket_base::max_listen_connections, ec); }
+	if (ec)
+	{
+		m_asio_acceptor.reset();
+		return false;
+	}
+	m_port = m_asio_acceptor->local_endpoint(ec).port();
+
+	accept();
+	m_thread = std::thread([&]() { m_asio_context.run(); });
+	return true;
+}
+
+void ft_swarm_peer::stop()
+{
+	m_asio_context.stop();
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+	m_asio_acceptor.reset();
+	m_peers.clear();
+	m_tracker.disconnect();
+}
+
+void ft_swarm_peer::set_download_timeout(std::chrono::milliseconds timeout) noexcept
+{
+	m_download_timeout = timeout;
+}
+
+std::uint16_t ft_swarm_peer::port() const noexcept
+{
+	return m_port;
+}
+
+float ft_swarm_peer::connect(const char* ip, std::uint16_t port)
+{
+	return m_tracker.connect(ip, port);
+}
+
+bool ft_swarm_peer::download(const std::string& file_name, const std::string& destination_file_name)
+{
+	if (m_port == 0)
+	{
+		return false;
+	}
+
+	// piece table
+	if (!m_tracker.exchange(ft_protocol::swarm_join, file_name, &m_port, sizeof(std::uint16_t))
+		|| (m_tracker.last_incoming_buffer_size() < ft_protocol::swarm_table_header_size))
+	{
+		return false;
+	}
+	std::uint64_t file_size;
+	std::uint32_t piece_size;
+	std::uint32_t number_of_pieces;
+	std::memcpy(&file_size, m_tracker.data(), sizeof(std::uint64_t));
+	std::memcpy(&piece_size, m_tracker.data() + sizeof(std::uint64_t), sizeof(std::uint32_t));
+	std::memcpy(&number_of_pieces, m_tracker.data() + sizeof(std::uint64_t) + sizeof(std::uint32_t), sizeof(std::uint32_t));
+	if (m_tracker.last_incoming_buffer_size() != ft_protocol::swarm_table_header_size + number_of_pieces * sizeof(ft_sha256::digest))
+	{
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_file_mutex);
+		if (m_file.is_open())
+		{
+			m_file.close();
+		}
+		m_file_name = file_name;
+		m_file_size = file_size;
+		m_piece_size = piece_size;
+		m_hashes.resize(number_of_pieces);
+		for (std::size_t n = 0; n < number_of_pieces; n++)
+		{
+			std::memcpy(m_hashes[n].data(), m_tracker.data() + ft_protocol::swarm_table_header_size + n * sizeof(ft_sha256::digest), sizeof(ft_sha256::digest));
+		}
+		m_have.assign(number_of_pieces, 0);
+
+		// full size up front, pieces land at their offset in any order
+		m_file.open(destination_file_name, std::ios::out | std::ios::binary | std::ios::trunc);
+		m_file.close();
+		std::error_code ec;
+		std::filesystem::resize_file(destination_file_name, file_size, ec);
+		m_file.open(destination_file_name, std::ios::in | std::ios::out | std::ios::binary);
+		if (ec || !m_file.is_open())
+		{
+			return false;
+		}
+	}
+
+	std::size_t received = 0;
+	std::size_t idle_rounds = 0;
+	std::chrono::steady_clock::time_point last_progress = std::chrono::steady_clock::now();
+	while (true)
+	{
+		std::vector<std::pair<std::uint32_t, std::string>> plan;
+		if (!send_plan_request(plan))
+		{
+			return false;
+		}
+		if (received == number_of_pieces)
+		{
+			// the last plan request told the server about the last pieces
+			break;
+		}
+
+		std::size_t received_before = received;
+		for (const std::pair<std::uint32_t, std::string>& item : plan)
+		{
+			received += fetch_piece(item.first, item.second) ? 1 : 0;
+		}
+
+		// everything left is being seeded to other peers, wait for it to spread, but not forever
+		if (received == received_before)
+		{
+			if (std::chrono::steady_clock::now() - last_progress > m_download_timeout)
+			{
+				return false;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(std::min<std::size_t>(++idle_rounds, 20)));
+		}
+		else
+		{
+			idle_rounds = 0;
+			last_progress = std::chrono::steady_clock::now();
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(m_file_mutex);
+	m_file.flush();
+	return m_file.good();
+}
+
+
+void ft_swarm_peer::accept()
+{
+	m_asio_acceptor->async_accept(
+		[&](std::error_code ec, asio::ip::tcp::socket new_socket)
+		{
+			if (!ec)
+			{
+				new_socket.set_option(asio::socket_base::keep_alive(true));
+				std::shared_ptr<connection> client = std::make_shared<connection>(new_socket);
+				char hello[ft_protocol::hello_size];
+				ft_protocol::encode_hello(hello);
+				asio::error_code write_ec;
+				asio::write(client->socket, asio::buffer(hello, sizeof(hello)), write_ec);
+				if (!write_ec && m_client_validation_enabled)
+				{
+					handle_validation(client);
+				}
+				else if (!write_ec)
+				{
+					handle_request(client);
+				}
+			}
+			accept();
+		}
+	);
+}
+
+void ft_swarm_peer::handle_validation(std::shared_ptr<connection> client)
+{
+	// same handshake as ft_server, without sessions : the token is 0 so a reconnection does the full handshake
+	client->challenge = std::uniform_int_distribution<>(-(1 << 30), (1 << 30))(mt);
+	asio::error_code ec;
+	asio::write(client->socket, asio::buffer(&client->challenge, sizeof(std::int32_t)), ec);
+	if (ec)
+	{
+		return;
+	}
+
+	asio::async_read(client->socket, asio::buffer(client->header, 4 * sizeof(char) + sizeof(std::int32_t)),
+		[this, client](std::error_code ec, std::size_t incoming_buffer_length)
+		{
+			std::int32_t answer_number;
+			std::memcpy(&answer_number, client->header + 4, sizeof(std::int32_t));
+			if (ec || (ft_protocol::decode_request_header(client->header).opcode != ft_protocol::vali)
+				|| (answer_number != m_validation_function(client->challenge)))
+			{
+				return;
+			}
+
+			std::uint64_t token = 0;
+			asio::error_code write_ec;
+			asio::write(client->socket, asio::buffer(&token, sizeof(std::uint64_t)), write_ec);
+			if (!write_ec)
+			{
+				handle_request(client);
+			}
+		}
+	);
+}
+
+void ft_swarm_peer::handle_request(std::shared_ptr<connection> client)
+{
+	asio::async_read(client->socket, asio::buffer(client->header, ft_protocol::request_header_size),
+		[this, client](std::error_code ec, std::size_t incoming_buffer_length)
+		{
+			ft_protocol::request_header header = ft_protocol::decode_request_header(client->header);
+			if (ec || (header.name_size > 4096) || (header.payload_size > sizeof(std::uint32_t)))
+			{
+				return;
+			}
+			client->body.resize(static_cast<std::size_t>(header.name_size + header.payload_size));
+
+			asio::async_read(client->socket, asio::buffer(client->body.data(), client->body.size()),
+				[this, client, header](std::error_code ec, std::size_t incoming_buffer_length)
+				{
+					if (ec)
+					{
+						return;
+					}
+
+					if (header.opcode == ft_protocol::ping)
+					{
+						client->response.assign(1, 'p');
+					}
+					else if (header.opcode == ft_protocol::peer_piece)
+					{
+						std::uint32_t piece = 0;
+						std::string_view name(client->body.data(), header.name_size);
+						if (header.payload_size == sizeof(std::uint32_t))
+						{
+							std::memcpy(&piece, client->body.data() + header.name_size, sizeof(std::uint32_t));
+						}
+
+						// only pieces that are written and checked, read right after the size they are sent with
+						std::uint64_t size = ft_protocol::no_content;
+						client->response.resize(sizeof(std::uint64_t));
+						{
+							std::lock_guard<std::mutex> lock(m_file_mutex);
+							if ((name == m_file_name) && (header.payload_size == sizeof(std::uint32_t))
+								&& (piece < m_have.size()) && (m_have[piece] != 0))
+							{
+								std::uint64_t offset = static_cast<std::uint64_t>(piece) * m_piece_size;
+								size = std::min<std::uint64_t>(m_piece_size, m_file_size - offset);
+								client->response.resize(sizeof(std::uint64_t) + static_cast<std::size_t>(size));
+								m_file.seekg(static_cast<std::streamoff>(offset));
+								m_file.read(client->response.data() + sizeof(std::uint64_t), static_cast<std::streamsize>(size));
+								if (!m_file.good())
+								{
+									m_file.clear();
+									size = ft_protocol::no_content;
+									client->response.resize(sizeof(std::uint64_t));
+								}
+							}
+						}
+						std::memcpy(client->response.data(), &size, sizeof(std::uint64_t));
+						if (size != ft_protocol::no_content)
+						{
+							m_bytes_served += size;
+						}
+					}
+					else
+					{
+						return;
+					}
+
+					write_response(client);
+				}
+			);
+		}
+	);
+}
+
+void ft_swarm_peer::write_response(std::shared_ptr<connection> client)
+{
+	// a slow peer only holds back its own connection, the loop goes on serving the others meanwhile
+	asio::async_write(client->socket, asio::buffer(client->response.data(), client->response.size()),
+		[this, client](std::error_code ec, std::size_t bytes_written)
+		{
+			if (!ec)
+			{
+				handle_request(client);
+			}
+		}
+	);
+}
+
+bool ft_swarm_peer::send_plan_request(std::vector<std::pair<std::uint32_t, std::string>>& plan)
+{
+	std::vector<char> payload(sizeof(std::uint16_t));
+	std::memcpy(payload.data(), &m_port, sizeof(std::uint16_t));
+	{
+		std::lock_guard<std::mutex> lock(m_file_mutex);
+		payload.insert(payload.end(), m_have.begin(), m_have.end());
+	}
+
+	if (!m_tracker.exchange(ft_protocol::swarm_plan, m_file_name, payload.data(), payload.size()))
+	{
+		return false;
+	}
+
+	const char* ptr = m_tracker.data();
+	std::size_t n = m_tracker.last_incoming_buffer_size();
+	while (n >= sizeof(std::uint32_t) + sizeof(std::uint16_t))
+	{
+		std::uint32_t piece;
+		std::uint16_t source_size;
+		std::memcpy(&piece, ptr, sizeof(std::uint32_t));
+		std::memcpy(&source_size, ptr + sizeof(std::uint32_t), sizeof(std::uint16_t));
+		ptr += sizeof(std::uint32_t) + sizeof(std::uint16_t);
+		n -= sizeof(std::uint32_t) + sizeof(std::uint16_t);
+		if (n < source_size)
+		{
+			return false;
+		}
+		plan.emplace_back(piece, std::string(ptr, source_size));
+		ptr += source_size;
+		n -= source_size;
+	}
+	return n == 0;
+}
+
+bool ft_swarm_peer::fetch_piece(std::uint32_t piece, const std::string& source)
+{
+	if (piece >= m_hashes.size())
+	{
+		return false;
+	}
+
+	ft_client* client = source.empty() ? &m_tracker : peer(source);
+	if ((client == nullptr) || !client->exchange(source.empty() ? ft_protocol::swarm_piece : ft_protocol::peer_piece,
+		m_file_name, &piece, sizeof(std::uint32_t)))
+	{
+		if (client != &m_tracker)
+		{
+			m_peers.erase(source);
+		}
+		return false;
+	}
+
+	// whatever the source, the piece has to match the hash the server gave
+	std::uint64_t offset = static_cast<std::uint64_t>(piece) * m_piece_size;
+	std::size_t expected_size = static_cast<std::size_t>(std::min<std::uint64_t>(m_piece_size, m_file_size - offset));
+	if ((client->last_incoming_buffer_size() != expected_size) || (ft_sha256::hash(client->data(), expected_size) != m_hashes[piece]))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(m_file_mutex);
+	m_file.seekp(static_cast<std::streamoff>(offset));
+	m_file.write(client->data(), static_cast<std::streamsize>(expected_size));
+	m_file.flush();
+	if (!m_file.good())
+	{
+		m_file.clear();
+		return false;
+	}
+	m_have[piece] = 1;
+	(source.empty() ? m_bytes_from_server : m_bytes_from_peers) += expected_size;
+	return true;
+}
+
+ft_client* ft_swarm_peer::peer(const std::string& address)
+{
+	std::unordered_map<std::string, std::unique_ptr<ft_client>>::iterator iter = m_peers.find(address);
+	if (iter != m_peers.end())
+	{
+		return iter->second.get();
+	}
+
+	std::size_t colon = address.rfind(':');
+	if (colon == std::string::npos)
+	{
+		return nullptr;
+	}
+
+	// a peer that went away is dropped at once, the server hands the piece to someone else
+	std::unique_ptr<ft_client> client = std::make_unique<ft_client>();
+	client->enable_client_validation(m_client_validation_enabled);
+	client->set_validation_function(m_validation_function);
+	client->set_reconnect_policy(false, 0, std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+	// the address comes from the server, anything but a port after the colon is ignored
+	std::uint16_t port = 0;
+	const char* port_end = address.data() + address.size();
+	std::from_chars_result result = std::from_chars(address.data() + colon + 1, port_end, port);
+	if ((result.ec != std::errc()) || (result.ptr != port_end) || (port == 0))
+	{
+		return nullptr;
+	}
+	if (!(client->connect(address.substr(0, colon).c_str(), port) < 1.0f / 0.0f))
+	{
+		return nullptr;
+	}
+	return (m_peers[address] = std::move(client)).get();
+}
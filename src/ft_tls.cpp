@@ -0,0 +1,178 @@
+#include "ft_tls.hpp"
+
+#ifdef FT_ENABLE_TLS
+
+#ifdef __linux__
+#include <sys/types.h>
+#endif // __linux__
+
+
+ft_tls_context::~ft_tls_context()
+{
+	if (m_context != nullptr)
+	{
+		SSL_CTX_free(m_context);
+	}
+}
+
+bool ft_tls_context::init_server(const std::string& certificate_file, const std::string& private_key_file)
+{
+	m_context = SSL_CTX_new(TLS_server_method());
+	if (m_context == nullptr)
+	{
+		return false;
+	}
+	SSL_CTX_set_min_proto_version(m_context, TLS1_2_VERSION);
+	SSL_CTX_set_mode(m_context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_ENABLE_KTLS
+	SSL_CTX_set_options(m_context, SSL_OP_ENABLE_KTLS);
+#endif // SSL_OP_ENABLE_KTLS
+
+	// a ticket sent after the handshake is not application data, a kernel offloaded socket read like a plain one
+	// could not step over it
+	SSL_CTX_set_options(m_context, SSL_OP_NO_TICKET);
+	SSL_CTX_set_num_tickets(m_context, 0);
+
+	if ((SSL_CTX_use_certificate_chain_file(m_context, certificate_file.c_str()) != 1)
+		|| (SSL_CTX_use_PrivateKey_file(m_context, private_key_file.c_str(), SSL_FILETYPE_PEM) != 1)
+		|| (SSL_CTX_check_private_key(m_context) != 1))
+	{
+		SSL_CTX_free(m_context);
+		m_context = nullptr;
+		return false;
+	}
+	return true;
+}
+
+bool ft_tls_context::init_client(const std::string& ca_file, bool verify)
+{
+	m_context = SSL_CTX_new(TLS_client_method());
+	if (m_context == nullptr)
+	{
+		return false;
+	}
+	SSL_CTX_set_min_proto_version(m_context, TLS1_2_VERSION);
+	SSL_CTX_set_mode(m_context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_ENABLE_KTLS
+	SSL_CTX_set_options(m_context, SSL_OP_ENABLE_KTLS);
+#endif // SSL_OP_ENABLE_KTLS
+
+	if (verify)
+	{
+		SSL_CTX_set_verify(m_context, SSL_VERIFY_PEER, nullptr);
+		int loaded = ca_file.empty() ? SSL_CTX_set_default_verify_paths(m_context)
+			: SSL_CTX_load_verify_locations(m_context, ca_file.c_str(), nullptr);
+		if (loaded != 1)
+		{
+			SSL_CTX_free(m_context);
+			m_context = nullptr;
+			return false;
+		}
+	}
+	else
+	{
+		SSL_CTX_set_verify(m_context, SSL_VERIFY_NONE, nullptr);
+	}
+	return true;
+}
+
+
+ft_tls_session::ft_tls_session(SSL_CTX* context, int fd, bool server, const std::string& server_name)
+{
+	ssl = SSL_new(context);
+	if (ssl == nullptr)
+	{
+		return;
+	}
+
+	// a socket BIO, the kernel can only take over records that OpenSSL writes to the socket itself
+	SSL_set_fd(ssl, fd);
+	if (server)
+	{
+		SSL_set_accept_state(ssl);
+	}
+	else
+	{
+		SSL_set_connect_state(ssl);
+		// a literal address is checked against the address entries of the certificate and never sent as SNI
+		if (!server_name.empty() && (X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), server_name.c_str()) != 1))
+		{
+			SSL_set_tlsext_host_name(ssl, server_name.c_str());
+			SSL_set1_host(ssl, server_name.c_str());
+		}
+	}
+}
+
+ft_tls_session::~ft_tls_session()
+{
+	if (ssl != nullptr)
+	{
+		SSL_free(ssl);
+	}
+}
+
+ft_tls_session::status ft_tls_session::handshake_step()
+{
+	if (ssl == nullptr)
+	{
+		return status::failed;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	return to_status(SSL_do_handshake(ssl));
+}
+
+void ft_tls_session::check_offload()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	ktls_send = BIO_get_ktls_send(SSL_get_wbio(ssl)) != 0;
+
+	// bytes OpenSSL already decrypted have to be read through it
+	ktls_recv = (BIO_get_ktls_recv(SSL_get_rbio(ssl)) != 0) && (SSL_has_pending(ssl) == 0);
+}
+
+ft_tls_session::status ft_tls_session::read_some(void* ptr, std::size_t n, std::size_t& transferred)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	transferred = 0;
+	return to_status(SSL_read_ex(ssl, ptr, n, &transferred));
+}
+
+ft_tls_session::status ft_tls_session::write_some(const void* ptr, std::size_t n, std::size_t& transferred)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	transferred = 0;
+	return to_status(SSL_write_ex(ssl, ptr, n, &transferred));
+}
+
+ft_tls_session::status ft_tls_session::sendfile(int file_fd, std::uint64_t offset, std::size_t n, std::size_t& transferred)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	transferred = 0;
+#if defined(__linux__) && !defined(OPENSSL_NO_KTLS)
+	ossl_ssize_t sent = SSL_sendfile(ssl, file_fd, static_cast<off_t>(offset), n, 0);
+	if (sent > 0)
+	{
+		transferred = static_cast<std::size_t>(sent);
+		return status::done;
+	}
+	return to_status(static_cast<int>(sent));
+#else
+	return status::failed;
+#endif // __linux__
+}
+
+ft_tls_session::status ft_tls_session::to_status(int result)
+{
+	if (result > 0)
+	{
+		return status::done;
+	}
+	switch (SSL_get_error(ssl, result))
+	{
+	case SSL_ERROR_WANT_READ: return status::want_read;
+	case SSL_ERROR_WANT_WRITE: return status::want_write;
+	default: ERR_clear_error(); return status::failed;
+	}
+}
+
+#endif // FT_ENABLE_TLS
@@ -0,0 +1,243 @@
+#include "ft_watcher.hpp"
+
+#ifdef __linux__
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+
+ft_watcher::~ft_watcher()
+{
+	stop();
+}
+
+bool ft_watcher::start(callback fn)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_running)
+	{
+		return true;
+	}
+
+	m_inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	m_wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if ((m_inotify_fd < 0) || (m_wake_fd < 0))
+	{
+		if (m_inotify_fd >= 0) { ::close(m_inotify_fd); m_inotify_fd = -1; }
+		if (m_wake_fd >= 0) { ::close(m_wake_fd); m_wake_fd = -1; }
+		return false;
+	}
+
+	m_callback = std::move(fn);
+	m_running = true;
+	m_thread = std::thread([&]() { run(); });
+	return true;
+}
+
+void ft_watcher::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_running)
+		{
+			return;
+		}
+		m_running = false;
+	}
+
+	std::uint64_t one = 1;
+	if (::write(m_wake_fd, &one, sizeof(std::uint64_t)) < 0) {}
+	if (m_thread.joinable())
+	{
+		m_thread.join();
+	}
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	::close(m_inotify_fd);
+	::close(m_wake_fd);
+	m_inotify_fd = -1;
+	m_wake_fd = -1;
+	m_directories.clear();
+	m_watches.clear();
+	m_pending.clear();
+}
+
+bool ft_watcher::add_watch(const std::string& directory)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_running)
+	{
+		return false;
+	}
+
+	std::unordered_map<std::string, std::pair<int, std::size_t>>::iterator iter = m_watches.find(directory);
+	if (iter != m_watches.end())
+	{
+		iter->second.second++;
+		return true;
+	}
+
+	int wd = ::inotify_add_watch(m_inotify_fd, directory.c_str(),
+		IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_MODIFY | IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR);
+	if (wd < 0)
+	{
+		return false;
+	}
+	m_watches[directory] = std::make_pair(wd, std::size_t(1));
+	m_directories[wd] = directory;
+	return true;
+}
+
+void ft_watcher::remove_watch(const std::string& directory)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::unordered_map<std::string, std::pair<int, std::size_t>>::iterator iter = m_watches.find(directory);
+	if ((iter != m_watches.end()) && (--iter->second.second == 0))
+	{
+		int wd = iter->second.first;
+		::inotify_rm_watch(m_inotify_fd, wd);
+		m_directories.erase(wd);
+		m_pending.erase(wd);
+		m_watches.erase(iter);
+	}
+}
+
+void ft_watcher::set_interval(std::chrono::milliseconds interval) noexcept
+{
+	m_interval = interval;
+}
+
+
+void ft_watcher::run()
+{
+	std::chrono::steady_clock::time_point next_flush = std::chrono::steady_clock::now();
+
+	while (true)
+	{
+		int timeout = -1;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_running)
+			{
+				return;
+			}
+			if (!m_pending.empty())
+			{
+				timeout = static_cast<int>(std::max<std::int64_t>(0,
+					std::chrono::duration_cast<std::chrono::milliseconds>(next_flush - std::chrono::steady_clock::now()).count()));
+			}
+		}
+
+		pollfd fds[2] = { { m_inotify_fd, POLLIN, 0 }, { m_wake_fd, POLLIN, 0 } };
+		if (::poll(fds, 2, timeout) < 0)
+		{
+			continue;
+		}
+		if ((fds[0].revents & POLLIN) != 0)
+		{
+			read_events();
+		}
+
+		// deliver at most once per interval, whatever happened in between is merged per file
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now < next_flush)
+		{
+			continue;
+		}
+
+		std::vector<std::pair<std::string, std::vector<event>>> batches;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			for (auto& pending : m_pending)
+			{
+				std::unordered_map<int, std::string>::iterator directory = m_directories.find(pending.first);
+				if (directory == m_directories.end())
+				{
+					continue;
+				}
+				std::vector<event> events;
+				events.reserve(pending.second.size());
+				for (auto& item : pending.second)
+				{
+					events.push_back(event{ item.second, item.first });
+				}
+				batches.emplace_back(directory->second, std::move(events));
+			}
+			m_pending.clear();
+		}
+
+		if (!batches.empty())
+		{
+			for (auto& batch : batches)
+			{
+				m_callback(batch.first, batch.second);
+			}
+			next_flush = now + m_interval;
+		}
+	}
+}
+
+void ft_watcher::read_events()
+{
+	alignas(inotify_event) char buffer[16 * 1024];
+
+	while (true)
+	{
+		ssize_t length = ::read(m_inotify_fd, buffer, sizeof(buffer));
+		if (length <= 0)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		for (char* ptr = buffer; ptr < buffer + length;)
+		{
+			inotify_event* item = reinterpret_cast<inotify_event*>(ptr);
+			ptr += sizeof(inotify_event) + item->len;
+
+			if ((item->len == 0) || (m_directories.count(item->wd) == 0))
+			{
+				continue;
+			}
+
+			// files the server is still writing are not interesting
+			std::string name(item->name);
+			if ((name.find(".ft_tmp") != std::string::npos) || (name.find(".ft_part") != std::string::npos))
+			{
+				continue;
+			}
+
+			char kind;
+			if ((item->mask & (IN_DELETE | IN_MOVED_FROM)) != 0) { kind = 'r'; }
+			else if ((item->mask & (IN_CREATE | IN_MOVED_TO)) != 0) { kind = 'c'; }
+			else { kind = 'm'; }
+
+			// a file created then written in the same interval is still reported as created
+			char& pending_kind = m_pending[item->wd][name];
+			if (!((pending_kind == 'c') && (kind == 'm')))
+			{
+				pending_kind = kind;
+			}
+		}
+	}
+}
+
+#else
+
+// no inotify, watch requests are refused
+
+ft_watcher::~ft_watcher() {}
+
+bool ft_watcher::start(callback fn) { return false; }
+
+void ft_watcher::stop() {}
+
+bool ft_watcher::add_watch(const std::string& directory) { return false; }
+
+void ft_watcher::remove_watch(const std::string& directory) {}
+
+void ft_watcher::set_interval(std::chrono::milliseconds interval) noexcept { m_interval = interval; }
+
+#endif // __linux__
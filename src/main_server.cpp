@@ -14,7 +14,7 @@ int main()
 		std::system("cls");
 #endif // WIN
 #ifdef __linux__
-		std::system("clear")
+		std::system("clear");
 #endif // __linux__
 		std::cout << "FT server running. "; SV.info();
 		std::this_thread::sleep_for(std::chrono::milliseconds(1000));
@@ -0,0 +1,172 @@
+#ifndef FT_TEST_HPP
+#define FT_TEST_HPP
+
+#include "ft_includes.hpp"
+#include "ft_server.hpp"
+#include "ft_client.hpp"
+
+#include <csignal>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// loopback test helpers : every server runs in a forked process inside its own directory, so that servers never
+// share files, they must be spawned before the test starts any thread of its own
+
+inline int ft_test_failures = 0;
+
+#define FT_CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::cerr << __FILE__ << ':' << __LINE__ << " : check failed : " #condition << std::endl; \
+			ft_test_failures++; \
+		} \
+	} while (false)
+
+inline int ft_test_result()
+{
+	std::cout << (ft_test_failures == 0 ? "passed" : "FAILED") << std::endl;
+	return (ft_test_failures == 0) ? 0 : 1;
+}
+
+// an empty scratch directory under the system temp directory
+inline std::string ft_test_directory(const std::string& name)
+{
+	std::filesystem::path path = std::filesystem::temp_directory_path() / ("ft_test_" + name + '_' + std::to_string(::getpid()));
+	std::error_code ec;
+	std::filesystem::remove_all(path, ec);
+	std::filesystem::create_directories(path, ec);
+	return path.string();
+}
+
+inline bool ft_test_write(const std::string& file_name, const std::string& content)
+{
+	std::ofstream file(file_name, std::ios::binary | std::ios::trunc);
+	file.write(content.data(), static_cast<std::streamsize>(content.size()));
+	return static_cast<bool>(file);
+}
+
+inline std::string ft_test_read(const std::string& file_name)
+{
+	std::ifstream file(file_name, std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// n pseudo random bytes, the same for the same seed
+inline std::string ft_test_content(std::size_t n, std::uint32_t seed)
+{
+	std::mt19937 rng(seed);
+	std::string content(n, '\0');
+	for (char& c : content)
+	{
+		c = static_cast<char>(rng() & 255);
+	}
+	return content;
+}
+
+class ft_test_server
+{
+
+public:
+
+	pid_t pid = -1;
+	std::uint16_t port = 0;
+	std::string directory;
+
+	ft_test_server() = default;
+	ft_test_server(const ft_test_server&) = delete;
+	ft_test_server& operator=(const ft_test_server&) = delete;
+	ft_test_server(ft_test_server&&) = delete;
+	ft_test_server& operator=(ft_test_server&&) = delete;
+	~ft_test_server() { kill(); }
+
+	// forks a server working in new_directory, created empty, configure is called on it before start
+	bool spawn(const std::string& new_directory, const std::function<void(ft_server&)>& configure = nullptr)
+	{
+		directory = std::filesystem::absolute(new_directory).string();
+		std::error_code ec;
+		std::filesystem::remove_all(directory, ec);
+		std::filesystem::create_directories(directory, ec);
+		m_configure = configure;
+
+		// the first free port from a pid dependent base, so that concurrent test runs rarely collide
+		std::uint16_t first = static_cast<std::uint16_t>(20000 + (static_cast<unsigned>(::getpid()) * 37) % 20000);
+		return fork_server(first, static_cast<std::uint16_t>(first + 256));
+	}
+
+	// kills the server and starts a new one on the same port and directory, files are kept
+	bool restart()
+	{
+		kill();
+		return fork_server(port, static_cast<std::uint16_t>(port + 1));
+	}
+
+	// SIGKILL, nothing pending on the server is flushed
+	void kill()
+	{
+		if (pid > 0)
+		{
+			::kill(pid, SIGKILL);
+			::waitpid(pid, nullptr, 0);
+			pid = -1;
+		}
+	}
+
+	bool connect(ft_client& client) const
+	{
+		return client.connect("127.0.0.1", port) < 1.0f / 0.0f;
+	}
+
+private:
+
+	std::function<void(ft_server&)> m_configure;
+
+	bool fork_server(std::uint16_t first, std::uint16_t last)
+	{
+		int fds[2];
+		if (::pipe(fds) != 0)
+		{
+			return false;
+		}
+		pid = ::fork();
+		if (pid == 0)
+		{
+			::close(fds[0]);
+			std::error_code ec;
+			std::filesystem::current_path(directory, ec);
+			ft_server server;
+			if (m_configure)
+			{
+				m_configure(server);
+			}
+			for (std::uint16_t candidate = first; candidate < last; candidate++)
+			{
+				if (server.start(candidate, 2))
+				{
+					ssize_t written = ::write(fds[1], &candidate, sizeof(std::uint16_t));
+					(void)written;
+					break;
+				}
+			}
+			::close(fds[1]);
+			while (true)
+			{
+				::pause();
+			}
+		}
+
+		::close(fds[1]);
+		ssize_t n = (pid > 0) ? ::read(fds[0], &port, sizeof(std::uint16_t)) : 0;
+		::close(fds[0]);
+		if (n != sizeof(std::uint16_t))
+		{
+			kill();
+			return false;
+		}
+		return true;
+	}
+};
+
+#endif // FT_TEST_HPP
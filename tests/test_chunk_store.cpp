@@ -0,0 +1,115 @@
+#include "ft_test.hpp"
+#include "ft_swarm_peer.hpp"
+
+// stored files become manifests, read back chunk by chunk, plain files that only look like one are left alone
+
+int main()
+{
+	std::string root = ft_test_directory("chunk_store");
+
+	ft_test_server server;
+	FT_CHECK(server.spawn(root + "/server", [](ft_server& target)
+		{
+			target.enable_chunk_store(".ft_chunks");
+			target.set_archive_producers(1);
+		}));
+
+	ft_client client;
+	FT_CHECK(server.connect(client));
+
+	// two files sharing most of their content
+	std::string first = ft_test_content(2 * 1024 * 1024, 1);
+	std::string second = first.substr(0, 1024 * 1024) + ft_test_content(4096, 2) + first.substr(1024 * 1024);
+	FT_CHECK(ft_test_write(root + "/first", first));
+	FT_CHECK(ft_test_write(root + "/second", second));
+	FT_CHECK(client.send_file(root + "/first", "first"));
+	FT_CHECK(client.send_file_deduplicated(root + "/second", "second"));
+	FT_CHECK(client.sync());
+
+	std::string manifest = ft_test_read(server.directory + "/first");
+	FT_CHECK(ft_chunker::is_manifest(manifest.data(), manifest.size()));
+	FT_CHECK(client.get_file("first", root + "/first_back"));
+	FT_CHECK(ft_test_read(root + "/first_back") == first);
+	FT_CHECK(client.get_file("second", root + "/second_back"));
+	FT_CHECK(ft_test_read(root + "/second_back") == second);
+
+	// an empty file goes up as a plain one, a long chunk list is asked about over several "have"
+	FT_CHECK(ft_test_write(root + "/empty", ""));
+	FT_CHECK(client.send_file_deduplicated(root + "/empty", "empty"));
+	std::string third = second + ft_test_content(512 * 1024, 4);
+	FT_CHECK(ft_test_write(root + "/third", third));
+	client.set_have_batch_size(7);
+	FT_CHECK(client.send_file_deduplicated(root + "/third", "third"));
+	FT_CHECK(client.sync());
+	FT_CHECK(client.get_file("empty", root + "/empty_back"));
+	FT_CHECK(std::filesystem::exists(root + "/empty_back") && ft_test_read(root + "/empty_back").empty());
+	FT_CHECK(client.get_file("third", root + "/third_back"));
+	FT_CHECK(ft_test_read(root + "/third_back") == third);
+
+	// the magic alone does not make a manifest
+	std::string lookalike = std::string(ft_chunker::manifest_magic, 8) + ft_test_content(1000, 3);
+	FT_CHECK(ft_test_write(server.directory + "/lookalike", lookalike));
+	FT_CHECK(client.get_file("lookalike", root + "/lookalike_back"));
+	FT_CHECK(ft_test_read(root + "/lookalike_back") == lookalike);
+
+	// nor does a well formed one listing chunks the store does not have
+	std::vector<ft_chunker::chunk> chunks{ ft_chunker::chunk{ 0, 100, ft_sha256::hash("x", 1) } };
+	std::vector<char> orphan = ft_chunker::make_manifest(chunks, 100);
+	FT_CHECK(ft_test_write(server.directory + "/orphan", std::string(orphan.begin(), orphan.end())));
+	FT_CHECK(client.get_file("orphan", root + "/orphan_back"));
+	FT_CHECK(ft_test_read(root + "/orphan_back") == std::string(orphan.begin(), orphan.end()));
+
+	// appends extend the content of a stored file, the manifest stays one
+	FT_CHECK(client.append_text("appended\n", "first"));
+	FT_CHECK(client.append_text("again\n", "first"));
+	FT_CHECK(client.sync());
+	first += "appended\nagain\n";
+	manifest = ft_test_read(server.directory + "/first");
+	FT_CHECK(ft_chunker::is_manifest(manifest.data(), manifest.size()));
+	FT_CHECK(client.get_file("first", root + "/first_back"));
+	FT_CHECK(ft_test_read(root + "/first_back") == first);
+
+	// directory archives carry the content, not the manifests nor the chunks
+	FT_CHECK(client.get_directory(".", root + "/unpacked"));
+	FT_CHECK(ft_test_read(root + "/unpacked/first") == first);
+	FT_CHECK(ft_test_read(root + "/unpacked/second") == second);
+	FT_CHECK(ft_test_read(root + "/unpacked/lookalike") == lookalike);
+	FT_CHECK(!std::filesystem::exists(root + "/unpacked/.ft_chunks"));
+
+	// more archives than producers : the later ones wait for the producer instead of getting a thread each
+	std::vector<std::thread> readers;
+	std::atomic<int> archives_read{ 0 };
+	for (int n = 0; n < 4; n++)
+	{
+		readers.emplace_back(
+			[&, n]()
+			{
+				ft_client reader;
+				std::string destination = root + "/unpacked" + std::to_string(n);
+				if (server.connect(reader) && reader.get_directory(".", destination) && (ft_test_read(destination + "/second") == second))
+				{
+					archives_read++;
+				}
+			}
+		);
+	}
+	for (std::thread& reader : readers)
+	{
+		reader.join();
+	}
+	FT_CHECK(archives_read == 4);
+
+	// no swarm serves the raw bytes of a manifest, a plain file still gets one
+	ft_swarm_peer peer;
+	FT_CHECK(peer.start() && (peer.connect("127.0.0.1", server.port) < 1.0f / 0.0f));
+	FT_CHECK(!peer.download("first", root + "/first_swarm"));
+	FT_CHECK(peer.download("lookalike", root + "/lookalike_swarm"));
+	FT_CHECK(ft_test_read(root + "/lookalike_swarm") == lookalike);
+	peer.stop();
+
+	client.disconnect();
+	server.kill();
+	std::error_code ec;
+	std::filesystem::remove_all(root, ec);
+	return ft_test_result();
+}
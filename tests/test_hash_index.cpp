@@ -0,0 +1,64 @@
+#include "ft_test.hpp"
+#include "ft_hash_index.hpp"
+
+// entries are only trusted once hashed after their mtime tick, invalidate makes an entry stale at once
+
+// polls until the file is hashed, false after a few seconds
+static bool wait_hashed(ft_hash_index& index, const std::string& path, ft_hash_index::record& result)
+{
+	for (int n = 0; n < 500; n++)
+	{
+		if (index.lookup(path, result) && result.hashed)
+		{
+			return true;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return false;
+}
+
+int main()
+{
+	std::string root = ft_test_directory("hash_index");
+	std::string path = root + "/file";
+	std::string content = ft_test_content(100000, 1);
+	FT_CHECK(ft_test_write(path, content));
+
+	ft_hash_index index;
+	FT_CHECK(index.open(root + "/index", root));
+	index.start();
+
+	// not trusted while a write in the same timestamp tick could still go unseen
+	ft_hash_index::record result;
+	FT_CHECK(wait_hashed(index, path, result));
+	FT_CHECK(result.hash == ft_sha256::hash(content.data(), content.size()));
+	std::uint64_t size = 0;
+	std::int64_t mtime = 0;
+	FT_CHECK(ft_hash_index::file_status(path, size, mtime));
+	FT_CHECK(ft_hash_index::current_time() - mtime >= 1000000000);
+
+	// same size, stale as soon as the index is told
+	std::string rewritten = ft_test_content(100000, 2);
+	FT_CHECK(ft_test_write(path, rewritten));
+	index.invalidate(path);
+	FT_CHECK(index.lookup(path, result) && !result.hashed);
+	FT_CHECK(wait_hashed(index, path, result));
+	FT_CHECK(result.hash == ft_sha256::hash(rewritten.data(), rewritten.size()));
+
+	// truncated while it is hashed, read and not mapped : hashed again instead of faulting
+	std::error_code ec;
+	std::string large = ft_test_content(64 * 1024 * 1024, 3);
+	FT_CHECK(ft_test_write(path, large));
+	index.invalidate(path);
+	FT_CHECK(index.lookup(path, result) && !result.hashed);
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	std::filesystem::resize_file(path, 1000, ec);
+	FT_CHECK(!ec);
+	FT_CHECK(wait_hashed(index, path, result));
+	FT_CHECK(result.hash == ft_sha256::hash(large.data(), 1000));
+
+	index.stop();
+	index.close();
+	std::filesystem::remove_all(root, ec);
+	return ft_test_result();
+}
@@ -0,0 +1,75 @@
+#include "ft_test.hpp"
+#include "ft_log_ingest.hpp"
+
+// buffered appends, rotation across restarts
+
+int main()
+{
+	std::string root = ft_test_directory("log_ingest");
+	std::string log = root + "/log";
+
+	// concurrent appenders, every line lands whole and the lines of one thread stay in order
+	{
+		ft_log_ingest ingest;
+		ingest.set_flush_size(4096);
+		ingest.set_flush_interval(std::chrono::milliseconds(2));
+		ingest.start();
+
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; t++)
+		{
+			threads.emplace_back([&ingest, &log, t]()
+				{
+					for (int n = 0; n < 2000; n++)
+					{
+						std::string line = std::to_string(t) + ' ' + std::to_string(n) + '\n';
+						ingest.append(log, line.data(), line.size());
+					}
+				});
+		}
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+		ingest.stop();
+
+		std::istringstream lines(ft_test_read(log));
+		std::vector<int> next(4, 0);
+		int t = 0;
+		int n = 0;
+		std::size_t count = 0;
+		while (lines >> t >> n)
+		{
+			FT_CHECK((t >= 0) && (t < 4) && (next[t] == n));
+			if ((t >= 0) && (t < 4)) { next[t] = n + 1; }
+			count++;
+		}
+		FT_CHECK(count == 8000);
+	}
+
+	// rotated files of an earlier run are never overwritten
+	std::error_code ec;
+	std::filesystem::remove(log, ec);
+	for (int run = 0; run < 2; run++)
+	{
+		ft_log_ingest ingest;
+		ingest.set_flush_size(1);
+		ingest.set_rotation_size(100);
+		ingest.start();
+		for (int n = 0; n < 3; n++)
+		{
+			std::string line = std::string(80, static_cast<char>('a' + 3 * run + n)) + '\n';
+			ingest.append(log, line.data(), line.size());
+		}
+		ingest.stop();
+	}
+	FT_CHECK(ft_test_read(log) == std::string(80, 'f') + '\n');
+	for (int n = 0; n < 5; n++)
+	{
+		FT_CHECK(ft_test_read(log + '.' + std::to_string(n)) == std::string(80, static_cast<char>('a' + n)) + '\n');
+	}
+	FT_CHECK(!std::filesystem::exists(log + ".5"));
+
+	std::filesystem::remove_all(root, ec);
+	return ft_test_result();
+}
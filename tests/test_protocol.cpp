@@ -0,0 +1,64 @@
+#include "ft_test.hpp"
+
+// greeting, framing of large uploads, unknown opcodes
+
+int main()
+{
+	std::string root = ft_test_directory("protocol");
+
+	ft_test_server server;
+	FT_CHECK(server.spawn(root + "/server", [](ft_server& target)
+		{
+			target.enable_client_validation(false);
+			target.set_max_request_size(1024 * 1024);
+			target.set_upload_piece_size(64 * 1024);
+		}));
+
+	// the server speaks first, with its version
+	{
+		asio::io_context context;
+		asio::ip::tcp::socket socket(context);
+		asio::error_code ec;
+		socket.connect(asio::ip::tcp::endpoint(asio::ip::make_address("127.0.0.1"), server.port), ec);
+		char hello[ft_protocol::hello_size];
+		asio::read(socket, asio::buffer(hello, sizeof(hello)), ec);
+		FT_CHECK(!ec && ft_protocol::check_hello(hello));
+	}
+
+	ft_client client;
+	client.enable_client_validation(false);
+	FT_CHECK(server.connect(client));
+
+	// unknown opcodes are answered and the connection goes on
+	FT_CHECK(!client.exchange(ft_opcode("zzzz"), "name"));
+	FT_CHECK(client.ping() < 1.0f / 0.0f);
+
+	// "have" is a sized answer, one char per hash, 'u' without a chunk store
+	std::string hashes(3 * 32, 'h');
+	FT_CHECK(client.exchange(ft_protocol::have, std::string(), hashes.data(), hashes.size()));
+	FT_CHECK((client.last_incoming_buffer_size() == 3) && (std::string(client.data(), 3) == "uuu"));
+	FT_CHECK(client.ping() < 1.0f / 0.0f);
+
+	// uploads beyond the request size limit are received piece by piece
+	std::string large = ft_test_content(5 * 1024 * 1024 + 3, 7);
+	FT_CHECK(ft_test_write(root + "/large", large));
+	FT_CHECK(client.send_file(root + "/large", "large"));
+	FT_CHECK(client.sync());
+	FT_CHECK(ft_test_read(server.directory + "/large") == large);
+
+	// into a missing directory : read whole all the same, then reported
+	FT_CHECK(client.send_file(root + "/large", "missing/large"));
+	FT_CHECK(!client.sync());
+	FT_CHECK(client.ping() < 1.0f / 0.0f);
+
+	for (const std::filesystem::directory_entry& item : std::filesystem::directory_iterator(server.directory))
+	{
+		FT_CHECK(item.path().filename().string().find(".ft_up") == std::string::npos);
+	}
+
+	client.disconnect();
+	server.kill();
+	std::error_code ec;
+	std::filesystem::remove_all(root, ec);
+	return ft_test_result();
+}
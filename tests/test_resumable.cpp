@@ -0,0 +1,52 @@
+#include "ft_test.hpp"
+
+// resumable uploads are bound to their content, leftovers of other uploads are never resumed
+
+static std::string part_file(const std::string& directory, const std::string& name, const std::string& content)
+{
+	return directory + '/' + name + ".ft_part." + ft_sha256::to_hex(ft_sha256::hash(content.data(), content.size())).substr(0, 32);
+}
+
+int main()
+{
+	std::string root = ft_test_directory("resumable");
+
+	ft_test_server server;
+	FT_CHECK(server.spawn(root + "/server"));
+
+	ft_client client;
+	FT_CHECK(server.connect(client));
+	client.set_send_chunk_size(64 * 1024);
+
+	std::string content = ft_test_content(1024 * 1024 + 5, 11);
+	FT_CHECK(ft_test_write(root + "/file", content));
+
+	// a larger leftover of an earlier version of the destination
+	FT_CHECK(ft_test_write(server.directory + "/dest.ft_part.0123456789abcdef0123456789abcdef", ft_test_content(3 * 1024 * 1024, 12)));
+	FT_CHECK(client.send_file_resumable(root + "/file", "dest"));
+	FT_CHECK(client.sync());
+	FT_CHECK(ft_test_read(server.directory + "/dest") == content);
+	FT_CHECK(!std::filesystem::exists(server.directory + "/dest.ft_part.0123456789abcdef0123456789abcdef"));
+
+	// a correct prefix is resumed
+	FT_CHECK(ft_test_write(part_file(server.directory, "resumed", content), content.substr(0, 500000)));
+	FT_CHECK(client.send_file_resumable(root + "/file", "resumed"));
+	FT_CHECK(client.sync());
+	FT_CHECK(ft_test_read(server.directory + "/resumed") == content);
+
+	// a corrupt prefix is caught by the hash at fin, the next attempt starts over
+	std::string corrupt = content.substr(0, 500000);
+	corrupt[1000] ^= 1;
+	FT_CHECK(ft_test_write(part_file(server.directory, "corrupt", content), corrupt));
+	FT_CHECK(!client.send_file_resumable(root + "/file", "corrupt"));
+	FT_CHECK(!std::filesystem::exists(server.directory + "/corrupt"));
+	FT_CHECK(client.send_file_resumable(root + "/file", "corrupt"));
+	FT_CHECK(client.sync());
+	FT_CHECK(ft_test_read(server.directory + "/corrupt") == content);
+
+	client.disconnect();
+	server.kill();
+	std::error_code ec;
+	std::filesystem::remove_all(root, ec);
+	return ft_test_result();
+}
@@ -0,0 +1,101 @@
+#include "ft_test.hpp"
+#include "ft_sharded_client.hpp"
+
+// placement, replication and read failover over several servers
+
+int main()
+{
+	std::string root = ft_test_directory("sharded");
+
+	constexpr std::size_t number_of_servers = 4;
+	ft_test_server servers[number_of_servers];
+	for (std::size_t n = 0; n < number_of_servers; n++)
+	{
+		FT_CHECK(servers[n].spawn(root + "/server" + std::to_string(n)));
+	}
+
+	ft_sharded_client client;
+	for (ft_test_server& server : servers)
+	{
+		client.add_server("127.0.0.1", server.port);
+	}
+	client.set_replication_factor(2);
+	FT_CHECK(client.connect() == number_of_servers);
+
+	// every file lands on exactly its replicas, and the files spread over all servers
+	constexpr std::uint32_t number_of_files = 32;
+	std::vector<std::size_t> files_per_server(number_of_servers, 0);
+	for (std::uint32_t n = 0; n < number_of_files; n++)
+	{
+		std::string name = "file" + std::to_string(n);
+		std::string content = ft_test_content(1000 + n, n);
+		FT_CHECK(ft_test_write(root + '/' + name, content));
+		FT_CHECK(client.send_file(root + '/' + name, name));
+
+		std::vector<std::size_t> indices = client.replicas(name);
+		FT_CHECK(indices.size() == 2);
+		for (std::size_t k = 0; k < number_of_servers; k++)
+		{
+			bool replica = std::find(indices.begin(), indices.end(), k) != indices.end();
+			bool stored = std::filesystem::exists(servers[k].directory + '/' + name);
+			FT_CHECK(replica == stored);
+			FT_CHECK(!stored || (ft_test_read(servers[k].directory + '/' + name) == content));
+			files_per_server[k] += stored ? 1 : 0;
+		}
+	}
+	for (std::size_t count : files_per_server)
+	{
+		FT_CHECK(count != 0);
+	}
+
+	// the placement does not depend on the order servers were added in
+	ft_sharded_client reversed;
+	for (std::size_t n = number_of_servers; n-- > 0;)
+	{
+		reversed.add_server("127.0.0.1", servers[n].port);
+	}
+	reversed.set_replication_factor(2);
+	for (std::uint32_t n = 0; n < number_of_files; n++)
+	{
+		std::string name = "file" + std::to_string(n);
+		std::vector<std::size_t> indices = client.replicas(name);
+		std::vector<std::size_t> reversed_indices = reversed.replicas(name);
+		for (std::size_t& index : reversed_indices)
+		{
+			index = number_of_servers - 1 - index;
+		}
+		std::sort(indices.begin(), indices.end());
+		std::sort(reversed_indices.begin(), reversed_indices.end());
+		FT_CHECK(indices == reversed_indices);
+	}
+
+	// a replica missing the file does not hide it
+	std::vector<std::size_t> first_replicas = client.replicas("file0");
+	std::error_code ec;
+	std::filesystem::remove(servers[first_replicas[0]].directory + "/file0", ec);
+	FT_CHECK(client.check_file("file0") == 'y');
+	FT_CHECK(client.check_file("missing") == 'n');
+
+	// reads fail over once a server is gone, without waiting on reconnection attempts
+	servers[0].kill();
+	client.client(0).set_reconnect_policy(false, 0, std::chrono::milliseconds(0), std::chrono::milliseconds(0));
+	for (std::uint32_t n = 0; n < number_of_files; n++)
+	{
+		std::string name = "file" + std::to_string(n);
+		if (n == 0)
+		{
+			continue;
+		}
+		FT_CHECK(client.get_file(name, root + "/back"));
+		FT_CHECK(ft_test_read(root + "/back") == ft_test_content(1000 + n, n));
+		FT_CHECK(client.check_file(name) == 'y');
+	}
+
+	client.disconnect();
+	for (ft_test_server& server : servers)
+	{
+		server.kill();
+	}
+	std::filesystem::remove_all(root, ec);
+	return ft_test_result();
+}
@@ -0,0 +1,76 @@
+#include "ft_test.hpp"
+#include "ft_swarm_peer.hpp"
+
+// the server sends about one copy of a file whatever the number of peers downloading it together
+
+// bytes the peers took from the server, zero if a download failed or came back wrong
+static std::uint64_t swarm_download(const ft_test_server& server, const std::string& root, const std::string& name,
+	const std::string& content, std::size_t number_of_peers)
+{
+	std::vector<std::unique_ptr<ft_swarm_peer>> peers;
+	for (std::size_t n = 0; n < number_of_peers; n++)
+	{
+		peers.push_back(std::make_unique<ft_swarm_peer>());
+		peers.back()->set_download_timeout(std::chrono::milliseconds(20000));
+		if (!peers.back()->start() || !(peers.back()->connect("127.0.0.1", server.port) < 1.0f / 0.0f))
+		{
+			return 0;
+		}
+	}
+
+	std::vector<char> done(number_of_peers, 0);
+	std::vector<std::thread> threads;
+	for (std::size_t n = 0; n < number_of_peers; n++)
+	{
+		threads.emplace_back([&, n]()
+			{
+				std::string destination = root + '/' + name + '_' + std::to_string(n);
+				done[n] = (peers[n]->download(name, destination) && (ft_test_read(destination) == content)) ? 1 : 0;
+			});
+	}
+	for (std::thread& thread : threads)
+	{
+		thread.join();
+	}
+
+	std::uint64_t from_server = 0;
+	for (std::size_t n = 0; n < number_of_peers; n++)
+	{
+		if (done[n] == 0)
+		{
+			return 0;
+		}
+		from_server += peers[n]->m_bytes_from_server;
+	}
+	return from_server;
+}
+
+int main()
+{
+	std::string root = ft_test_directory("swarm");
+
+	ft_test_server server;
+	FT_CHECK(server.spawn(root + "/server", [](ft_server& target) { target.set_swarm_piece_size(64 * 1024); }));
+
+	std::string content = ft_test_content(4 * 1024 * 1024 + 5, 1);
+	FT_CHECK(ft_test_write(server.directory + "/file2", content));
+	FT_CHECK(ft_test_write(server.directory + "/file16", content));
+
+	std::uint64_t few = swarm_download(server, root, "file2", content, 2);
+	std::uint64_t many = swarm_download(server, root, "file16", content, 16);
+	std::cout << "from the server : " << few << " bytes for 2 peers, " << many << " bytes for 16 peers" << std::endl;
+	FT_CHECK(few >= content.size());
+	FT_CHECK(many >= content.size());
+	FT_CHECK(many <= 2 * content.size());
+
+	// a name the server does not have
+	ft_swarm_peer peer;
+	FT_CHECK(peer.start() && (peer.connect("127.0.0.1", server.port) < 1.0f / 0.0f));
+	FT_CHECK(!peer.download("missing", root + "/missing"));
+	peer.stop();
+
+	server.kill();
+	std::error_code ec;
+	std::filesystem::remove_all(root, ec);
+	return ft_test_result();
+}
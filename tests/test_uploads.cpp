@@ -0,0 +1,76 @@
+#include "ft_test.hpp"
+
+// atomic uploads through the group commit, acknowledged by "sync"
+
+int main()
+{
+	std::string root = ft_test_directory("uploads");
+
+	ft_test_server server;
+	FT_CHECK(server.spawn(root + "/server", [](ft_server& target) { target.set_sync_latency(std::chrono::microseconds(5000)); }));
+
+	ft_client client;
+	FT_CHECK(server.connect(client));
+
+	// many small uploads share sync cycles, "sync" returns once all of them are in place
+	std::vector<std::string> contents;
+	for (std::uint32_t n = 0; n < 64; n++)
+	{
+		contents.push_back(ft_test_content(100 + 37 * n, n));
+		std::string local = root + "/local" + std::to_string(n);
+		FT_CHECK(ft_test_write(local, contents.back()));
+		FT_CHECK(client.send_file(local, "file" + std::to_string(n)));
+	}
+	FT_CHECK(client.sync());
+	for (std::uint32_t n = 0; n < 64; n++)
+	{
+		FT_CHECK(ft_test_read(server.directory + "/file" + std::to_string(n)) == contents[n]);
+	}
+
+	// streamed in several chunks, read back right after the acknowledgement
+	std::string large = ft_test_content(3 * 1024 * 1024 + 11, 1000);
+	FT_CHECK(ft_test_write(root + "/large", large));
+	client.set_send_chunk_size(256 * 1024);
+	FT_CHECK(client.send_file(root + "/large", "large"));
+	FT_CHECK(client.sync());
+	FT_CHECK(client.get_file("large", root + "/large_back"));
+	FT_CHECK(ft_test_read(root + "/large_back") == large);
+
+	// a file that cannot be written fails the next "sync" only
+	FT_CHECK(client.send_file(root + "/local0", "missing/directory/file"));
+	FT_CHECK(!client.sync());
+	FT_CHECK(client.sync());
+
+	// no temp file is left behind
+	for (const std::filesystem::directory_entry& item : std::filesystem::directory_iterator(server.directory))
+	{
+		FT_CHECK(item.path().filename().string().find(".ft_tmp") == std::string::npos);
+	}
+
+	// durable appends
+	for (int n = 0; n < 3; n++)
+	{
+		FT_CHECK(client.append_text("line\n", "log"));
+	}
+	FT_CHECK(client.sync());
+	FT_CHECK(ft_test_read(server.directory + "/log") == "line\nline\nline\n");
+
+	// "app" and "rem" right behind an upload of the same name still waiting for its sync cycle
+	for (std::uint32_t n = 0; n < 8; n++)
+	{
+		FT_CHECK(client.send_file(root + "/local1", "ordered"));
+		FT_CHECK(client.append_text("tail", "ordered"));
+		FT_CHECK(client.sync());
+		FT_CHECK(ft_test_read(server.directory + "/ordered") == contents[1] + "tail");
+		FT_CHECK(client.send_file(root + "/local2", "ordered"));
+		client.remove_file("ordered");
+		FT_CHECK(client.sync());
+		FT_CHECK(!std::filesystem::exists(server.directory + "/ordered"));
+	}
+
+	client.disconnect();
+	server.kill();
+	std::error_code ec;
+	std::filesystem::remove_all(root, ec);
+	return ft_test_result();
+}
@@ -0,0 +1,110 @@
+#include "ft_test.hpp"
+
+#include <set>
+
+// pushes reach a reading subscriber while another one never reads, subscriptions survive a reconnection
+
+int main()
+{
+	std::string root = ft_test_directory("watch");
+
+	ft_test_server server;
+	FT_CHECK(server.spawn(root + "/server", [](ft_server&) {}));
+	std::error_code ec;
+	std::filesystem::create_directories(server.directory + "/dir", ec);
+
+	ft_client reader;
+	ft_client idle;
+	ft_client writer;
+	FT_CHECK(server.connect(reader) && server.connect(idle) && server.connect(writer));
+	FT_CHECK(idle.watch("dir"));
+	FT_CHECK(reader.watch("dir"));
+
+	std::string content = ft_test_content(64 * 1024, 1);
+	FT_CHECK(ft_test_write(root + "/local", content));
+	std::set<std::string> expected;
+	for (int n = 0; n < 200; n++)
+	{
+		std::string name = "dir/file" + std::to_string(n);
+		expected.insert(name);
+		FT_CHECK(writer.send_file(root + "/local", name));
+	}
+	FT_CHECK(writer.sync());
+
+	std::vector<ft_watch_event> events;
+	while (!expected.empty() && reader.read_watch_events(events))
+	{
+		for (const ft_watch_event& event : events)
+		{
+			for (auto it = expected.begin(); it != expected.end(); ++it)
+			{
+				if ((event.path.size() >= it->size()) && (event.path.compare(event.path.size() - it->size(), it->size(), *it) == 0))
+				{
+					expected.erase(it);
+					break;
+				}
+			}
+		}
+	}
+	FT_CHECK(expected.empty());
+
+	reader.disconnect();
+	idle.disconnect();
+	writer.disconnect();
+
+	// two paths on one connection, resubscribed after a restart while both keep changing : pushes for the first
+	// path arrive ahead of the answer to the second watch and must not be taken for it
+	std::filesystem::create_directories(server.directory + "/first", ec);
+	std::filesystem::create_directories(server.directory + "/second", ec);
+	ft_client watcher;
+	FT_CHECK(server.connect(watcher));
+	FT_CHECK(watcher.watch("first") && watcher.watch("second"));
+
+	std::atomic<bool> writing{ false };
+	std::atomic<int> generation{ 0 };
+	auto write_files = [&]()
+	{
+		for (int n = 0; writing; n++)
+		{
+			std::string name = "g" + std::to_string(generation.load()) + '_' + std::to_string(n);
+			ft_test_write(server.directory + "/first/" + name, "x");
+			ft_test_write(server.directory + "/second/" + name, "x");
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	};
+
+	for (int round = 1; round <= 3; round++)
+	{
+		// no thread of ours runs while the server is forked
+		FT_CHECK(server.restart());
+		generation = round;
+		writing = true;
+		std::thread files(write_files);
+
+		std::string tag = "/g" + std::to_string(round) + '_';
+		bool first_seen = false;
+		bool second_seen = false;
+		for (int batch = 0; (batch < 10000) && !(first_seen && second_seen); batch++)
+		{
+			if (!watcher.read_watch_events(events))
+			{
+				break;
+			}
+			for (const ft_watch_event& event : events)
+			{
+				FT_CHECK((event.kind == 'c') || (event.kind == 'm') || (event.kind == 'r'));
+				first_seen = first_seen || ((event.path.rfind("first" + tag, 0) == 0));
+				second_seen = second_seen || ((event.path.rfind("second" + tag, 0) == 0));
+			}
+		}
+		FT_CHECK(first_seen && second_seen);
+
+		writing = false;
+		files.join();
+	}
+
+	watcher.disconnect();
+	server.kill();
+	std::filesystem::remove_all(root, ec);
+	return ft_test_result();
+}